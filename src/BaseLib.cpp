@@ -47,6 +47,8 @@ SharedObjects::SharedObjects(bool testMaxThreadCount)
 	settings.init(this);
 	out.init(this);
 	globalServiceMessages.init(this);
+	httpConnectionPool.init(this);
+	ssdpMonitor.init(this);
 }
 
 SharedObjects::~SharedObjects()
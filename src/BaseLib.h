@@ -38,6 +38,7 @@
 #include "Encoding/RpcDecoder.h"
 #include "Encoding/RpcEncoder.h"
 #include "Encoding/RpcMethod.h"
+#include "Encoding/RpcMulticall.h"
 #include "Encoding/BinaryRpc.h"
 #include "Encoding/JsonDecoder.h"
 #include "Encoding/JsonEncoder.h"
@@ -45,6 +46,7 @@
 #include "Encoding/Html.h"
 #include "Encoding/WebSocket.h"
 #include "Encoding/BitReaderWriter.h"
+#include "Encoding/GZip.h"
 #include "Managers/SerialDeviceManager.h"
 #include "Managers/FileDescriptorManager.h"
 #include "Managers/ThreadManager.h"
@@ -76,9 +78,12 @@
 #include "Systems/UpdateInfo.h"
 #include "Licensing/LicensingFactory.h"
 #include "Sockets/Ssdp.h"
+#include "Sockets/SsdpMonitor.h"
 #include "IQueue.h"
 #include "ITimedQueue.h"
+#include "Sockets/AsyncHttpClient.h"
 #include "Sockets/HttpClient.h"
+#include "Sockets/HttpConnectionPool.h"
 #include "Sockets/HttpServer.h"
 #include "Sockets/Modbus.h"
 #include "Sockets/TcpSocket.h"
@@ -176,6 +181,17 @@ public:
 	 */
 	Systems::GlobalServiceMessages globalServiceMessages;
 
+	/**
+	 * Persistent HTTP connections shared by all HttpClient objects with enabled connection pool. Declared after the managers, so pooled sockets are closed
+	 * before the managers are destroyed.
+	 */
+	HttpConnectionPool httpConnectionPool;
+
+	/**
+	 * Device table of all SSDP announcements shared by all device families. Started on first use.
+	 */
+	SsdpMonitor ssdpMonitor;
+
 	/**
 	 * Main constructor.
 	 *
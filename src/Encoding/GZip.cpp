@@ -0,0 +1,105 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * 
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "GZip.h"
+
+#include <cstring>
+
+#include <zlib.h>
+
+namespace BaseLib
+{
+
+void GZip::compress(const char* data, size_t size, std::vector<char>& out, bool gzip, int32_t level)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(z_stream));
+	//15 is the maximum window size, adding 16 selects the gzip format.
+	if(deflateInit2(&stream, level, Z_DEFLATED, gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) throw GZipException("Could not initialize zlib stream.");
+
+	size_t outStart = out.size();
+	out.resize(outStart + deflateBound(&stream, size) + (gzip ? 18 : 0));
+	stream.next_in = (Bytef*)data;
+	stream.avail_in = size;
+	stream.next_out = (Bytef*)out.data() + outStart;
+	stream.avail_out = out.size() - outStart;
+	int32_t result = deflate(&stream, Z_FINISH);
+	size_t compressedSize = stream.total_out;
+	deflateEnd(&stream);
+	if(result != Z_STREAM_END)
+	{
+		out.resize(outStart);
+		throw GZipException("Could not compress data: " + std::to_string(result));
+	}
+	out.resize(outStart + compressedSize);
+}
+
+void GZip::uncompress(const char* data, size_t size, std::vector<char>& out)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(z_stream));
+	//Adding 32 to the window size enables automatic gzip and zlib header detection.
+	if(inflateInit2(&stream, 15 + 32) != Z_OK) throw GZipException("Could not initialize zlib stream.");
+
+	size_t outStart = out.size();
+	stream.next_in = (Bytef*)data;
+	stream.avail_in = size;
+	int32_t result = Z_OK;
+	while(result != Z_STREAM_END)
+	{
+		size_t outSize = out.size();
+		if(outSize - outStart > 104857600)
+		{
+			inflateEnd(&stream);
+			out.resize(outStart);
+			throw GZipException("Data is larger than 100 MiB.");
+		}
+		out.resize(outSize + (size * 4 > 16384 ? size * 4 : 16384));
+		stream.next_out = (Bytef*)out.data() + outSize;
+		stream.avail_out = out.size() - outSize;
+		result = inflate(&stream, Z_NO_FLUSH);
+		out.resize(out.size() - stream.avail_out);
+		if(result != Z_OK && result != Z_STREAM_END)
+		{
+			inflateEnd(&stream);
+			out.resize(outStart);
+			throw GZipException("Could not decompress data: " + std::to_string(result));
+		}
+		if(result == Z_OK && stream.avail_in == 0 && stream.avail_out != 0)
+		{
+			inflateEnd(&stream);
+			out.resize(outStart);
+			throw GZipException("Could not decompress data: Unexpected end of data.");
+		}
+	}
+	inflateEnd(&stream);
+}
+
+}
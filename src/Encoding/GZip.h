@@ -0,0 +1,81 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * 
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef GZIP_H_
+#define GZIP_H_
+
+#include "../Exception.h"
+
+#include <string>
+#include <vector>
+
+namespace BaseLib
+{
+
+class GZipException : public BaseLib::Exception
+{
+public:
+	GZipException(std::string message) : BaseLib::Exception(message) {}
+};
+
+/**
+ * Compresses and decompresses data using zlib. Programs using this class need to link against zlib ("-lz").
+ */
+class GZip
+{
+public:
+	virtual ~GZip() {}
+
+	/**
+	 * Compresses data.
+	 *
+	 * @param[in] data The data to compress.
+	 * @param[in] size The size of "data".
+	 * @param[out] out The vector the compressed data is appended to.
+	 * @param[in] gzip (Optional, default "true") Use the gzip format. When set to "false", the zlib format is used as required for "Content-Encoding: deflate".
+	 * @param[in] level (Optional, default "6") The compression level between 1 (fastest) and 9 (smallest).
+	 * @throws GZipException Thrown on zlib errors.
+	 */
+	static void compress(const char* data, size_t size, std::vector<char>& out, bool gzip = true, int32_t level = 6);
+
+	/**
+	 * Decompresses data in gzip or zlib format. The format is detected automatically.
+	 *
+	 * @param[in] data The data to decompress.
+	 * @param[in] size The size of "data".
+	 * @param[out] out The vector the decompressed data is appended to.
+	 * @throws GZipException Thrown on zlib errors or when the decompressed data is larger than 100 MiB.
+	 */
+	static void uncompress(const char* data, size_t size, std::vector<char>& out);
+private:
+	GZip() {}
+};
+}
+#endif
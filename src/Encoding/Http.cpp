@@ -32,18 +32,80 @@
 #include "../HelperFunctions/Math.h"
 #include "../HelperFunctions/HelperFunctions.h"
 
+#include <array>
+
+#include <fcntl.h>
+#include <unistd.h>
+
 namespace BaseLib
 {
 
+struct Http::FormDataStream
+{
+	enum class State { preamble, delimiterEnd, partHeader, partData, epilogue };
+
+	State state = State::preamble;
+
+	/**
+	 * CRLF + "--" + boundary.
+	 */
+	std::string delimiter;
+
+	/**
+	 * Boyer-Moore-Horspool shift table for "delimiter".
+	 */
+	std::array<size_t, 256> shiftTable;
+
+	/**
+	 * Received data not processed yet. Only the bytes which might be the beginning of a delimiter or an incomplete part header are kept.
+	 */
+	std::vector<char> buffer;
+	std::shared_ptr<FormData> part;
+	int32_t fileDescriptor = -1;
+	uint64_t contentSize = 0;
+	std::set<std::shared_ptr<FormData>> formData;
+
+	FormDataStream(const std::string& boundary)
+	{
+		delimiter = "\r\n--" + boundary;
+		shiftTable.fill(delimiter.size());
+		for(size_t i = 0; i < delimiter.size() - 1; i++)
+		{
+			shiftTable[(uint8_t)delimiter[i]] = delimiter.size() - 1 - i;
+		}
+		//The first delimiter has no leading CRLF.
+		buffer.reserve(16384);
+		buffer.push_back('\r');
+		buffer.push_back('\n');
+	}
+
+	const char* findDelimiter(const char* data, size_t size)
+	{
+		size_t delimiterSize = delimiter.size();
+		if(size < delimiterSize) return nullptr;
+		const char lastChar = delimiter.back();
+		size_t pos = 0;
+		while(pos <= size - delimiterSize)
+		{
+			char currentChar = data[pos + delimiterSize - 1];
+			if(currentChar == lastChar && memcmp(data + pos, delimiter.data(), delimiterSize - 1) == 0) return data + pos;
+			pos += shiftTable[(uint8_t)currentChar];
+		}
+		return nullptr;
+	}
+};
+
 std::string Http::getMimeType(std::string extension)
 {
-	if(_extMimeTypeMap.find(extension) != _extMimeTypeMap.end()) return _extMimeTypeMap[extension];
+	auto mimeTypeIterator = _extMimeTypeMap.find(extension);
+	if(mimeTypeIterator != _extMimeTypeMap.end()) return mimeTypeIterator->second;
 	return "";
 }
 
 std::string Http::getStatusText(int32_t code)
 {
-	if(_statusCodeMap.find(code) != _statusCodeMap.end()) return _statusCodeMap[code];
+	auto statusCodeIterator = _statusCodeMap.find(code);
+	if(statusCodeIterator != _statusCodeMap.end()) return statusCodeIterator->second;
 	return "";
 }
 
@@ -52,21 +114,9 @@ std::set<std::shared_ptr<Http::FormData>> Http::decodeMultipartFormdata()
 	std::set<std::shared_ptr<FormData>> formData;
 	if(_header.contentType != "multipart/form-data") return formData;
 
-	std::string temp(_content.data(), _content.size());
-
-	std::string boundary;
-	std::vector<std::string> parts = HelperFunctions::splitAll(_header.contentTypeFull, ';');
-	for(auto& part : parts)
-	{
-		auto arg = HelperFunctions::splitFirst(part, '=');
-		HelperFunctions::trim(arg.first);
-		if(arg.first == "boundary")
-		{
-			boundary = HelperFunctions::trim(arg.second);
-			break;
-		}
-	}
+	if(_formDataStream) return _formDataStream->formData;
 
+	std::string boundary = getMultipartBoundary(_header.contentTypeFull, ';');
 	if(boundary.empty()) return formData;
 
 	char* pos = _content.data();
@@ -75,6 +125,18 @@ std::set<std::shared_ptr<Http::FormData>> Http::decodeMultipartFormdata()
 	return formData;
 }
 
+std::string Http::getMultipartBoundary(const std::string& contentTypeFull, char separator)
+{
+	std::vector<std::string> parts = HelperFunctions::splitAll(contentTypeFull, separator);
+	for(auto& part : parts)
+	{
+		auto arg = HelperFunctions::splitFirst(part, '=');
+		HelperFunctions::trim(arg.first);
+		if(arg.first == "boundary") return HelperFunctions::trim(arg.second);
+	}
+	return "";
+}
+
 char* Http::findNextString(std::string& needle, char* buffer, size_t bufferSize)
 {
 	if(needle.size() > bufferSize) return nullptr;
@@ -94,6 +156,42 @@ char* Http::findNextString(std::string& needle, char* buffer, size_t bufferSize)
 	return pos;
 }
 
+void Http::processFormDataHeaderField(std::shared_ptr<FormData>& formData, std::string& name, std::string& value)
+{
+	formData->header.emplace(name, value);
+	if(name == "content-disposition")
+	{
+		formData->contentDisposition = value;
+
+		std::vector<std::string> parts;
+		std::string args = HelperFunctions::splitFirst(value, ';').second;
+		if(args.empty())
+		{
+			args = HelperFunctions::splitFirst(value, ',').second;
+			parts = HelperFunctions::splitAll(value, ',');
+		}
+		else parts = HelperFunctions::splitAll(value, ';');
+
+		for(auto& part : parts)
+		{
+			auto arg = HelperFunctions::splitFirst(part, '=');
+			HelperFunctions::trim(arg.first);
+			HelperFunctions::toLower(arg.first);
+			HelperFunctions::trim(arg.second);
+			if(arg.second.size() > 1 && arg.second.front() == '"' && arg.second.back() == '"') arg.second = arg.second.substr(1, arg.second.size() - 2);
+			if(arg.first == "name") formData->name = arg.second;
+			if(arg.first == "filename") formData->filename = arg.second;
+		}
+	}
+	else if(name == "content-type")
+	{
+		formData->contentTypeFull = value;
+		formData->contentType = HelperFunctions::splitFirst(value, ',').first;
+		formData->contentType = HelperFunctions::splitFirst(value, ';').first;
+		HelperFunctions::toLower(formData->contentType);
+	}
+}
+
 std::set<std::shared_ptr<Http::FormData>> Http::decodeMultipartMixed(std::string& boundary, char* buffer, size_t bufferSize, char** pos)
 {
 	std::set<std::shared_ptr<FormData>> formData;
@@ -153,38 +251,7 @@ std::set<std::shared_ptr<Http::FormData>> Http::decodeMultipartMixed(std::string
 					HelperFunctions::toLower(name);
 					std::string value(valuePos, valueSize);
 
-					blockData->header.emplace(name, value);
-					if(name == "content-disposition")
-					{
-						blockData->contentDisposition = value;
-
-						std::vector<std::string> parts;
-						std::string args = HelperFunctions::splitFirst(value, ';').second;
-						if(args.empty())
-						{
-							args = HelperFunctions::splitFirst(value, ',').second;
-							parts = HelperFunctions::splitAll(value, ',');
-						}
-						else parts = HelperFunctions::splitAll(value, ';');
-
-						for(auto& part : parts)
-						{
-							auto arg = HelperFunctions::splitFirst(part, '=');
-							HelperFunctions::trim(arg.first);
-							HelperFunctions::toLower(arg.first);
-							HelperFunctions::trim(arg.second);
-							if(arg.second.size() > 1 && arg.second.front() == '"' && arg.second.back() == '"') arg.second = arg.second.substr(1, arg.second.size() - 2);
-							if(arg.first == "name") blockData->name = arg.second;
-							if(arg.first == "filename") blockData->filename = arg.second;
-						}
-					}
-					else if(name == "content-type")
-					{
-						blockData->contentTypeFull = value;
-						blockData->contentType = HelperFunctions::splitFirst(value, ',').first;
-						blockData->contentType = HelperFunctions::splitFirst(value, ';').first;
-						HelperFunctions::toLower(blockData->contentType);
-					}
+					processFormDataHeaderField(blockData, name, value);
 				}
 
 				*pos = newlinePos + crlfOffset;
@@ -192,18 +259,7 @@ std::set<std::shared_ptr<Http::FormData>> Http::decodeMultipartMixed(std::string
 
 			if(blockData->contentType == "multipart/mixed")
 			{
-				std::string innerBoundary;
-				std::vector<std::string> parts = HelperFunctions::splitAll(blockData->contentTypeFull, blockData->contentTypeFull.find(',') == std::string::npos ? ';' : ',');
-				for(auto& part : parts)
-				{
-					auto arg = HelperFunctions::splitFirst(part, '=');
-					HelperFunctions::trim(arg.first);
-					if(arg.first == "boundary")
-					{
-						innerBoundary = HelperFunctions::trim(arg.second);
-						break;
-					}
-				}
+				std::string innerBoundary = getMultipartBoundary(blockData->contentTypeFull, blockData->contentTypeFull.find(',') == std::string::npos ? ';' : ',');
 
 				if(innerBoundary.empty()) continue;
 
@@ -231,7 +287,225 @@ std::set<std::shared_ptr<Http::FormData>> Http::decodeMultipartMixed(std::string
 	return formData;
 }
 
-void Http::constructHeader(uint32_t contentLength, std::string contentType, int32_t code, std::string codeDescription, std::vector<std::string>& additionalHeaders, std::string& header)
+// {{{ Incremental multipart/form-data decoding
+void Http::startFormDataStream()
+{
+	_formDataStream.reset();
+	if((!_formDataCallback && _formDataDirectory.empty()) || _header.contentType != "multipart/form-data") return;
+	std::string boundary = getMultipartBoundary(_header.contentTypeFull, ';');
+	if(boundary.empty()) return;
+	_formDataStream = std::make_shared<FormDataStream>(boundary);
+}
+
+void Http::appendContent(const char* data, size_t size)
+{
+	if(_formDataStream)
+	{
+		_formDataStream->contentSize += size;
+		processFormDataStream(data, size);
+	}
+	else _content.insert(_content.end(), data, data + size);
+}
+
+void Http::processFormDataStream(const char* data, size_t size)
+{
+	FormDataStream& stream = *_formDataStream;
+	if(stream.state == FormDataStream::State::epilogue) return;
+	stream.buffer.insert(stream.buffer.end(), data, data + size);
+
+	size_t delimiterSize = stream.delimiter.size();
+	size_t pos = 0;
+	while(pos < stream.buffer.size())
+	{
+		const char* start = stream.buffer.data() + pos;
+		size_t remainingBytes = stream.buffer.size() - pos;
+		if(stream.state == FormDataStream::State::preamble || stream.state == FormDataStream::State::partData)
+		{
+			const char* delimiterPos = stream.findDelimiter(start, remainingBytes);
+			if(!delimiterPos)
+			{
+				//Keep the bytes which might be the start of a delimiter.
+				size_t safeBytes = remainingBytes >= delimiterSize ? remainingBytes - (delimiterSize - 1) : 0;
+				if(stream.state == FormDataStream::State::partData) writeFormDataPart(start, safeBytes);
+				pos += safeBytes;
+				break;
+			}
+			if(stream.state == FormDataStream::State::partData)
+			{
+				writeFormDataPart(start, delimiterPos - start);
+				finishFormDataPart();
+			}
+			pos += (delimiterPos - start) + delimiterSize;
+			stream.state = FormDataStream::State::delimiterEnd;
+		}
+		else if(stream.state == FormDataStream::State::delimiterEnd)
+		{
+			if(remainingBytes < 2) break;
+			if(start[0] == '-' && start[1] == '-')
+			{
+				stream.state = FormDataStream::State::epilogue;
+				pos = stream.buffer.size();
+				break;
+			}
+			//Skip transport padding and CRLF
+			const char* newlinePos = (const char*)memchr(start, '\n', remainingBytes);
+			if(!newlinePos)
+			{
+				if(remainingBytes > 1024) throw HttpException("Could not parse multipart data: Delimiter line is too long.");
+				break;
+			}
+			pos += (newlinePos - start) + 1;
+			stream.state = FormDataStream::State::partHeader;
+		}
+		else if(stream.state == FormDataStream::State::partHeader)
+		{
+			size_t headerSize = 0;
+			const char* headerEnd = nullptr;
+			if(start[0] == '\n')
+			{
+				//Part without header fields. Checked first, as a blank line within the part's data would be taken as the end of the header otherwise.
+				headerEnd = start;
+				headerSize = 1;
+			}
+			else if(start[0] == '\r')
+			{
+				if(remainingBytes < 2) break;
+				if(start[1] == '\n')
+				{
+					headerEnd = start;
+					headerSize = 2;
+				}
+			}
+			if(!headerEnd)
+			{
+				headerEnd = (const char*)memmem(start, remainingBytes, "\r\n\r\n", 4);
+				if(headerEnd) headerSize = (headerEnd - start) + 4;
+				else
+				{
+					headerEnd = (const char*)memmem(start, remainingBytes, "\n\n", 2);
+					if(headerEnd) headerSize = (headerEnd - start) + 2;
+				}
+			}
+			if(!headerEnd)
+			{
+				if(remainingBytes > 16384) throw HttpException("Could not parse multipart data: Part header is larger than 16 KiB.");
+				break;
+			}
+
+			stream.part = std::make_shared<FormData>();
+			const char* lineStart = start;
+			while(lineStart < headerEnd)
+			{
+				const char* lineEnd = (const char*)memchr(lineStart, '\n', headerEnd - lineStart);
+				if(!lineEnd) lineEnd = headerEnd;
+				const char* colonPos = (const char*)memchr(lineStart, ':', lineEnd - lineStart);
+				if(colonPos)
+				{
+					std::string name(lineStart, colonPos - lineStart);
+					std::string value(colonPos + 1, lineEnd - (colonPos + 1));
+					HelperFunctions::trim(name);
+					HelperFunctions::toLower(name);
+					HelperFunctions::trim(value);
+					processFormDataHeaderField(stream.part, name, value);
+				}
+				lineStart = lineEnd + 1;
+			}
+			startFormDataPart();
+			pos += headerSize;
+			stream.state = FormDataStream::State::partData;
+		}
+		else
+		{
+			pos = stream.buffer.size();
+			break;
+		}
+	}
+	stream.buffer.erase(stream.buffer.begin(), stream.buffer.begin() + pos);
+}
+
+void Http::startFormDataPart()
+{
+	FormDataStream& stream = *_formDataStream;
+	if(_formDataCallback || stream.part->filename.empty() || stream.part->contentType == "multipart/mixed") return;
+
+	std::string path = _formDataDirectory;
+	if(path.back() != '/') path.push_back('/');
+	path.append("homegear-upload-XXXXXX");
+	std::vector<char> pathTemplate(path.begin(), path.end());
+	pathTemplate.push_back('\0');
+	stream.fileDescriptor = mkostemp(pathTemplate.data(), O_CLOEXEC);
+	if(stream.fileDescriptor == -1) throw HttpException("Could not create temporary file in \"" + _formDataDirectory + "\": " + std::string(strerror(errno)), 500);
+	stream.part->filePath = pathTemplate.data();
+}
+
+void Http::writeFormDataPart(const char* data, size_t size)
+{
+	if(size == 0) return;
+	FormDataStream& stream = *_formDataStream;
+	if(_formDataCallback) _formDataCallback(stream.part, data, size, false);
+	else if(stream.fileDescriptor != -1)
+	{
+		while(size > 0)
+		{
+			ssize_t bytesWritten = write(stream.fileDescriptor, data, size);
+			if(bytesWritten == -1)
+			{
+				if(errno == EINTR) continue;
+				throw HttpException("Could not write to \"" + stream.part->filePath + "\": " + std::string(strerror(errno)), 500);
+			}
+			data += bytesWritten;
+			size -= bytesWritten;
+		}
+	}
+	else
+	{
+		if(!stream.part->data) stream.part->data = std::make_shared<std::vector<char>>();
+		if(stream.part->data->size() + size > _maxContentSize) throw HttpException("Data is larger than " + std::to_string(_maxContentSize) + " bytes.");
+		stream.part->data->insert(stream.part->data->end(), data, data + size);
+	}
+}
+
+void Http::finishFormDataPart()
+{
+	FormDataStream& stream = *_formDataStream;
+	if(_formDataCallback) _formDataCallback(stream.part, nullptr, 0, true);
+	if(stream.fileDescriptor != -1)
+	{
+		::close(stream.fileDescriptor);
+		stream.fileDescriptor = -1;
+	}
+	if(stream.part->contentType == "multipart/mixed" && stream.part->data)
+	{
+		std::string innerBoundary = getMultipartBoundary(stream.part->contentTypeFull, stream.part->contentTypeFull.find(',') == std::string::npos ? ';' : ',');
+		if(!innerBoundary.empty())
+		{
+			char* pos = stream.part->data->data();
+			stream.part->multipartMixed = decodeMultipartMixed(innerBoundary, stream.part->data->data(), stream.part->data->size(), &pos);
+		}
+		stream.part->data.reset();
+	}
+	stream.formData.emplace(stream.part);
+	stream.part.reset();
+}
+
+void Http::clearFormDataStream()
+{
+	if(!_formDataStream) return;
+	if(_formDataStream->fileDescriptor != -1)
+	{
+		::close(_formDataStream->fileDescriptor);
+		_formDataStream->fileDescriptor = -1;
+		unlink(_formDataStream->part->filePath.c_str());
+	}
+	for(auto& formData : _formDataStream->formData)
+	{
+		if(!formData->filePath.empty()) unlink(formData->filePath.c_str());
+	}
+	_formDataStream.reset();
+}
+// }}}
+
+void Http::constructHeader(uint32_t contentLength, std::string contentType, int32_t code, std::string codeDescription, std::vector<std::string>& additionalHeaders, std::string& header, bool keepAlive)
 {
 	std::string additionalHeader;
 	additionalHeader.reserve(1024);
@@ -248,131 +522,131 @@ void Http::constructHeader(uint32_t contentLength, std::string contentType, int3
 
 	header.reserve(1024);
 	header.append("HTTP/1.1 " + std::to_string(code) + " " + codeDescription + "\r\n");
-	header.append("Connection: close\r\n");
+	header.append(keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
 	if(!contentType.empty()) header.append("Content-Type: " + contentType + "\r\n");
 	header.append(additionalHeader);
 	header.append("Content-Length: ").append(std::to_string(contentLength)).append("\r\n\r\n");
 }
 
+const std::map<std::string, std::string> Http::_extMimeTypeMap = {
+	{"html", "text/html"},
+	{"htm", "text/html"},
+	{"js", "text/javascript"},
+	{"css", "text/css"},
+	{"gif", "image/gif"},
+	{"jpg", "image/jpeg"},
+	{"jpeg", "image/jpeg"},
+	{"jpe", "image/jpeg"},
+	{"pdf", "application/pdf"},
+	{"png", "image/png"},
+	{"svg", "image/svg+xml"},
+	{"txt", "text/plain"},
+	{"webm", "video/webm"},
+	{"ogv", "video/ogg"},
+	{"ogg", "video/ogg"},
+	{"3gp", "video/3gpp"},
+	{"apk", "application/vnd.android.package-archive"},
+	{"avi", "video/x-msvideo"},
+	{"bmp", "image/x-ms-bmp"},
+	{"csv", "text/comma-separated-values"},
+	{"doc", "application/msword"},
+	{"docx", "application/msword"},
+	{"flac", "audio/flac"},
+	{"gz", "application/x-gzip"},
+	{"gzip", "application/x-gzip"},
+	{"ics", "text/calendar"},
+	{"kml", "application/vnd.google-earth.kml+xml"},
+	{"kmz", "application/vnd.google-earth.kmz"},
+	{"m4a", "audio/mp4"},
+	{"mp3", "audio/mpeg"},
+	{"mp4", "video/mp4"},
+	{"mpg", "video/mpeg"},
+	{"mpeg", "video/mpeg"},
+	{"mov", "video/quicktime"},
+	{"odp", "application/vnd.oasis.opendocument.presentation"},
+	{"ods", "application/vnd.oasis.opendocument.spreadsheet"},
+	{"odt", "application/vnd.oasis.opendocument.text"},
+	{"oga", "audio/ogg"},
+	{"pptx", "application/vnd.ms-powerpoint"},
+	{"pps", "application/vnd.ms-powerpoint"},
+	{"qt", "video/quicktime"},
+	{"swf", "application/x-shockwave-flash"},
+	{"tar", "application/x-tar"},
+	{"text", "text/plain"},
+	{"tif", "image/tiff"},
+	{"tiff", "image/tiff"},
+	{"wav", "audio/wav"},
+	{"wmv", "video/x-ms-wmv"},
+	{"xls", "application/vnd.ms-excel"},
+	{"xlsx", "application/vnd.ms-excel"},
+	{"zip", "application/zip"},
+	{"xml", "application/xml"},
+	{"xsl", "application/xml"},
+	{"xsd", "application/xml"},
+
+	{"xhtml", "application/xhtml+xml"},
+	{"json", "application/json"},
+	{"dtd", "application/xml-dtd"},
+	{"xslt", "application/xslt+xml"},
+	{"java", "text/x-java-source,java"}
+};
+
+const std::map<int32_t, std::string> Http::_statusCodeMap = {
+	{100, "Continue"},
+	{101, "Switching Protocols"},
+	{200, "OK"},
+	{201, "Created"},
+	{202, "Accepted"},
+	{203, "Non-Authoritative Information"},
+	{204, "No Content"},
+	{205, "Reset Content"},
+	{206, "Partial Content"},
+	{300, "Multiple Choices"},
+	{301, "Moved Permanently"},
+	{302, "Found"},
+	{303, "See Other"},
+	{304, "Not Modified"},
+	{305, "Use Proxy"},
+	{307, "Temporary Redirect"},
+	{308, "Permanent Redirect"},
+	{400, "Bad Request"},
+	{401, "Unauthorized"},
+	{402, "Payment Required"},
+	{403, "Forbidden"},
+	{404, "Not Found"},
+	{405, "Method Not Allowed"},
+	{406, "Not Acceptable"},
+	{407, "Proxy Authentication Required"},
+	{408, "Request Timeout"},
+	{409, "Conflict"},
+	{410, "Gone"},
+	{411, "Length Required"},
+	{412, "Precondition Failed"},
+	{413, "Request Entity Too Large"},
+	{414, "Request-URI Too Long"},
+	{415, "Unsupported Media Type"},
+	{416, "Requested Range Not Satisfiable"},
+	{417, "Expectation Failed"},
+	{426, "Upgrade Required"},
+	{428, "Precondition Required"},
+	{429, "Too Many Requests"},
+	{431, "Request Header Fields Too Large"},
+	{500, "Internal Server Error"},
+	{501, "Not Implemented"},
+	{502, "Bad Gateway"},
+	{503, "Service Unavailable"},
+	{504, "Gateway Timeout"},
+	{505, "HTTP Version Not Supported"},
+	{511, "Network Authentication Required"}
+};
+
 Http::Http()
 {
-	_extMimeTypeMap = {
-		{"html", "text/html"},
-		{"htm", "text/html"},
-		{"js", "text/javascript"},
-		{"css", "text/css"},
-		{"gif", "image/gif"},
-		{"jpg", "image/jpeg"},
-		{"jpeg", "image/jpeg"},
-		{"jpe", "image/jpeg"},
-		{"pdf", "application/pdf"},
-		{"png", "image/png"},
-		{"svg", "image/svg+xml"},
-		{"txt", "text/plain"},
-		{"webm", "video/webm"},
-		{"ogv", "video/ogg"},
-		{"ogg", "video/ogg"},
-		{"3gp", "video/3gpp"},
-		{"apk", "application/vnd.android.package-archive"},
-		{"avi", "video/x-msvideo"},
-		{"bmp", "image/x-ms-bmp"},
-		{"csv", "text/comma-separated-values"},
-		{"doc", "application/msword"},
-		{"docx", "application/msword"},
-		{"flac", "audio/flac"},
-		{"gz", "application/x-gzip"},
-		{"gzip", "application/x-gzip"},
-		{"ics", "text/calendar"},
-		{"kml", "application/vnd.google-earth.kml+xml"},
-		{"kmz", "application/vnd.google-earth.kmz"},
-		{"m4a", "audio/mp4"},
-		{"mp3", "audio/mpeg"},
-		{"mp4", "video/mp4"},
-		{"mpg", "video/mpeg"},
-		{"mpeg", "video/mpeg"},
-		{"mov", "video/quicktime"},
-		{"odp", "application/vnd.oasis.opendocument.presentation"},
-		{"ods", "application/vnd.oasis.opendocument.spreadsheet"},
-		{"odt", "application/vnd.oasis.opendocument.text"},
-		{"oga", "audio/ogg"},
-		{"pptx", "application/vnd.ms-powerpoint"},
-		{"pps", "application/vnd.ms-powerpoint"},
-		{"qt", "video/quicktime"},
-		{"swf", "application/x-shockwave-flash"},
-		{"tar", "application/x-tar"},
-		{"text", "text/plain"},
-		{"tif", "image/tiff"},
-		{"tiff", "image/tiff"},
-		{"wav", "audio/wav"},
-		{"wmv", "video/x-ms-wmv"},
-		{"xls", "application/vnd.ms-excel"},
-		{"xlsx", "application/vnd.ms-excel"},
-		{"zip", "application/zip"},
-		{"xml", "application/xml"},
-		{"xsl", "application/xml"},
-		{"xsd", "application/xml"},
-
-		{"xhtml", "application/xhtml+xml"},
-		{"json", "application/json"},
-		{"dtd", "application/xml-dtd"},
-		{"xslt", "application/xslt+xml"},
-		{"java", "text/x-java-source,java"}
-	};
-
-	_statusCodeMap = {
-		{100, "Continue"},
-		{101, "Switching Protocols"},
-		{200, "OK"},
-		{201, "Created"},
-		{202, "Accepted"},
-		{203, "Non-Authoritative Information"},
-		{204, "No Content"},
-		{205, "Reset Content"},
-		{206, "Partial Content"},
-		{300, "Multiple Choices"},
-		{301, "Moved Permanently"},
-		{302, "Found"},
-		{303, "See Other"},
-		{304, "Not Modified"},
-		{305, "Use Proxy"},
-		{307, "Temporary Redirect"},
-		{308, "Permanent Redirect"},
-		{400, "Bad Request"},
-		{401, "Unauthorized"},
-		{402, "Payment Required"},
-		{403, "Forbidden"},
-		{404, "Not Found"},
-		{405, "Method Not Allowed"},
-		{406, "Not Acceptable"},
-		{407, "Proxy Authentication Required"},
-		{408, "Request Timeout"},
-		{409, "Conflict"},
-		{410, "Gone"},
-		{411, "Length Required"},
-		{412, "Precondition Failed"},
-		{413, "Request Entity Too Large"},
-		{414, "Request-URI Too Long"},
-		{415, "Unsupported Media Type"},
-		{416, "Requested Range Not Satisfiable"},
-		{417, "Expectation Failed"},
-		{426, "Upgrade Required"},
-		{428, "Precondition Required"},
-		{429, "Too Many Requests"},
-		{431, "Request Header Fields Too Large"},
-		{500, "Internal Server Error"},
-		{501, "Not Implemented"},
-		{502, "Bad Gateway"},
-		{503, "Service Unavailable"},
-		{504, "Gateway Timeout"},
-		{505, "HTTP Version Not Supported"},
-		{511, "Network Authentication Required"}
-	};
 }
 
 Http::~Http()
 {
-	_extMimeTypeMap.clear();
-	_statusCodeMap.clear();
+	clearFormDataStream();
 }
 
 PVariable Http::serialize()
@@ -401,15 +675,17 @@ void Http::unserialize(PVariable data)
 	_headerProcessingStarted = data->arrayValue->at(2)->booleanValue;
 	_dataProcessingStarted = data->arrayValue->at(3)->booleanValue;
 	_content.insert(_content.end(), data->arrayValue->at(4)->binaryValue.begin(), data->arrayValue->at(4)->binaryValue.end());
-	_rawHeader.insert(_rawHeader.end(), data->arrayValue->at(5)->binaryValue.begin(), data->arrayValue->at(5)->binaryValue.end());
+	//processHeader() copies the header into _rawHeader again, so it must not point into _rawHeader itself.
+	std::vector<char> rawHeader(data->arrayValue->at(5)->binaryValue.begin(), data->arrayValue->at(5)->binaryValue.end());
 	_header.remoteAddress = data->arrayValue->at(6)->stringValue;
 	_header.remotePort = data->arrayValue->at(7)->integerValue;
 	_redirectUrl = data->arrayValue->at(8)->stringValue;
 	_redirectQueryString = data->arrayValue->at(9)->stringValue;
 	_redirectStatus = data->arrayValue->at(10)->integerValue;
 
-	int32_t headerSize = _rawHeader.size();
-	char* pHeader = &(_rawHeader.at(0));
+	if(rawHeader.empty()) return;
+	int32_t headerSize = rawHeader.size();
+	char* pHeader = rawHeader.data();
 	processHeader(&pHeader, headerSize);
 }
 
@@ -420,7 +696,9 @@ int32_t Http::process(char* buffer, int32_t bufferLength, bool checkForChunkedXm
 	int32_t processedBytes = 0;
 	if(!_header.parsed) processedBytes = processHeader(&buffer, bufferLength);
 	if(!_header.parsed) return processedBytes;
-	if(_header.method == "GET" || _header.method == "M-SEARCH" || (_header.method == "NOTIFY" && _header.contentLength == 0) || (_contentLengthSet && _header.contentLength == 0))
+	//Responses with status 1xx, 204 or 304 never have a body (RFC 7230 section 3.3.3).
+	if(_header.method == "GET" || _header.method == "HEAD" || _header.method == "M-SEARCH" || (_header.method == "NOTIFY" && _header.contentLength == 0) || (_contentLengthSet && _header.contentLength == 0) ||
+		(_type == Type::Enum::response && ((_header.responseCode >= 100 && _header.responseCode < 200) || _header.responseCode == 204 || _header.responseCode == 304)))
 	{
 		_dataProcessingStarted = true;
 		setFinished();
@@ -449,8 +727,9 @@ int32_t Http::process(char* buffer, int32_t bufferLength, bool checkForChunkedXm
 				if(BaseLib::Math::isNumber(BaseLib::HelperFunctions::trim(chunk), true)) _header.transferEncoding = BaseLib::Http::TransferEncoding::chunked;
 			}
 		}
-		if(_header.contentLength > 104857600) throw HttpException("Data is larger than 100 MiB.");
-		_content.reserve(_header.contentLength);
+		if(_header.contentLength > _maxContentSize) throw HttpException("Data is larger than " + std::to_string(_maxContentSize) + " bytes.");
+		startFormDataStream();
+		if(!_formDataStream) _content.reserve(_header.contentLength);
 	}
 	_dataProcessingStarted = true;
 
@@ -503,6 +782,7 @@ int32_t Http::processHeader(char** buffer, int32_t& bufferLength)
 			}
 			else
 			{
+				if(_rawHeader.capacity() < 1024) _rawHeader.reserve(1024);
 				_rawHeader.insert(_rawHeader.end(), *buffer, *buffer + bufferLength);
 				return bufferLength;
 			}
@@ -516,6 +796,7 @@ int32_t Http::processHeader(char** buffer, int32_t& bufferLength)
 	}
 	else headerSize = ((end + 3) - *buffer) + 1;
 
+	if(_rawHeader.capacity() < 1024) _rawHeader.reserve(1024);
 	_rawHeader.insert(_rawHeader.end(), *buffer, *buffer + headerSize);
 
 	char* headerBuffer = _rawHeader.data();
@@ -523,12 +804,18 @@ int32_t Http::processHeader(char** buffer, int32_t& bufferLength)
 	*buffer += headerSize;
 	bufferLength -= headerSize;
 
-	if(headerSize >= 5 && !strncmp(headerBuffer, "HTTP/", 5))
+	if(_rawHeader.size() >= 5 && !strncmp(headerBuffer, "HTTP/", 5))
 	{
 		_type = Type::Enum::response;
 		_header.responseCode = strtol(headerBuffer + 9, NULL, 10);
+		if(_rawHeader.size() >= 8)
+		{
+			if(!strncmp(headerBuffer, "HTTP/1.1", 8)) _header.protocol = Http::Protocol::http11;
+			else if(!strncmp(headerBuffer, "HTTP/1.0", 8)) _header.protocol = Http::Protocol::http10;
+			else if(!strncmp(headerBuffer, "HTTP/2.0", 8)) _header.protocol = Http::Protocol::http20;
+		}
 	}
-	else if(headerSize >= 10)
+	else if(_rawHeader.size() >= 10)
 	{
 		char* endPos = (char*)memchr(headerBuffer, ' ', 10);
 		if(!endPos) throw HttpException("Your client sent a request that this server could not understand (1).");
@@ -575,6 +862,7 @@ int32_t Http::processHeader(char** buffer, int32_t& bufferLength)
 	}
 
 	char* colonPos = nullptr;
+	_headerFields.reserve(32);
 	newlinePos = (char*)memchr(headerBuffer, '\n', _rawHeader.size());
 	if(!newlinePos || newlinePos > end) throw HttpException("Could not parse HTTP header.");
 	headerBuffer = newlinePos + 1;
@@ -606,7 +894,17 @@ void Http::processHeaderField(char* name, uint32_t nameSize, char* value, uint32
 		value++;
 		valueSize--;
 	}
-	if(!strnaicmp(name, "content-length", nameSize))
+
+	//Only remember where the field is. Fields not needed for parsing are decoded on request.
+	HeaderField field;
+	field.nameOffset = name - _rawHeader.data();
+	field.nameSize = nameSize;
+	field.valueOffset = value - _rawHeader.data();
+	field.valueSize = valueSize;
+	_headerFields.push_back(field);
+
+	//Compare the length first, so most fields are skipped without comparing any characters.
+	if(nameSize == 14 && !strnaicmp(name, "content-length", nameSize))
 	{
 		//Ignore Content-Length when Transfer-Encoding is present. See: http://greenbytes.de/tech/webdav/rfc2616.html#rfc.section.4.4
 		if(_header.transferEncoding == TransferEncoding::Enum::none)
@@ -615,20 +913,20 @@ void Http::processHeaderField(char* name, uint32_t nameSize, char* value, uint32
 			_header.contentLength = strtol(value, NULL, 10);
 		}
 	}
-	else if(!strnaicmp(name, "host", nameSize))
+	else if(nameSize == 4 && !strnaicmp(name, "host", nameSize))
 	{
 		_header.host = std::string(value, valueSize);
 		HelperFunctions::toLower(_header.host);
 		HelperFunctions::stringReplace(_header.host, "../", "");
 	}
-	else if(!strnaicmp(name, "content-type", nameSize))
+	else if(nameSize == 12 && !strnaicmp(name, "content-type", nameSize))
 	{
-		_header.contentType = std::string(value, valueSize);
-		_header.contentTypeFull = _header.contentType;
-		_header.contentType = HelperFunctions::splitFirst(_header.contentType, ';').first;
+		_header.contentTypeFull = std::string(value, valueSize);
+		char* semicolonPos = (char*)memchr(value, ';', valueSize);
+		_header.contentType = semicolonPos ? std::string(value, semicolonPos - value) : _header.contentTypeFull;
 		HelperFunctions::toLower(_header.contentType);
 	}
-	else if(!strnaicmp(name, "content-encoding", nameSize))
+	else if(nameSize == 16 && !strnaicmp(name, "content-encoding", nameSize))
 	{
 		std::string s(value, valueSize);
 		s = s.substr(0, s.find(';'));
@@ -638,11 +936,12 @@ void Http::processHeaderField(char* name, uint32_t nameSize, char* value, uint32
 			std::string ce = (pos == (signed)std::string::npos) ? s : s.substr(0, pos);
 			HelperFunctions::trim(BaseLib::HelperFunctions::toLower(ce));
 			if(ce == "gzip") _header.contentEncoding = (ContentEncoding::Enum)(_header.contentEncoding | ContentEncoding::Enum::gzip);
+			else if(ce == "deflate") _header.contentEncoding = (ContentEncoding::Enum)(_header.contentEncoding | ContentEncoding::Enum::deflate);
 			else throw HttpException("Unknown value for HTTP header \"Content-Encoding\": " + std::string(value, valueSize));
 			if(pos == (signed)std::string::npos) s.clear(); else s.erase(0, pos + 1);
 		}
 	}
-	else if(!strnaicmp(name, "transfer-encoding", nameSize) || !strnaicmp(name, "te", nameSize))
+	else if((nameSize == 17 && !strnaicmp(name, "transfer-encoding", nameSize)) || (nameSize == 2 && !strnaicmp(name, "te", nameSize)))
 	{
 		if(_header.contentLength > 0) _header.contentLength = 0; //Ignore Content-Length when Transfer-Encoding is present. See: http://greenbytes.de/tech/webdav/rfc2616.html#rfc.section.4.4
 		std::string s(value, valueSize);
@@ -661,7 +960,7 @@ void Http::processHeaderField(char* name, uint32_t nameSize, char* value, uint32
 		    if(pos == (signed)std::string::npos) s.clear(); else s.erase(0, pos + 1);
 		}
 	}
-	else if(!strnaicmp(name, "connection", nameSize))
+	else if(nameSize == 10 && !strnaicmp(name, "connection", nameSize))
 	{
 		std::string s(value, valueSize);
 		s = s.substr(0, s.find(';'));
@@ -678,20 +977,77 @@ void Http::processHeaderField(char* name, uint32_t nameSize, char* value, uint32
 			if(pos == (signed)std::string::npos) s.clear(); else s.erase(0, pos + 1);
 		}
 	}
-	else if(!strnaicmp(name, "cookie", nameSize))
+	else if(nameSize == 13 && !strnaicmp(name, "authorization", nameSize)) _header.authorization = std::string(value, valueSize);
+}
+
+const Http::HeaderField* Http::findHeaderField(const std::string& name)
+{
+	if(name.empty()) return nullptr;
+	std::string lowercaseName(name);
+	HelperFunctions::toLower(lowercaseName);
+	const char* rawHeader = _rawHeader.data();
+	//Searched backwards, so the last occurrence wins like in getHeaderFields().
+	for(auto fieldIterator = _headerFields.rbegin(); fieldIterator != _headerFields.rend(); ++fieldIterator)
 	{
-		_header.cookie = std::string(value, valueSize);
-		std::vector<std::string> cookies = HelperFunctions::splitAll(_header.cookie, ';');
-		for(auto& cookie : cookies)
-		{
-			auto data = HelperFunctions::splitFirst(cookie, '=');
-			_header.cookies.emplace(HelperFunctions::trim(data.first), HelperFunctions::trim(data.second));
-		}
+		if(fieldIterator->nameSize == lowercaseName.size() && !strnaicmp(rawHeader + fieldIterator->nameOffset, lowercaseName.c_str(), fieldIterator->nameSize)) return &(*fieldIterator);
 	}
-	else if(!strnaicmp(name, "authorization", nameSize)) _header.authorization = std::string(value, valueSize);
-	std::string lowercaseName(name, nameSize);
-	HelperFunctions::toLower(lowercaseName);
-	_header.fields[lowercaseName] = std::string(value, valueSize);
+	return nullptr;
+}
+
+std::string Http::getHeaderField(const std::string& name)
+{
+	const HeaderField* field = findHeaderField(name);
+	if(!field) return "";
+	return std::string(_rawHeader.data() + field->valueOffset, field->valueSize);
+}
+
+bool Http::hasHeaderField(const std::string& name)
+{
+	return findHeaderField(name) != nullptr;
+}
+
+std::map<std::string, std::string>& Http::getHeaderFields()
+{
+	if(_headerFieldMapCreated) return _headerFieldMap;
+	_headerFieldMapCreated = true;
+	for(auto& field : _headerFields)
+	{
+		std::string lowercaseName(_rawHeader.data() + field.nameOffset, field.nameSize);
+		HelperFunctions::toLower(lowercaseName);
+		_headerFieldMap[lowercaseName] = std::string(_rawHeader.data() + field.valueOffset, field.valueSize);
+	}
+	return _headerFieldMap;
+}
+
+std::unordered_map<std::string, std::string>& Http::getCookies()
+{
+	if(_cookiesDecoded) return _cookies;
+	_cookiesDecoded = true;
+	const HeaderField* field = findHeaderField("cookie");
+	if(!field) return _cookies;
+	std::vector<std::string> cookies = HelperFunctions::splitAll(std::string(_rawHeader.data() + field->valueOffset, field->valueSize), ';');
+	for(auto& cookie : cookies)
+	{
+		auto data = HelperFunctions::splitFirst(cookie, '=');
+		_cookies.emplace(HelperFunctions::trim(data.first), HelperFunctions::trim(data.second));
+	}
+	return _cookies;
+}
+
+std::unordered_map<std::string, std::string>& Http::getQueryArgs()
+{
+	if(_queryArgsDecoded) return _queryArgs;
+	_queryArgsDecoded = true;
+	std::vector<std::string> args = HelperFunctions::splitAll(_header.args, '&');
+	for(auto& arg : args)
+	{
+		if(arg.empty()) continue;
+		auto data = HelperFunctions::splitFirst(arg, '=');
+		HelperFunctions::stringReplace(data.first, "+", " ");
+		HelperFunctions::stringReplace(data.second, "+", " ");
+		_queryArgs.emplace(decodeURL(data.first), decodeURL(data.second));
+	}
+	return _queryArgs;
 }
 
 int32_t Http::strnaicmp(char const *a, char const *b, uint32_t size)
@@ -705,17 +1061,88 @@ int32_t Http::strnaicmp(char const *a, char const *b, uint32_t size)
 	return 0;
 }
 
+bool Http::isKeepAlive()
+{
+	if(_header.connection & Connection::Enum::close) return false;
+	if(_header.protocol == Protocol::Enum::http11 || _header.protocol == Protocol::Enum::http20) return true;
+	return _header.connection & Connection::Enum::keepAlive;
+}
+
+Http::ContentEncoding::Enum Http::getAcceptedContentEncoding()
+{
+	const HeaderField* field = findHeaderField("accept-encoding");
+	if(!field) return ContentEncoding::Enum::none;
+
+	bool gzip = false;
+	bool deflate = false;
+	bool any = false;
+	//Codings explicitly rejected with "q=0". "*" doesn't apply to them (RFC 7231 section 5.3.4).
+	bool gzipRejected = false;
+	bool deflateRejected = false;
+	std::vector<std::string> codings = HelperFunctions::splitAll(std::string(_rawHeader.data() + field->valueOffset, field->valueSize), ',');
+	for(auto& coding : codings)
+	{
+		std::string::size_type semicolonPos = coding.find(';');
+		std::string name = coding.substr(0, semicolonPos);
+		HelperFunctions::toLower(HelperFunctions::trim(name));
+		bool rejected = false;
+		if(semicolonPos != std::string::npos)
+		{
+			//"q=0" means "not acceptable".
+			std::string parameter = coding.substr(semicolonPos + 1);
+			HelperFunctions::trim(parameter);
+			rejected = parameter.compare(0, 2, "q=") == 0 && Math::getDouble(parameter.substr(2)) <= 0;
+		}
+		if(name == "gzip" || name == "x-gzip")
+		{
+			if(rejected) gzipRejected = true;
+			else gzip = true;
+		}
+		else if(name == "deflate")
+		{
+			if(rejected) deflateRejected = true;
+			else deflate = true;
+		}
+		else if(name == "*" && !rejected) any = true;
+	}
+	if(any)
+	{
+		if(!gzipRejected) gzip = true;
+		if(!deflateRejected) deflate = true;
+	}
+	if(gzipRejected) gzip = false;
+	if(deflateRejected) deflate = false;
+	if(gzip) return ContentEncoding::Enum::gzip;
+	if(deflate) return ContentEncoding::Enum::deflate;
+	return ContentEncoding::Enum::none;
+}
+
 void Http::reset()
 {
 	_header = Header();
 	_content.clear();
 	_rawHeader.clear();
+	_headerFields.clear();
+	_headerFieldMapCreated = false;
+	_headerFieldMap.clear();
+	_cookiesDecoded = false;
+	_cookies.clear();
+	_queryArgsDecoded = false;
+	_queryArgs.clear();
 	_chunk.clear();
 	_chunkNewLineMissing = false;
+	_chunkSize = -1;
+	_endChunkSizeBytes = -1;
+	_partialChunkSize.clear();
+	_contentLengthSet = false;
+	_crlf = true;
+	_streamPos = 0;
+	_contentStreamPos = 0;
 	_type = Type::Enum::none;
 	_finished = false;
 	_dataProcessingStarted = false;
 	_headerProcessingStarted = false;
+	clearFormDataStream();
 }
 
 void Http::setFinished()
@@ -723,17 +1150,26 @@ void Http::setFinished()
 	if(_finished) return;
 	_finished = true;
 	_content.push_back('\0');
+	if(_formDataStream && _formDataStream->fileDescriptor != -1)
+	{
+		//Incomplete part
+		::close(_formDataStream->fileDescriptor);
+		_formDataStream->fileDescriptor = -1;
+		unlink(_formDataStream->part->filePath.c_str());
+	}
 }
 
 int32_t Http::processContent(char* buffer, int32_t bufferLength)
 {
-	if(_content.size() + bufferLength > 104857600) throw HttpException("Data is larger than 100 MiB.");
-	if(_header.contentLength == 0) _content.insert(_content.end(), buffer, buffer + bufferLength);
+	//Streamed content is not kept in memory, but it is limited, too, as it is written to disk.
+	uint64_t contentSize = _formDataStream ? _formDataStream->contentSize : _content.size();
+	if(contentSize + bufferLength > _maxContentSize) throw HttpException("Data is larger than " + std::to_string(_maxContentSize) + " bytes.");
+	if(_header.contentLength == 0) appendContent(buffer, bufferLength);
 	else
 	{
-		if(_content.size() + bufferLength > _header.contentLength) bufferLength -= (_content.size() + bufferLength) - _header.contentLength;
-		_content.insert(_content.end(), buffer, buffer + bufferLength);
-		if(_content.size() == _header.contentLength) setFinished();
+		if(contentSize + bufferLength > _header.contentLength) bufferLength -= (contentSize + bufferLength) - _header.contentLength;
+		appendContent(buffer, bufferLength);
+		if(contentSize + bufferLength == _header.contentLength) setFinished();
 	}
 	return bufferLength;
 }
@@ -743,7 +1179,8 @@ int32_t Http::processChunkedContent(char* buffer, int32_t bufferLength)
 	int32_t initialBufferLength = bufferLength;
 	while(true)
 	{
-		if(_content.size() + bufferLength > 104857600) throw HttpException("Data is larger than 100 MiB.");
+		uint64_t contentSize = _formDataStream ? _formDataStream->contentSize : _content.size();
+		if(contentSize + _chunk.size() + bufferLength > _maxContentSize) throw HttpException("Data is larger than " + std::to_string(_maxContentSize) + " bytes.");
 		if(_chunkSize == -1)
 		{
 			if(_chunkNewLineMissing)
@@ -780,7 +1217,7 @@ int32_t Http::processChunkedContent(char* buffer, int32_t bufferLength)
 			_chunk.insert(_chunk.end(), buffer, buffer + sizeToInsert);
 			if((signed)_chunk.size() == _chunkSize)
 			{
-				_content.insert(_content.end(), _chunk.begin(), _chunk.end());
+				appendContent(_chunk.data(), _chunk.size());
 				_chunk.clear();
 				_chunkSize = -1;
 			}
@@ -942,7 +1379,7 @@ size_t Http::readFirstContentLine(char* buffer, size_t requestLength)
 	size_t bytesRead = 0;
 	char* posTemp = (char*)memchr(&_content.at(_contentStreamPos), '\n', _content.size() - 1 - _contentStreamPos);
 	int32_t newlinePos = 0;
-	if(posTemp > 0) newlinePos = posTemp - &_content.at(0);
+	if(posTemp) newlinePos = posTemp - &_content.at(0);
 	if(newlinePos > 0 && _content.at(newlinePos - 1) == '\r') newlinePos--;
 	else if(newlinePos <= 0) newlinePos = _content.size() - 1;
 	if(_contentStreamPos < (unsigned)newlinePos)
@@ -38,11 +38,13 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <cstring>
 #include <memory>
 #include <vector>
 #include <iomanip>
 #include <set>
+#include <functional>
 
 namespace BaseLib
 {
@@ -66,7 +68,7 @@ public:
 	};
 	struct ContentEncoding
 	{
-		enum Enum { none = 0, gzip = 8 };
+		enum Enum { none = 0, deflate = 4, gzip = 8 };
 	};
 	struct TransferEncoding
 	{
@@ -80,6 +82,10 @@ public:
 	{
 		enum Enum { none, http10, http11, http20 };
 	};
+	/**
+	 * The decoded header. Since version 2 of the library the members "fields", "cookies" and "cookie" don't exist anymore. Use getHeaderField(),
+	 * getHeaderFields() and getCookies() instead.
+	 */
 	struct Header
 	{
 		bool parsed = false;
@@ -97,11 +103,8 @@ public:
 		TransferEncoding::Enum transferEncoding = TransferEncoding::Enum::none;
 		Connection::Enum connection = Connection::Enum::none;
 		std::string authorization;
-		std::string cookie;
-		std::unordered_map<std::string, std::string> cookies;
 		std::string remoteAddress;
 		int32_t remotePort = 0;
-		std::map<std::string, std::string> fields;
 	};
 
 	struct FormData
@@ -114,8 +117,25 @@ public:
 		std::unordered_map<std::string, std::string> header;
 		std::shared_ptr<std::vector<char>> data;
 		std::set<std::shared_ptr<FormData>> multipartMixed;
+
+		/**
+		 * Path of the temporary file containing the data, when the part was streamed to disk. "data" is empty then.
+		 *
+		 * @see setFormDataDirectory()
+		 */
+		std::string filePath;
 	};
 
+	/**
+	 * Callback for streamed "multipart/form-data" parts.
+	 *
+	 * @param formData The part. The header fields are set on the first call.
+	 * @param data The next bytes of the part's data.
+	 * @param size The number of bytes in "data".
+	 * @param finished "true" on the last call for the part. "size" is 0 then.
+	 */
+	typedef std::function<void(const std::shared_ptr<FormData>& formData, const char* data, size_t size, bool finished)> FormDataCallback;
+
 	Http();
 	virtual ~Http();
 
@@ -141,8 +161,80 @@ public:
 	std::vector<char>& getContent() { return _content; }
 	uint32_t getContentSize() { return _content.empty() ? 0 : (_finished ? _content.size() - 1 : _content.size()); }
 	Header& getHeader() { return _header; }
+
+	/**
+	 * Returns the value of a header field. Only the fields needed for parsing are decoded by process(), all other fields are looked up in the raw header on request.
+	 *
+	 * @param name The name of the field. The comparison is case insensitive.
+	 * @return The value of the field or an empty string, when the field doesn't exist. When the field occurs more than once, the last value is returned like
+	 * in getHeaderFields().
+	 */
+	std::string getHeaderField(const std::string& name);
+
+	/**
+	 * Checks if the header contains a field.
+	 *
+	 * @param name The name of the field. The comparison is case insensitive.
+	 */
+	bool hasHeaderField(const std::string& name);
+
+	/**
+	 * Returns all header fields with lower case names. The map is created on first access. When a field occurs more than once, the last value is stored.
+	 */
+	std::map<std::string, std::string>& getHeaderFields();
+
+	/**
+	 * Returns the cookies of the request. They are decoded on first access.
+	 */
+	std::unordered_map<std::string, std::string>& getCookies();
+
+	/**
+	 * Returns the URL decoded query arguments of the request. They are decoded on first access.
+	 */
+	std::unordered_map<std::string, std::string>& getQueryArgs();
+
+	/**
+	 * Checks if the connection should be kept open after the response. This is the default for HTTP/1.1 unless the request contains "Connection: close". HTTP/1.0
+	 * clients need to send "Connection: keep-alive".
+	 *
+	 * @return Returns true when the connection can be reused for further requests.
+	 */
+	bool isKeepAlive();
+
+	/**
+	 * Returns the content encoding to use for the response according to the request's "Accept-Encoding" field. gzip is preferred over deflate.
+	 *
+	 * @return Returns ContentEncoding::gzip, ContentEncoding::deflate or ContentEncoding::none when the client accepts neither.
+	 */
+	ContentEncoding::Enum getAcceptedContentEncoding();
+
 	void reset();
 
+	/**
+	 * Enables incremental decoding of "multipart/form-data" bodies in process(). The data of every part is passed to "callback" while it is received and
+	 * is not stored in the content. Needs to be set before the body is processed. The setting is kept by reset().
+	 *
+	 * @param callback The function to call for every block of part data.
+	 */
+	void setFormDataCallback(FormDataCallback callback) { _formDataCallback = callback; }
+
+	/**
+	 * Enables incremental decoding of "multipart/form-data" bodies in process(). Parts with a file name are written to temporary files in "directory"
+	 * while they are received, all other parts are kept in memory. The parts are returned by decodeMultipartFormdata(). The temporary files are deleted by
+	 * reset() and the destructor, so move them to keep them. The setting is kept by reset().
+	 *
+	 * @param directory The directory to create the temporary files in. Set to an empty string to disable.
+	 */
+	void setFormDataDirectory(const std::string& directory) { _formDataDirectory = directory; }
+
+	/**
+	 * Sets the maximum size of the body. process() throws an HttpException when it is exceeded. The limit also applies to bodies which are decoded while
+	 * they are received (see setFormDataCallback() and setFormDataDirectory()). The setting is kept by reset().
+	 *
+	 * @param value The maximum size in bytes. The default is 100 MiB.
+	 */
+	void setMaxContentSize(uint64_t value) { _maxContentSize = value; }
+
 	/**
 	 * Parses HTTP data from a buffer.
 	 *
@@ -162,18 +254,53 @@ public:
 	size_t readFirstContentLine(char* buffer, size_t requestLength);
 	std::string getMimeType(std::string extension);
 	std::string getStatusText(int32_t code);
+
+	/**
+	 * Decodes a "multipart/form-data" body. When the body was decoded while it was received (see setFormDataCallback() and setFormDataDirectory()), the
+	 * already decoded parts are returned.
+	 */
 	std::set<std::shared_ptr<FormData>> decodeMultipartFormdata();
 	std::set<std::shared_ptr<FormData>> decodeMultipartMixed(std::string& boundary, char* buffer, size_t bufferSize, char** pos);
-	static void constructHeader(uint32_t contentLength, std::string contentType, int32_t code, std::string codeDescription, std::vector<std::string>& additionalHeaders, std::string& header);
+
+	/**
+	 * Creates a response header.
+	 *
+	 * @param contentLength The size of the response body.
+	 * @param contentType The content type. No "Content-Type" field is added when empty.
+	 * @param code The status code.
+	 * @param codeDescription The status text.
+	 * @param additionalHeaders Further header fields without line endings.
+	 * @param[out] header The constructed header.
+	 * @param keepAlive (Optional, default "false") Set to "true" to add "Connection: keep-alive" instead of "Connection: close".
+	 */
+	static void constructHeader(uint32_t contentLength, std::string contentType, int32_t code, std::string codeDescription, std::vector<std::string>& additionalHeaders, std::string& header, bool keepAlive = false);
 	PVariable serialize();
 	void unserialize(PVariable data);
 private:
+	/**
+	 * Position of a header field within _rawHeader.
+	 */
+	struct HeaderField
+	{
+		uint32_t nameOffset = 0;
+		uint32_t nameSize = 0;
+		uint32_t valueOffset = 0;
+		uint32_t valueSize = 0;
+	};
+
 	bool _contentLengthSet = false;
 	bool _headerProcessingStarted = false;
 	bool _dataProcessingStarted = false;
 	bool _crlf = true;
 	Header _header;
 	std::vector<char> _rawHeader;
+	std::vector<HeaderField> _headerFields;
+	bool _headerFieldMapCreated = false;
+	std::map<std::string, std::string> _headerFieldMap;
+	bool _cookiesDecoded = false;
+	std::unordered_map<std::string, std::string> _cookies;
+	bool _queryArgsDecoded = false;
+	std::unordered_map<std::string, std::string> _queryArgs;
 	Type::Enum _type = Type::Enum::none;
 	std::vector<char> _content;
 	std::vector<char> _chunk;
@@ -184,19 +311,46 @@ private:
 	std::string _partialChunkSize;
 	size_t _streamPos = 0;
 	size_t _contentStreamPos = 0;
-	std::map <std::string, std::string> _extMimeTypeMap;
-	std::map <int32_t, std::string> _statusCodeMap;
+	static const std::map<std::string, std::string> _extMimeTypeMap;
+	static const std::map<int32_t, std::string> _statusCodeMap;
 	std::string _redirectUrl;
 	std::string _redirectQueryString;
 	int32_t _redirectStatus = -1;
 
+	/**
+	 * State of the incremental "multipart/form-data" decoder.
+	 */
+	struct FormDataStream;
+	std::shared_ptr<FormDataStream> _formDataStream;
+	FormDataCallback _formDataCallback;
+	std::string _formDataDirectory;
+	uint64_t _maxContentSize = 104857600;
+
 	int32_t processHeader(char** buffer, int32_t& bufferLength);
 	void processHeaderField(char* name, uint32_t nameSize, char* value, uint32_t valueSize);
 	int32_t processContent(char* buffer, int32_t bufferLength);
+
+	/**
+	 * Stores received content or passes it to the "multipart/form-data" decoder.
+	 */
+	void appendContent(const char* data, size_t size);
+	void startFormDataStream();
+	void processFormDataStream(const char* data, size_t size);
+	void startFormDataPart();
+	void writeFormDataPart(const char* data, size_t size);
+	void finishFormDataPart();
+
+	/**
+	 * Closes the open temporary file and deletes all temporary files.
+	 */
+	void clearFormDataStream();
+	void processFormDataHeaderField(std::shared_ptr<FormData>& formData, std::string& name, std::string& value);
 	int32_t processChunkedContent(char* buffer, int32_t bufferLength);
 	void readChunkSize(char** buffer, int32_t& bufferLength);
 
 	char* findNextString(std::string& needle, char* buffer, size_t bufferSize);
+	static std::string getMultipartBoundary(const std::string& contentTypeFull, char separator);
+	const HeaderField* findHeaderField(const std::string& name);
 
 	int32_t strnaicmp(char const *a, char const *b, uint32_t size);
 };
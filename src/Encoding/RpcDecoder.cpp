@@ -189,6 +189,102 @@ std::shared_ptr<std::vector<std::shared_ptr<Variable>>> RpcDecoder::decodeReques
     return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>();
 }
 
+std::shared_ptr<std::vector<std::shared_ptr<Variable>>> RpcDecoder::decodeRequest(std::vector<char>& packet, std::string& methodName, PMulticallView& multicall)
+{
+	try
+	{
+		multicall.reset();
+		uint32_t position = 4;
+		uint32_t headerSize = 0;
+		if(packet.at(3) == 0x40 || packet.at(3) == 0x41) headerSize = _decoder->decodeInteger(packet, position) + 4;
+		position = 8 + headerSize;
+		methodName = _decoder->decodeString(packet, position);
+		if(methodName != "system.multicall")
+		{
+			std::string name;
+			return decodeRequest(packet, name);
+		}
+		uint32_t parameterCount = _decoder->decodeInteger(packet, position);
+		if(parameterCount != 1 || position + 8 > packet.size() || decodeType(packet, position) != VariableType::tArray)
+		{
+			return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32602, "Invalid params. system.multicall expects exactly one array parameter.")});
+		}
+		uint32_t callCount = _decoder->decodeInteger(packet, position);
+		//Every call needs at least 8 bytes (type and member count). Don't trust the count for the allocation.
+		if(callCount > (packet.size() - position) / 8)
+		{
+			return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. Call count of system.multicall request exceeds packet size.")});
+		}
+		std::vector<uint32_t> offsets;
+		offsets.reserve(callCount);
+		for(uint32_t i = 0; i < callCount; i++)
+		{
+			offsets.push_back(position);
+			if(!skipParameter(packet, position))
+			{
+				return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. system.multicall request is malformed.")});
+			}
+		}
+		multicall = std::make_shared<BinaryMulticallView>(_bl, this, packet, offsets);
+		return std::make_shared<std::vector<std::shared_ptr<Variable>>>();
+	}
+	catch(const std::exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    	return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. Not well formed: " + std::string(ex.what()))});
+    }
+    catch(const Exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    	return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. Not well formed: " + std::string(ex.what()))});
+    }
+    catch(...)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. Not well formed.")});
+}
+
+bool RpcDecoder::decodeMulticallCall(std::vector<char>& packet, uint32_t position, std::string& methodName, PArray& parameters)
+{
+	try
+	{
+		if(decodeType(packet, position) != VariableType::tStruct) return false;
+		uint32_t memberCount = _decoder->decodeInteger(packet, position);
+		for(uint32_t i = 0; i < memberCount; i++)
+		{
+			std::string name = _decoder->decodeString(packet, position);
+			if(name == "methodName")
+			{
+				PVariable value = decodeParameter(packet, position);
+				if(!value || value->type != VariableType::tString) return false;
+				methodName = value->stringValue;
+			}
+			else if(name == "params")
+			{
+				PVariable value = decodeParameter(packet, position);
+				if(!value || value->type != VariableType::tArray) return false;
+				parameters = value->arrayValue;
+			}
+			else if(!skipParameter(packet, position)) return false;
+		}
+		return true;
+	}
+	catch(const std::exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(const Exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return false;
+}
+
 std::shared_ptr<Variable> RpcDecoder::decodeResponse(std::vector<char>& packet, uint32_t offset)
 {
 	uint32_t position = offset + 8;
@@ -240,6 +336,51 @@ VariableType RpcDecoder::decodeType(std::vector<uint8_t>& packet, uint32_t& posi
 	return (VariableType)_decoder->decodeInteger(packet, position);
 }
 
+bool RpcDecoder::skipParameter(std::vector<char>& packet, uint32_t& position, uint32_t depth)
+{
+	//Walks over an encoded parameter without allocating anything. Returns false when the parameter exceeds the packet.
+	if(depth > 100 || position + 4 > packet.size()) return false;
+	VariableType type = decodeType(packet, position);
+	if(type == VariableType::tVoid)
+	{
+		//Nothing
+	}
+	else if(type == VariableType::tString || type == VariableType::tBase64 || type == VariableType::tBinary)
+	{
+		if(position + 4 > packet.size()) return false;
+		int32_t length = _decoder->decodeInteger(packet, position);
+		if(length < 0 || (uint64_t)position + length > packet.size()) return false;
+		position += length;
+	}
+	else if(type == VariableType::tInteger) position += 4;
+	else if(type == VariableType::tInteger64 || type == VariableType::tFloat) position += 8;
+	else if(type == VariableType::tBoolean) position += 1;
+	else if(type == VariableType::tArray)
+	{
+		if(position + 4 > packet.size()) return false;
+		uint32_t arrayLength = _decoder->decodeInteger(packet, position);
+		for(uint32_t i = 0; i < arrayLength; i++)
+		{
+			if(!skipParameter(packet, position, depth + 1)) return false;
+		}
+	}
+	else if(type == VariableType::tStruct)
+	{
+		if(position + 4 > packet.size()) return false;
+		uint32_t structLength = _decoder->decodeInteger(packet, position);
+		for(uint32_t i = 0; i < structLength; i++)
+		{
+			if(position + 4 > packet.size()) return false;
+			int32_t nameLength = _decoder->decodeInteger(packet, position);
+			if(nameLength < 0 || (uint64_t)position + nameLength > packet.size()) return false;
+			position += nameLength;
+			if(!skipParameter(packet, position, depth + 1)) return false;
+		}
+	}
+	else return false;
+	return position <= packet.size();
+}
+
 std::shared_ptr<Variable> RpcDecoder::decodeParameter(std::vector<char>& packet, uint32_t& position)
 {
 	try
@@ -39,6 +39,7 @@
 #include "../Variable.h"
 #include "BinaryDecoder.h"
 #include "RpcHeader.h"
+#include "RpcMulticall.h"
 
 namespace BaseLib
 {
@@ -58,10 +59,25 @@ public:
 	virtual std::shared_ptr<RpcHeader> decodeHeader(std::vector<uint8_t>& packet);
 	virtual std::shared_ptr<std::vector<std::shared_ptr<Variable>>> decodeRequest(std::vector<char>& packet, std::string& methodName);
 	virtual std::shared_ptr<std::vector<std::shared_ptr<Variable>>> decodeRequest(std::vector<uint8_t>& packet, std::string& methodName);
+
+	/**
+	 * Decodes a request like decodeRequest(std::vector<char>&, std::string&), but doesn't materialize the parameters of "system.multicall" requests. For these requests
+	 * "multicall" is set to a view on the contained calls and an empty parameter array is returned. The view references "packet" and this decoder, so both need to
+	 * outlive it.
+	 *
+	 * @param packet The binary RPC request.
+	 * @param[out] methodName The name of the requested method.
+	 * @param[out] multicall Set when the request is a valid "system.multicall" request, otherwise reset.
+	 * @return Returns the decoded parameters. When the request is malformed, an array with a single error struct (-32700 or -32602) is returned and
+	 * "multicall" stays reset.
+	 */
+	virtual std::shared_ptr<std::vector<std::shared_ptr<Variable>>> decodeRequest(std::vector<char>& packet, std::string& methodName, PMulticallView& multicall);
 	virtual std::shared_ptr<Variable> decodeResponse(std::vector<char>& packet, uint32_t offset = 0);
 	virtual std::shared_ptr<Variable> decodeResponse(std::vector<uint8_t>& packet, uint32_t offset = 0);
 	virtual void decodeResponse(PVariable& variable, uint32_t offset = 0);
 private:
+	friend class BinaryMulticallView;
+
 	BaseLib::SharedObjects* _bl = nullptr;
 	bool _ansi = false;
 	std::unique_ptr<BinaryDecoder> _decoder;
@@ -76,6 +92,8 @@ private:
 	std::shared_ptr<Array> decodeArray(std::vector<uint8_t>& packet, uint32_t& position);
 	std::shared_ptr<Struct> decodeStruct(std::vector<char>& packet, uint32_t& position);
 	std::shared_ptr<Struct> decodeStruct(std::vector<uint8_t>& packet, uint32_t& position);
+	bool skipParameter(std::vector<char>& packet, uint32_t& position, uint32_t depth = 0);
+	bool decodeMulticallCall(std::vector<char>& packet, uint32_t position, std::string& methodName, PArray& parameters);
 };
 }
 }
@@ -290,6 +290,47 @@ void RpcEncoder::encodeResponse(std::shared_ptr<Variable> variable, std::vector<
     }
 }
 
+void RpcEncoder::encodeMulticallResponse(std::vector<PVariable>& results, std::vector<char>& encodedData)
+{
+	//The "Bin", the type byte after that and the length itself are not part of the length
+	try
+	{
+		encodedData.clear();
+		//Most multicall results are small (e. g. getValue), so this avoids nearly all reallocations.
+		encodedData.reserve(16 + results.size() * 32);
+		encodedData.insert(encodedData.end(), _packetStartResponse, _packetStartResponse + 4);
+		encodedData.insert(encodedData.end(), 4, 0); //Placeholder for the length
+		encodeType(encodedData, VariableType::tArray);
+		_encoder->encodeInteger(encodedData, results.size());
+		for(auto& result : results)
+		{
+			if(!result) result.reset(new Variable(VariableType::tVoid));
+			if(result->errorStruct) encodeVariable(encodedData, result);
+			else
+			{
+				encodeType(encodedData, VariableType::tArray);
+				_encoder->encodeInteger(encodedData, 1);
+				encodeVariable(encodedData, result);
+			}
+		}
+
+		uint32_t dataSize = encodedData.size() - 8;
+		_bl->hf.memcpyBigEndian(&encodedData.at(4), (char*)&dataSize, 4);
+	}
+	catch(const std::exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(const Exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+}
+
 void RpcEncoder::insertHeader(std::vector<char>& packet, const RpcHeader& header)
 {
 	std::vector<char> headerData;
@@ -62,6 +62,15 @@ public:
 	virtual void encodeRequest(std::string methodName, PArray parameters, std::vector<uint8_t>& encodedData, std::shared_ptr<RpcHeader> header = nullptr);
 	virtual void encodeResponse(std::shared_ptr<Variable> variable, std::vector<char>& encodedData);
 	virtual void encodeResponse(std::shared_ptr<Variable> variable, std::vector<uint8_t>& encodedData);
+
+	/**
+	 * Encodes the response to a "system.multicall" request into a single, preallocated packet without building an intermediate variable tree. Successful results are wrapped
+	 * in an array with one element, error structs are encoded as they are.
+	 *
+	 * @param results The results in request order as returned by MulticallView::execute().
+	 * @param[out] encodedData The encoded response.
+	 */
+	virtual void encodeMulticallResponse(std::vector<PVariable>& results, std::vector<char>& encodedData);
 private:
 	BaseLib::SharedObjects* _bl = nullptr;
 	bool _forceInteger64 = false;
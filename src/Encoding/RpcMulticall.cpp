@@ -0,0 +1,293 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * 
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "RpcMulticall.h"
+#include "../BaseLib.h"
+
+namespace BaseLib
+{
+namespace Rpc
+{
+
+MulticallCall MulticallView::Iterator::operator*()
+{
+	MulticallCall call;
+	if(!_view->get(_index, call)) call.methodName.clear();
+	return call;
+}
+
+MulticallView::MulticallView(BaseLib::SharedObjects* baseLib)
+{
+	_bl = baseLib;
+}
+
+std::string MulticallView::getPeerKey(PArray& parameters)
+{
+	if(!parameters || parameters->empty() || !parameters->front()) return "";
+	PVariable& parameter = parameters->front();
+	if(parameter->type == VariableType::tInteger || parameter->type == VariableType::tInteger64)
+	{
+		//Peer ID 0 addresses the central
+		if(parameter->integerValue64 <= 0) return "";
+		return std::to_string(parameter->integerValue64);
+	}
+	else if(parameter->type == VariableType::tString)
+	{
+		//HomeMatic style "ADDRESS:CHANNEL". Everything else (e. g. URLs or variable names) is not considered to be a peer reference.
+		if(parameter->stringValue.find('/') != std::string::npos) return "";
+		std::string::size_type pos = parameter->stringValue.find(':');
+		if(pos == std::string::npos || pos == 0) return "";
+		return parameter->stringValue.substr(0, pos);
+	}
+	return "";
+}
+
+PVariable MulticallView::invoke(CallbackFunction& callback, MulticallCall& call)
+{
+	try
+	{
+		if(call.methodName.empty()) return Variable::createError(-32600, "Invalid multicall entry.");
+		if(call.methodName == "system.multicall") return Variable::createError(-32600, "Recursive system.multicall calls are not allowed.");
+		PVariable result = callback(call.methodName, call.parameters);
+		if(!result) result = std::make_shared<Variable>(VariableType::tVoid);
+		return result;
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return Variable::createError(-32500, "Unknown application error.");
+}
+
+std::vector<PVariable> MulticallView::execute(CallbackFunction callback, uint32_t maxThreads)
+{
+	size_t callCount = size();
+	std::vector<PVariable> results(callCount);
+	try
+	{
+		if(maxThreads < 2)
+		{
+			for(size_t i = 0; i < callCount; i++)
+			{
+				MulticallCall call;
+				if(!get(i, call)) call.methodName.clear();
+				results[i] = invoke(callback, call);
+			}
+			return results;
+		}
+
+		std::vector<MulticallCall> segment;
+		segment.reserve(callCount);
+		for(size_t i = 0; i <= callCount; i++)
+		{
+			MulticallCall call;
+			if(i < callCount)
+			{
+				if(!get(i, call)) call.methodName.clear();
+				call.peerKey = getPeerKey(call.parameters);
+				if(!call.peerKey.empty() && !call.methodName.empty())
+				{
+					segment.push_back(std::move(call));
+					continue;
+				}
+			}
+
+			//Barrier: Finish all preceding peer calls before executing a call without peer reference.
+			if(!segment.empty())
+			{
+				executeParallel(callback, segment, results, maxThreads);
+				segment.clear();
+			}
+			if(i < callCount) results[i] = invoke(callback, call);
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	for(auto& result : results)
+	{
+		if(!result) result = Variable::createError(-32500, "Unknown application error.");
+	}
+	return results;
+}
+
+void MulticallView::executeParallel(CallbackFunction& callback, std::vector<MulticallCall>& calls, std::vector<PVariable>& results, uint32_t maxThreads)
+{
+	try
+	{
+		std::vector<std::vector<MulticallCall*>> groups;
+		std::map<std::string, size_t> groupIndexes;
+		for(auto& call : calls)
+		{
+			auto groupIterator = groupIndexes.find(call.peerKey);
+			if(groupIterator == groupIndexes.end())
+			{
+				groupIndexes.emplace(call.peerKey, groups.size());
+				groups.push_back(std::vector<MulticallCall*>{ &call });
+			}
+			else groups.at(groupIterator->second).push_back(&call);
+		}
+
+		size_t threadCount = std::min((size_t)maxThreads, groups.size());
+		if(threadCount < 2)
+		{
+			executeGroups(&callback, &groups, 0, 1, &results);
+			return;
+		}
+
+		//The calling thread executes the first share itself.
+		std::vector<std::thread> threads(threadCount - 1);
+		std::vector<bool> started(threadCount - 1, false);
+		for(size_t i = 1; i < threadCount; i++)
+		{
+			started[i - 1] = _bl->threadManager.start(threads[i - 1], false, &MulticallView::executeGroups, this, &callback, &groups, i, threadCount, &results);
+		}
+		executeGroups(&callback, &groups, 0, threadCount, &results);
+		for(size_t i = 1; i < threadCount; i++)
+		{
+			if(started[i - 1]) _bl->threadManager.join(threads[i - 1]);
+			else executeGroups(&callback, &groups, i, threadCount, &results); //Thread limit reached
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void MulticallView::executeGroups(CallbackFunction* callback, std::vector<std::vector<MulticallCall*>>* groups, size_t firstGroup, size_t step, std::vector<PVariable>* results)
+{
+	for(size_t i = firstGroup; i < groups->size(); i += step)
+	{
+		for(auto call : groups->at(i))
+		{
+			//Each call has its own result slot, so no locking is necessary.
+			results->at(call->index) = invoke(*callback, *call);
+		}
+	}
+}
+
+BinaryMulticallView::BinaryMulticallView(BaseLib::SharedObjects* baseLib, RpcDecoder* decoder, std::vector<char>& packet, std::vector<uint32_t>& offsets) : MulticallView(baseLib), _decoder(decoder), _packet(packet)
+{
+	_offsets.swap(offsets);
+}
+
+bool BinaryMulticallView::get(size_t index, MulticallCall& call)
+{
+	try
+	{
+		call.index = index;
+		call.methodName.clear();
+		call.parameters.reset();
+		if(index >= _offsets.size()) return false;
+		if(!_decoder->decodeMulticallCall(_packet, _offsets[index], call.methodName, call.parameters)) return false;
+		if(!call.parameters) call.parameters = std::make_shared<Array>();
+		return !call.methodName.empty();
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return false;
+}
+
+XmlrpcMulticallView::XmlrpcMulticallView(BaseLib::SharedObjects* baseLib, XmlrpcDecoder* decoder, std::shared_ptr<xml_document<>> doc, std::vector<xml_node<>*>& callNodes) : MulticallView(baseLib), _decoder(decoder), _doc(doc)
+{
+	_callNodes.swap(callNodes);
+}
+
+XmlrpcMulticallView::~XmlrpcMulticallView()
+{
+	_callNodes.clear();
+	if(_doc) _doc->clear();
+}
+
+bool XmlrpcMulticallView::get(size_t index, MulticallCall& call)
+{
+	try
+	{
+		call.index = index;
+		call.methodName.clear();
+		call.parameters.reset();
+		if(index >= _callNodes.size()) return false;
+		if(!_decoder->decodeMulticallCall(_callNodes[index], call.methodName, call.parameters)) return false;
+		if(!call.parameters) call.parameters = std::make_shared<Array>();
+		return !call.methodName.empty();
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(const Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return false;
+}
+
+}
+}
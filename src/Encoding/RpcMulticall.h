@@ -0,0 +1,181 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * 
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef RPCMULTICALL_H_
+#define RPCMULTICALL_H_
+
+#include "../Variable.h"
+#include "RapidXml/rapidxml.hpp"
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <string>
+
+using namespace rapidxml;
+
+namespace BaseLib
+{
+
+class SharedObjects;
+
+namespace Rpc
+{
+
+class RpcDecoder;
+class XmlrpcDecoder;
+
+/**
+ * One call of a "system.multicall" request.
+ */
+class MulticallCall
+{
+public:
+	/**
+	 * The position of the call within the multicall request.
+	 */
+	size_t index = 0;
+
+	std::string methodName;
+	PArray parameters;
+
+	/**
+	 * Identifies the peer the call refers to. Empty when the call doesn't reference a peer.
+	 */
+	std::string peerKey;
+};
+
+/**
+ * Lazy view on the calls of a "system.multicall" request. Creating the view only locates the calls within the packet. Method names and parameters of a call are decoded
+ * when the call is accessed, so the array of structs the request consists of is never materialized as a whole.
+ *
+ * @see RpcDecoder::decodeRequest()
+ * @see XmlrpcDecoder::decodeRequest()
+ */
+class MulticallView
+{
+public:
+	typedef std::function<PVariable(std::string& methodName, PArray& parameters)> CallbackFunction;
+
+	class Iterator
+	{
+	public:
+		Iterator(MulticallView* view, size_t index) : _view(view), _index(index) {}
+
+		/**
+		 * Decodes the call the iterator points to. Malformed calls are returned with an empty method name.
+		 */
+		MulticallCall operator*();
+		Iterator& operator++() { _index++; return *this; }
+		bool operator==(const Iterator& rhs) const { return _index == rhs._index; }
+		bool operator!=(const Iterator& rhs) const { return _index != rhs._index; }
+	private:
+		MulticallView* _view = nullptr;
+		size_t _index = 0;
+	};
+
+	MulticallView(BaseLib::SharedObjects* baseLib);
+	virtual ~MulticallView() {}
+
+	/**
+	 * Returns the number of calls in the request.
+	 */
+	virtual size_t size() = 0;
+
+	/**
+	 * Decodes a single call.
+	 *
+	 * @param index The index of the call.
+	 * @param[out] call The decoded call.
+	 * @return Returns false when the call is malformed.
+	 */
+	virtual bool get(size_t index, MulticallCall& call) = 0;
+
+	Iterator begin() { return Iterator(this, 0); }
+	Iterator end() { return Iterator(this, size()); }
+
+	/**
+	 * Executes all calls and returns the results in request order. With "maxThreads" greater than 1, consecutive calls referencing different peers (peer ID or
+	 * "ADDRESS:CHANNEL" as first parameter) are grouped by peer and the groups are executed in parallel. Calls to the same peer keep their order. Calls without
+	 * peer reference are executed on their own after all preceding calls have finished.
+	 *
+	 * @param callback The function executing a single call. It needs to be thread safe when "maxThreads" is greater than 1.
+	 * @param maxThreads The maximum number of threads to use. "1" executes all calls in the calling thread.
+	 * @return One result per call. Malformed calls produce an error struct.
+	 */
+	std::vector<PVariable> execute(CallbackFunction callback, uint32_t maxThreads = 1);
+protected:
+	BaseLib::SharedObjects* _bl = nullptr;
+
+	static std::string getPeerKey(PArray& parameters);
+	PVariable invoke(CallbackFunction& callback, MulticallCall& call);
+	void executeParallel(CallbackFunction& callback, std::vector<MulticallCall>& calls, std::vector<PVariable>& results, uint32_t maxThreads);
+	void executeGroups(CallbackFunction* callback, std::vector<std::vector<MulticallCall*>>* groups, size_t firstGroup, size_t step, std::vector<PVariable>* results);
+};
+
+typedef std::shared_ptr<MulticallView> PMulticallView;
+
+/**
+ * Multicall view on a binary RPC packet. The view stores the offsets of the calls within the packet, so the packet must not be modified or destroyed while the view is in use.
+ */
+class BinaryMulticallView : public MulticallView
+{
+public:
+	BinaryMulticallView(BaseLib::SharedObjects* baseLib, RpcDecoder* decoder, std::vector<char>& packet, std::vector<uint32_t>& offsets);
+	virtual ~BinaryMulticallView() {}
+
+	virtual size_t size() { return _offsets.size(); }
+	virtual bool get(size_t index, MulticallCall& call);
+private:
+	RpcDecoder* _decoder = nullptr;
+	std::vector<char>& _packet;
+	std::vector<uint32_t> _offsets;
+};
+
+/**
+ * Multicall view on a XML-RPC packet. The view owns the parsed XML document which references the packet, so the packet must not be modified or destroyed while the view is in use.
+ */
+class XmlrpcMulticallView : public MulticallView
+{
+public:
+	XmlrpcMulticallView(BaseLib::SharedObjects* baseLib, XmlrpcDecoder* decoder, std::shared_ptr<xml_document<>> doc, std::vector<xml_node<>*>& callNodes);
+	virtual ~XmlrpcMulticallView();
+
+	virtual size_t size() { return _callNodes.size(); }
+	virtual bool get(size_t index, MulticallCall& call);
+private:
+	XmlrpcDecoder* _decoder = nullptr;
+	std::shared_ptr<xml_document<>> _doc;
+	std::vector<xml_node<>*> _callNodes;
+};
+
+}
+}
+#endif
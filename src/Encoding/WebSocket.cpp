@@ -31,9 +31,41 @@
 #include "WebSocket.h"
 #include "../HelperFunctions/HelperFunctions.h"
 #include <iostream>
+#include <cstring>
+#include <set>
+
+#include <zlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 namespace BaseLib
 {
+struct WebSocket::DeflateState
+{
+	z_stream deflateStream;
+	z_stream inflateStream;
+	bool deflateInitialized = false;
+	bool inflateInitialized = false;
+	bool contextTakeover = true;
+	bool clientContextTakeover = true;
+
+	DeflateState()
+	{
+		memset(&deflateStream, 0, sizeof(z_stream));
+		memset(&inflateStream, 0, sizeof(z_stream));
+	}
+
+	~DeflateState()
+	{
+		if(deflateInitialized) deflateEnd(&deflateStream);
+		if(inflateInitialized) inflateEnd(&inflateStream);
+	}
+};
+
 WebSocket::WebSocket()
 {
 }
@@ -50,13 +82,86 @@ void WebSocket::reset()
 	_finished = false;
 	_dataProcessingStarted = false;
 	_oldContentSize = 0;
+	_compressedMessage = false;
+}
+
+std::string WebSocket::negotiateDeflate(const std::string& extensions)
+{
+	return negotiateDeflate(extensions, DeflateOptions());
+}
+
+std::string WebSocket::negotiateDeflate(const std::string& extensions, const DeflateOptions& options)
+{
+	_deflate.reset();
+	if(options.windowBits < 9 || options.windowBits > 15 || options.clientWindowBits < 8 || options.clientWindowBits > 15) throw WebSocketException("Invalid window size.");
+
+	std::vector<std::string> offers = HelperFunctions::splitAll(extensions, ',');
+	for(auto& offer : offers)
+	{
+		std::vector<std::string> elements = HelperFunctions::splitAll(offer, ';');
+		if(HelperFunctions::trim(elements.at(0)) != "permessage-deflate") continue;
+
+		bool valid = true;
+		bool serverNoContextTakeover = !options.contextTakeover;
+		bool clientNoContextTakeover = !options.clientContextTakeover;
+		int32_t serverWindowBits = options.windowBits;
+		int32_t clientWindowBits = options.clientWindowBits;
+		bool clientWindowBitsSupported = false;
+		std::set<std::string> parameterNames;
+		for(uint32_t i = 1; i < elements.size(); i++)
+		{
+			std::pair<std::string, std::string> parameter = HelperFunctions::splitFirst(elements.at(i), '=');
+			HelperFunctions::trim(parameter.first);
+			HelperFunctions::trim(parameter.second);
+			if(parameter.second.size() >= 2 && parameter.second.front() == '"' && parameter.second.back() == '"') parameter.second = parameter.second.substr(1, parameter.second.size() - 2);
+			int32_t windowBits = 0;
+			if(parameter.second.size() == 1 && parameter.second.at(0) >= '8' && parameter.second.at(0) <= '9') windowBits = parameter.second.at(0) - '0';
+			else if(parameter.second.size() == 2 && parameter.second.at(0) == '1' && parameter.second.at(1) >= '0' && parameter.second.at(1) <= '5') windowBits = 10 + parameter.second.at(1) - '0';
+
+			if(!parameterNames.insert(parameter.first).second) valid = false;
+			else if(parameter.first == "server_no_context_takeover" && parameter.second.empty()) serverNoContextTakeover = true;
+			else if(parameter.first == "client_no_context_takeover" && parameter.second.empty()) clientNoContextTakeover = true;
+			else if(parameter.first == "server_max_window_bits" && windowBits != 0)
+			{
+				//zlib can't create raw deflate streams with a window of 256 bytes, so this offer can't be accepted.
+				if(windowBits == 8) valid = false;
+				else if(windowBits < serverWindowBits) serverWindowBits = windowBits;
+			}
+			else if(parameter.first == "client_max_window_bits" && (parameter.second.empty() || windowBits != 0))
+			{
+				clientWindowBitsSupported = true;
+				if(windowBits != 0 && windowBits < clientWindowBits) clientWindowBits = windowBits;
+			}
+			else valid = false;
+			if(!valid) break;
+		}
+		if(!valid) continue;
+
+		std::shared_ptr<DeflateState> deflateState = std::make_shared<DeflateState>();
+		deflateState->contextTakeover = !serverNoContextTakeover;
+		deflateState->clientContextTakeover = !clientNoContextTakeover;
+		if(deflateInit2(&deflateState->deflateStream, options.level, Z_DEFLATED, -serverWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) throw WebSocketException("Could not initialize zlib stream.");
+		deflateState->deflateInitialized = true;
+		//The largest window is always used for decompression, so it doesn't matter whether the client honors "client_max_window_bits".
+		if(inflateInit2(&deflateState->inflateStream, -15) != Z_OK) throw WebSocketException("Could not initialize zlib stream.");
+		deflateState->inflateInitialized = true;
+		_deflate = deflateState;
+
+		std::string response = "permessage-deflate";
+		if(serverNoContextTakeover) response.append("; server_no_context_takeover");
+		if(clientNoContextTakeover) response.append("; client_no_context_takeover");
+		if(serverWindowBits < 15) response.append("; server_max_window_bits=" + std::to_string(serverWindowBits));
+		if(clientWindowBitsSupported && clientWindowBits < 15) response.append("; client_max_window_bits=" + std::to_string(clientWindowBits));
+		return response;
+	}
+	return "";
 }
 
 void WebSocket::process(char* buffer, int32_t bufferLength)
 {
 	if(bufferLength <= 0 || _finished) return;
 	if(!_header.parsed) processHeader(&buffer, bufferLength);
-	if(_header.length == 0 || _header.rsv1 || _header.rsv2 || _header.rsv3 || (_header.opcode != Header::Opcode::continuation && _header.opcode != Header::Opcode::text  && _header.opcode != Header::Opcode::binary && _header.opcode != Header::Opcode::ping && _header.opcode != Header::Opcode::pong))
+	if(_header.length == 0 || (_header.rsv1 && (!_deflate || (_header.opcode != Header::Opcode::text && _header.opcode != Header::Opcode::binary))) || _header.rsv2 || _header.rsv3 || (_header.opcode != Header::Opcode::continuation && _header.opcode != Header::Opcode::text  && _header.opcode != Header::Opcode::binary && _header.opcode != Header::Opcode::ping && _header.opcode != Header::Opcode::pong))
 	{
 		_header.close = true;
 		_dataProcessingStarted = true;
@@ -76,6 +181,8 @@ void WebSocket::processHeader(char** buffer, int32_t& bufferLength)
 	_header.rsv2 = (*buffer)[0] & 0x20;
 	_header.rsv3 = (*buffer)[0] & 0x10;
 	_header.opcode = (Header::Opcode::Enum)((*buffer)[0] & 0x0F);
+	//Only the first frame of a message has "rsv1" set when it is compressed.
+	if(_header.opcode == Header::Opcode::text || _header.opcode == Header::Opcode::binary) _compressedMessage = _header.rsv1;
 	_header.hasMask = (*buffer)[1] & 0x80;
 	(*buffer)[1] &= 0x7F;
 	if((*buffer)[1] == 126) lengthBytes = 2;
@@ -97,11 +204,8 @@ void WebSocket::processHeader(char** buffer, int32_t& bufferLength)
 	}
 	if(_header.hasMask)
 	{
-		_header.maskingKey.reserve(4);
-		_header.maskingKey.push_back((*buffer)[2 + lengthBytes]);
-		_header.maskingKey.push_back((*buffer)[2 + lengthBytes + 1]);
-		_header.maskingKey.push_back((*buffer)[2 + lengthBytes + 2]);
-		_header.maskingKey.push_back((*buffer)[2 + lengthBytes + 3]);
+		//Every frame of a fragmented message has its own key.
+		_header.maskingKey.assign(*buffer + 2 + lengthBytes, *buffer + 2 + lengthBytes + 4);
 	}
 	*buffer += headerSize;
 	bufferLength -= headerSize;
@@ -113,12 +217,15 @@ void WebSocket::processContent(char* buffer, int32_t bufferLength)
 	uint32_t currentContentSize = _content.size() - _oldContentSize;
 	if(currentContentSize + bufferLength > 10485760) throw WebSocketException("Data is larger than 10MiB.");
 	if(currentContentSize + bufferLength > _header.length) bufferLength -= (currentContentSize + bufferLength) - _header.length;
+	size_t oldSize = _content.size();
 	_content.insert(_content.end(), buffer, buffer + bufferLength);
+	//Unmask the new bytes while they are in the cache anyway. The key position depends on the offset within the frame.
+	if(_header.hasMask && bufferLength > 0) applyMask(_content.data() + oldSize, bufferLength, _header.maskingKey.data(), currentContentSize);
 	if(currentContentSize + bufferLength == _header.length)
 	{
 		if(_header.fin)
 		{
-			applyMask();
+			if(_compressedMessage) inflateContent();
 			_finished = true;
 		}
 		else
@@ -129,13 +236,126 @@ void WebSocket::processContent(char* buffer, int32_t bufferLength)
 	}
 }
 
-void WebSocket::applyMask()
+void WebSocket::applyMask(char* data, size_t size, const char* maskingKey, size_t offset)
 {
-	if(!_header.hasMask) return;
-	for(uint32_t i = 0; i < _content.size(); i++)
+	//The key repeated and rotated to the position of "data" within the frame. Block sizes are multiples of 4, so the pattern stays aligned.
+	uint8_t pattern[16];
+	for(uint32_t i = 0; i < sizeof(pattern); i++)
+	{
+		pattern[i] = (uint8_t)maskingKey[(offset + i) & 3];
+	}
+
+	size_t pos = 0;
+#if defined(__SSE2__)
+	__m128i mask128 = _mm_loadu_si128((const __m128i*)pattern);
+	for(; pos + 16 <= size; pos += 16)
 	{
-		_content.operator [](i) ^= _header.maskingKey[i % 4];
+		__m128i block = _mm_loadu_si128((const __m128i*)(data + pos));
+		_mm_storeu_si128((__m128i*)(data + pos), _mm_xor_si128(block, mask128));
 	}
+#elif defined(__ARM_NEON)
+	uint8x16_t mask128 = vld1q_u8(pattern);
+	for(; pos + 16 <= size; pos += 16)
+	{
+		vst1q_u8((uint8_t*)(data + pos), veorq_u8(vld1q_u8((const uint8_t*)(data + pos)), mask128));
+	}
+#endif
+
+	uint64_t mask64 = 0;
+	memcpy(&mask64, pattern, sizeof(mask64));
+	for(; pos + 8 <= size; pos += 8)
+	{
+		uint64_t block = 0;
+		memcpy(&block, data + pos, sizeof(block));
+		block ^= mask64;
+		memcpy(data + pos, &block, sizeof(block));
+	}
+
+	for(; pos < size; pos++)
+	{
+		data[pos] ^= pattern[pos & 3];
+	}
+}
+
+void WebSocket::inflateContent()
+{
+	//The sender removes the empty block at the end of the compressed data (RFC 7692 section 7.2.1). It needs to be appended again.
+	static const char emptyBlock[4] = { 0, 0, (char)0xFF, (char)0xFF };
+	_content.insert(_content.end(), emptyBlock, emptyBlock + sizeof(emptyBlock));
+
+	z_stream& stream = _deflate->inflateStream;
+	std::vector<char> data(std::min(_content.size() * 4, (size_t)10485760));
+	size_t size = 0;
+	stream.next_in = (Bytef*)_content.data();
+	stream.avail_in = _content.size();
+	while(true)
+	{
+		if(size == data.size())
+		{
+			if(data.size() >= 10485760)
+			{
+				inflateReset(&stream);
+				throw WebSocketException("Data is larger than 10MiB.");
+			}
+			data.resize(std::min(data.size() * 2, (size_t)10485760));
+		}
+		stream.next_out = (Bytef*)data.data() + size;
+		stream.avail_out = data.size() - size;
+		int32_t result = inflate(&stream, Z_SYNC_FLUSH);
+		size = data.size() - stream.avail_out;
+		if(result == Z_STREAM_END)
+		{
+			//The sender finished the deflate stream, so the next message starts a new one.
+			inflateReset(&stream);
+			break;
+		}
+		if(result != Z_OK && result != Z_BUF_ERROR)
+		{
+			inflateReset(&stream);
+			throw WebSocketException("Could not decompress data: " + std::to_string(result));
+		}
+		if(stream.avail_out != 0) break;
+	}
+	data.resize(size);
+	_content.swap(data);
+	if(!_deflate->clientContextTakeover) inflateReset(&stream);
+}
+
+void WebSocket::encodeMessage(const std::vector<char>& data, Header::Opcode::Enum messageType, std::vector<char>& output)
+{
+	if(!_deflate || (messageType != Header::Opcode::text && messageType != Header::Opcode::binary))
+	{
+		encode(data, messageType, output);
+		return;
+	}
+
+	z_stream& stream = _deflate->deflateStream;
+	std::vector<char> compressedData(deflateBound(&stream, data.size()) + 16);
+	size_t compressedSize = 0;
+	stream.next_in = (Bytef*)data.data();
+	stream.avail_in = data.size();
+	do
+	{
+		if(compressedSize == compressedData.size()) compressedData.resize(compressedData.size() * 2);
+		stream.next_out = (Bytef*)compressedData.data() + compressedSize;
+		stream.avail_out = compressedData.size() - compressedSize;
+		int32_t result = deflate(&stream, Z_SYNC_FLUSH);
+		if(result != Z_OK && result != Z_BUF_ERROR)
+		{
+			deflateReset(&stream);
+			throw WebSocketException("Could not compress data: " + std::to_string(result));
+		}
+		compressedSize = compressedData.size() - stream.avail_out;
+	} while(stream.avail_out == 0);
+	if(!_deflate->contextTakeover) deflateReset(&stream);
+
+	//Remove the empty block created by Z_SYNC_FLUSH (RFC 7692 section 7.2.1). An empty message is sent as a single empty block.
+	if(compressedSize >= 4) compressedSize -= 4;
+	compressedData.resize(compressedSize);
+	if(compressedData.empty()) compressedData.push_back(0);
+
+	encode(compressedData, messageType, output);
+	output[0] |= 0x40;
 }
 
 void WebSocket::encode(const std::vector<char>& data, Header::Opcode::Enum messageType, std::vector<char>& output)
@@ -179,6 +399,13 @@ void WebSocket::encode(const std::vector<char>& data, Header::Opcode::Enum messa
 	if(!data.empty()) output.insert(output.end(), data.begin(), data.end());
 }
 
+std::shared_ptr<const std::vector<char>> WebSocket::encodeShared(const std::vector<char>& data, Header::Opcode::Enum messageType)
+{
+	std::shared_ptr<std::vector<char>> output = std::make_shared<std::vector<char>>();
+	encode(data, messageType, *output);
+	return output;
+}
+
 void WebSocket::encodeClose(std::vector<char>& output)
 {
 	output.clear();
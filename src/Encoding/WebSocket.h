@@ -34,6 +34,7 @@
 #include "../Exception.h"
 
 #include <memory>
+#include <string>
 #include <vector>
 
 namespace BaseLib
@@ -65,6 +66,37 @@ public:
 		std::vector<char> maskingKey;
 	};
 
+	/**
+	 * Settings for the permessage-deflate extension (RFC 7692).
+	 */
+	struct DeflateOptions
+	{
+		/**
+		 * The maximum LZ77 window size (as base 2 logarithm) used to compress outgoing messages. Valid values are 9 to 15. Smaller windows need less memory per connection.
+		 */
+		int32_t windowBits = 15;
+
+		/**
+		 * The maximum window size the client is asked to use for its messages, when the client supports "client_max_window_bits". Valid values are 8 to 15.
+		 */
+		int32_t clientWindowBits = 15;
+
+		/**
+		 * When set to "false", every outgoing message is compressed independently ("server_no_context_takeover"). This reduces the compression ratio but makes it possible to send the same compressed data to multiple clients.
+		 */
+		bool contextTakeover = true;
+
+		/**
+		 * When set to "false", the client is asked to compress every message independently ("client_no_context_takeover").
+		 */
+		bool clientContextTakeover = true;
+
+		/**
+		 * The zlib compression level between 1 (fastest) and 9 (smallest).
+		 */
+		int32_t level = 6;
+	};
+
 	WebSocket();
 	virtual ~WebSocket() {}
 
@@ -81,8 +113,35 @@ public:
 	std::vector<char>& getContent() { return _content; }
 	uint32_t getContentSize() { return _content.size(); }
 	Header& getHeader() { return _header; }
+
+	/**
+	 * Resets the object to receive the next message. The permessage-deflate state is kept.
+	 */
 	void reset();
 
+	/**
+	 * Negotiates the permessage-deflate extension (RFC 7692) as server. Call this when handling the opening handshake and, if the returned
+	 * string is not empty, add it to the response as "Sec-WebSocket-Extensions". Afterwards compressed messages are decompressed by process()
+	 * and encodeMessage() compresses outgoing messages. Programs using this need to link against zlib ("-lz").
+	 *
+	 * @param extensions The value of the client's "Sec-WebSocket-Extensions" header.
+	 * @param options The compression settings.
+	 * @return Returns the value for the "Sec-WebSocket-Extensions" header of the response or an empty string when none of the client's offers was accepted.
+	 */
+	std::string negotiateDeflate(const std::string& extensions, const DeflateOptions& options);
+
+	/**
+	 * Negotiates the permessage-deflate extension using the default settings.
+	 *
+	 * @see negotiateDeflate(const std::string&, const DeflateOptions&)
+	 */
+	std::string negotiateDeflate(const std::string& extensions);
+
+	/**
+	 * Returns "true" when permessage-deflate was negotiated successfully.
+	 */
+	bool deflateEnabled() { return (bool)_deflate; }
+
 	/**
 	 * Parses WebSocket data from a buffer.
 	 *
@@ -102,6 +161,27 @@ public:
 	 */
 	static void encode(const std::vector<char>& data, Header::Opcode::Enum messageType, std::vector<char>& output);
 
+	/**
+	 * Encodes a WebSocket packet into an immutable buffer that can be sent to multiple clients, e. g. using TcpSocket::sendToClients(). The
+	 * packet is never compressed, so it is valid for all connections independent of the negotiated extensions.
+	 *
+	 * @param data The data to encode
+	 * @param messageType The message type of the packet.
+	 * @return Returns the WebSocket packet.
+	 */
+	static std::shared_ptr<const std::vector<char>> encodeShared(const std::vector<char>& data, Header::Opcode::Enum messageType);
+
+	/**
+	 * Encodes a WebSocket packet and compresses text and binary messages when permessage-deflate was negotiated. Contrary to encode() this
+	 * method must be called on the object of the connection the packet is sent over, as the compression state is kept between messages.
+	 *
+	 * @param[in] data The data to encode
+	 * @param[in] messageType The message type of the packet.
+	 * @param[out] output The WebSocket packet
+	 * @see negotiateDeflate()
+	 */
+	void encodeMessage(const std::vector<char>& data, Header::Opcode::Enum messageType, std::vector<char>& output);
+
 	/**
 	 * Encodes a WebSocket "close" packet.
 	 *
@@ -109,15 +189,33 @@ public:
 	 */
 	static void encodeClose(std::vector<char>& output);
 private:
+	struct DeflateState;
+
 	Header _header;
 	std::vector<char> _content;
 	uint32_t _oldContentSize = 0;
 	bool _finished = false;
 	bool _dataProcessingStarted = false;
+	std::shared_ptr<DeflateState> _deflate;
+	bool _compressedMessage = false;
 
 	void processHeader(char** buffer, int32_t& bufferLength);
 	void processContent(char* buffer, int32_t bufferLength);
-	void applyMask();
+
+	/**
+	 * Unmasks data in place using 128 bit (SSE2 or NEON) and 64 bit XOR.
+	 *
+	 * @param data The data to unmask.
+	 * @param size The size of "data".
+	 * @param maskingKey The 4 byte masking key of the frame.
+	 * @param offset The position of "data" within the frame's payload.
+	 */
+	static void applyMask(char* data, size_t size, const char* maskingKey, size_t offset);
+
+	/**
+	 * Decompresses _content after the last frame of a compressed message was received.
+	 */
+	void inflateContent();
 
 };
 }
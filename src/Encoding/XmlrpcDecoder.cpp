@@ -73,13 +73,7 @@ std::shared_ptr<std::vector<std::shared_ptr<Variable>>> XmlrpcDecoder::decodeReq
 			return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. Node \"params\" not found.")});
 		}
 
-		std::shared_ptr<std::vector<std::shared_ptr<Variable>>> parameters(new std::vector<std::shared_ptr<Variable>>());
-		for(xml_node<>* paramNode = subNode->first_node(); paramNode; paramNode = paramNode->next_sibling())
-		{
-			xml_node<>* valueNode = paramNode->first_node("value");
-			if(valueNode == nullptr) continue;
-			parameters->push_back(decodeParameter(valueNode));
-		}
+		std::shared_ptr<std::vector<std::shared_ptr<Variable>>> parameters = decodeParameters(subNode);
 
 		doc.clear();
 		return parameters;
@@ -104,6 +98,141 @@ std::shared_ptr<std::vector<std::shared_ptr<Variable>>> XmlrpcDecoder::decodeReq
     return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. Not well formed.")});
 }
 
+std::shared_ptr<std::vector<std::shared_ptr<Variable>>> XmlrpcDecoder::decodeRequest(std::vector<char>& packet, std::string& methodName, PMulticallView& multicall)
+{
+	multicall.reset();
+	//The document is kept by the multicall view, so it is allocated on the heap.
+	std::shared_ptr<xml_document<>> doc = std::make_shared<xml_document<>>();
+	try
+	{
+		doc->parse<0>(&packet.at(0));
+		xml_node<>* node = doc->first_node();
+		if(node == nullptr || std::string(doc->first_node()->name()) != "methodCall")
+		{
+			doc->clear();
+			return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. First root node has to be \"methodCall\".")});
+		}
+		xml_node<>* subNode = node->first_node("methodName");
+		if(subNode == nullptr || std::string(subNode->name()) != "methodName")
+		{
+			doc->clear();
+			return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. Node \"methodName\" not found.")});
+		}
+		methodName = std::string(subNode->value());
+		if(methodName.empty())
+		{
+			doc->clear();
+			return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. \"methodName\" is empty.")});
+		}
+
+		subNode = node->first_node("params");
+		if(subNode == nullptr)
+		{
+			doc->clear();
+			return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. Node \"params\" not found.")});
+		}
+
+		if(methodName != "system.multicall")
+		{
+			std::shared_ptr<std::vector<std::shared_ptr<Variable>>> parameters = decodeParameters(subNode);
+			doc->clear();
+			return parameters;
+		}
+
+		//params/param/value/array/data/value*
+		xml_node<>* dataNode = subNode->first_node("param");
+		if(dataNode) dataNode = dataNode->first_node("value");
+		if(dataNode) dataNode = dataNode->first_node("array");
+		if(dataNode) dataNode = dataNode->first_node("data");
+		if(dataNode == nullptr)
+		{
+			doc->clear();
+			return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32602, "Invalid params. system.multicall expects exactly one array parameter.")});
+		}
+
+		std::vector<xml_node<>*> callNodes;
+		for(xml_node<>* valueNode = dataNode->first_node(); valueNode; valueNode = valueNode->next_sibling())
+		{
+			callNodes.push_back(valueNode);
+		}
+		multicall = std::make_shared<XmlrpcMulticallView>(_bl, this, doc, callNodes);
+		return std::make_shared<std::vector<std::shared_ptr<Variable>>>();
+	}
+	catch(const std::exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    	doc->clear();
+    	return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. Not well formed: " + std::string(ex.what()))});
+    }
+    catch(const Exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    	doc->clear();
+    	return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. Not well formed: " + std::string(ex.what()))});
+    }
+    catch(...)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    	doc->clear();
+    }
+    return std::shared_ptr<std::vector<std::shared_ptr<Variable>>>(new std::vector<std::shared_ptr<Variable>>{Variable::createError(-32700, "Parse error. Not well formed.")});
+}
+
+std::shared_ptr<std::vector<std::shared_ptr<Variable>>> XmlrpcDecoder::decodeParameters(xml_node<>* paramsNode)
+{
+	std::shared_ptr<std::vector<std::shared_ptr<Variable>>> parameters(new std::vector<std::shared_ptr<Variable>>());
+	for(xml_node<>* paramNode = paramsNode->first_node(); paramNode; paramNode = paramNode->next_sibling())
+	{
+		xml_node<>* valueNode = paramNode->first_node("value");
+		if(valueNode == nullptr) continue;
+		parameters->push_back(decodeParameter(valueNode));
+	}
+	return parameters;
+}
+
+bool XmlrpcDecoder::decodeMulticallCall(xml_node<>* callNode, std::string& methodName, PArray& parameters)
+{
+	try
+	{
+		xml_node<>* structNode = callNode->first_node("struct");
+		if(structNode == nullptr) return false;
+		for(xml_node<>* memberNode = structNode->first_node(); memberNode; memberNode = memberNode->next_sibling())
+		{
+			xml_node<>* nameNode = memberNode->first_node("name");
+			if(nameNode == nullptr) continue;
+			xml_node<>* valueNode = nameNode->next_sibling("value");
+			if(valueNode == nullptr) continue;
+			std::string name(nameNode->value());
+			if(name == "methodName")
+			{
+				PVariable value = decodeParameter(valueNode);
+				if(!value || value->type != VariableType::tString) return false;
+				methodName = value->stringValue;
+			}
+			else if(name == "params")
+			{
+				PVariable value = decodeParameter(valueNode);
+				if(!value || value->type != VariableType::tArray) return false;
+				parameters = value->arrayValue;
+			}
+		}
+		return true;
+	}
+	catch(const std::exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(const Exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    return false;
+}
+
 std::shared_ptr<Variable> XmlrpcDecoder::decodeResponse(std::string& packet)
 {
 	xml_document<> doc;
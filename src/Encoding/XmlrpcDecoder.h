@@ -33,6 +33,7 @@
 
 #include "../Variable.h"
 #include "RapidXml/rapidxml.hpp"
+#include "RpcMulticall.h"
 
 #include <memory>
 #include <vector>
@@ -53,15 +54,32 @@ public:
 	virtual ~XmlrpcDecoder() {}
 
 	virtual std::shared_ptr<std::vector<std::shared_ptr<Variable>>> decodeRequest(std::vector<char>& packet, std::string& methodName);
+
+	/**
+	 * Decodes a request like decodeRequest(std::vector<char>&, std::string&), but doesn't materialize the parameters of "system.multicall" requests. For these requests
+	 * "multicall" is set to a view on the contained calls and an empty parameter array is returned. The view keeps the parsed document, which points into "packet", so
+	 * "packet" and this decoder need to outlive it.
+	 *
+	 * @param packet The XML-RPC request.
+	 * @param[out] methodName The name of the requested method.
+	 * @param[out] multicall Set when the request is a valid "system.multicall" request, otherwise reset.
+	 * @return Returns the decoded parameters. When the request is malformed, an array with a single error struct (-32700 or -32602) is returned and
+	 * "multicall" stays reset.
+	 */
+	virtual std::shared_ptr<std::vector<std::shared_ptr<Variable>>> decodeRequest(std::vector<char>& packet, std::string& methodName, PMulticallView& multicall);
 	virtual std::shared_ptr<Variable> decodeResponse(std::vector<char>& packet);
 	virtual std::shared_ptr<Variable> decodeResponse(std::string& packet);
 private:
+	friend class XmlrpcMulticallView;
+
 	BaseLib::SharedObjects* _bl = nullptr;
 
 	std::shared_ptr<Variable> decodeParameter(xml_node<>* valueNode);
 	std::shared_ptr<Variable> decodeArray(xml_node<>* dataNode);
 	std::shared_ptr<Variable> decodeStruct(xml_node<>* structNode);
 	std::shared_ptr<Variable> decodeResponse(xml_document<>* doc);
+	std::shared_ptr<std::vector<std::shared_ptr<Variable>>> decodeParameters(xml_node<>* paramsNode);
+	bool decodeMulticallCall(xml_node<>* callNode, std::string& methodName, PArray& parameters);
 };
 
 } /* namespace Rpc */
@@ -196,6 +196,59 @@ void XmlrpcEncoder::encodeResponse(std::shared_ptr<Variable> variable, std::vect
 	doc.clear();
 }
 
+void XmlrpcEncoder::encodeMulticallResponse(std::vector<PVariable>& results, std::vector<char>& encodedData)
+{
+	xml_document<> doc;
+	try
+	{
+		xml_node<> *node = doc.allocate_node(node_element, "methodResponse");
+		doc.append_node(node);
+		xml_node<> *paramsNode = doc.allocate_node(node_element, "params");
+		node->append_node(paramsNode);
+		xml_node<> *paramNode = doc.allocate_node(node_element, "param");
+		paramsNode->append_node(paramNode);
+		xml_node<> *valueNode = doc.allocate_node(node_element, "value");
+		paramNode->append_node(valueNode);
+		xml_node<> *arrayNode = doc.allocate_node(node_element, "array");
+		valueNode->append_node(arrayNode);
+		xml_node<> *dataNode = doc.allocate_node(node_element, "data");
+		arrayNode->append_node(dataNode);
+
+		for(auto& result : results)
+		{
+			if(result && result->errorStruct) encodeVariable(&doc, dataNode, result);
+			else
+			{
+				xml_node<> *resultValueNode = doc.allocate_node(node_element, "value");
+				dataNode->append_node(resultValueNode);
+				xml_node<> *resultArrayNode = doc.allocate_node(node_element, "array");
+				resultValueNode->append_node(resultArrayNode);
+				xml_node<> *resultDataNode = doc.allocate_node(node_element, "data");
+				resultArrayNode->append_node(resultDataNode);
+				encodeVariable(&doc, resultDataNode, result);
+			}
+		}
+
+		//Most multicall results are small (e. g. getValue), so this avoids nearly all reallocations.
+		encodedData.reserve(encodedData.size() + 128 + results.size() * 128);
+		print(std::back_inserter(encodedData), doc, 1);
+		doc.clear();
+	}
+	catch(const std::exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(const Exception& ex)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+    }
+    catch(...)
+    {
+    	_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+    }
+    doc.clear();
+}
+
 void XmlrpcEncoder::encodeVariable(xml_document<>* doc, xml_node<>* node, std::shared_ptr<Variable> variable)
 {
 	try
@@ -57,6 +57,15 @@ public:
 
 	virtual void encodeResponse(std::shared_ptr<Variable> variable, std::vector<char>& encodedData);
 	virtual void encodeResponse(std::shared_ptr<Variable> variable, std::vector<uint8_t>& encodedData);
+
+	/**
+	 * Encodes the response to a "system.multicall" request into a single, preallocated packet. Successful results are wrapped in an array with one element, error
+	 * structs are encoded as they are.
+	 *
+	 * @param results The results in request order as returned by MulticallView::execute().
+	 * @param[out] encodedData The encoded response.
+	 */
+	virtual void encodeMulticallResponse(std::vector<PVariable>& results, std::vector<char>& encodedData);
 	virtual void encodeRequest(std::string methodName, std::shared_ptr<std::vector<std::shared_ptr<Variable>>> parameters, std::vector<char>& encodedData);
 	virtual void encodeRequest(std::string methodName, std::shared_ptr<std::list<std::shared_ptr<Variable>>> parameters, std::vector<char>& encodedData);
 private:
@@ -0,0 +1,659 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * 
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "AsyncHttpClient.h"
+#include "../BaseLib.h"
+
+#include <array>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+namespace BaseLib
+{
+
+AsyncHttpClient::AsyncHttpClient(BaseLib::SharedObjects* baseLib)
+{
+	_bl = baseLib;
+}
+
+AsyncHttpClient::~AsyncHttpClient()
+{
+	stop();
+}
+
+// {{{ Public methods
+void AsyncHttpClient::start()
+{
+	try
+	{
+		std::lock_guard<std::mutex> startStopGuard(_startStopMutex);
+		if(!_stopEventLoop) return;
+		_epollDescriptor = _bl->fileDescriptorManager.add(epoll_create1(EPOLL_CLOEXEC));
+		if(_epollDescriptor->descriptor == -1) throw HttpClientException("Could not create epoll instance: " + std::string(strerror(errno)));
+		_wakeUpDescriptor = _bl->fileDescriptorManager.add(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+		if(_wakeUpDescriptor->descriptor == -1)
+		{
+			_bl->fileDescriptorManager.close(_epollDescriptor);
+			throw HttpClientException("Could not create eventfd: " + std::string(strerror(errno)));
+		}
+		epoll_event event{};
+		event.events = EPOLLIN;
+		event.data.fd = _wakeUpDescriptor->descriptor;
+		epoll_ctl(_epollDescriptor->descriptor, EPOLL_CTL_ADD, _wakeUpDescriptor->descriptor, &event);
+
+		_stopEventLoop = false;
+		_bl->threadManager.start(_eventLoopThread, true, &AsyncHttpClient::eventLoop, this);
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void AsyncHttpClient::stop()
+{
+	try
+	{
+		std::lock_guard<std::mutex> startStopGuard(_startStopMutex);
+		if(_stopEventLoop) return;
+		{
+			//Set while holding the lock, so sendRequest() doesn't queue requests after the event loop took the remaining requests.
+			std::lock_guard<std::mutex> newRequestsGuard(_newRequestsMutex);
+			_stopEventLoop = true;
+		}
+		wakeUp();
+		_bl->threadManager.join(_eventLoopThread);
+		_bl->fileDescriptorManager.close(_wakeUpDescriptor);
+		_bl->fileDescriptorManager.close(_epollDescriptor);
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void AsyncHttpClient::sendRequest(const std::string& hostname, int32_t port, const std::string& request, ResponseCallback callback, uint32_t timeout)
+{
+	if(request.empty()) throw HttpClientException("Request is empty.");
+
+	PRequest newRequest = std::make_shared<Request>();
+	newRequest->hostKey = hostname + ":" + std::to_string(port);
+
+	//Resolve in the calling thread, so the event loop is never blocked by DNS.
+	try
+	{
+		bool cacheHit = false;
+		newRequest->addresses = TcpSocket::resolveHostname(hostname, std::to_string(port), cacheHit);
+	}
+	catch(SocketOperationException& ex)
+	{
+		throw HttpClientException("Could not resolve \"" + hostname + "\": " + ex.what());
+	}
+
+	std::string method = request.substr(0, request.find(' '));
+	newRequest->data = request;
+	newRequest->callback = callback;
+	newRequest->deadline = HelperFunctions::getTime() + timeout;
+	newRequest->head = method == "HEAD";
+	newRequest->idempotent = method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE" || method == "OPTIONS" || method == "TRACE";
+	{
+		std::lock_guard<std::mutex> newRequestsGuard(_newRequestsMutex);
+		//Checked while holding the lock, so the request is either taken by the event loop or rejected here.
+		if(_stopEventLoop) throw HttpClientException("Event loop is not running.");
+		_newRequests.push_back(newRequest);
+	}
+	wakeUp();
+}
+
+void AsyncHttpClient::get(const std::string& hostname, int32_t port, const std::string& path, ResponseCallback callback, uint32_t timeout)
+{
+	std::string getRequest = "GET " + (path.empty() ? std::string("/") : path) + " HTTP/1.1\r\nUser-Agent: Homegear\r\nHost: " + hostname + ":" + std::to_string(port) + "\r\nConnection: Keep-Alive\r\n\r\n";
+	sendRequest(hostname, port, getRequest, callback, timeout);
+}
+// }}}
+
+void AsyncHttpClient::wakeUp()
+{
+	uint64_t value = 1;
+	if(_wakeUpDescriptor && _wakeUpDescriptor->descriptor != -1)
+	{
+		if(write(_wakeUpDescriptor->descriptor, &value, sizeof(value)) == -1 && errno != EAGAIN) _bl->out.printError("Error: Could not wake up HTTP client event loop: " + std::string(strerror(errno)));
+	}
+}
+
+void AsyncHttpClient::eventLoop()
+{
+	std::array<epoll_event, 64> events;
+	while(!_stopEventLoop)
+	{
+		try
+		{
+			int32_t eventCount = epoll_wait(_epollDescriptor->descriptor, events.data(), events.size(), 100);
+			if(eventCount == -1)
+			{
+				if(errno == EINTR) continue;
+				_bl->out.printError("Error: epoll_wait failed: " + std::string(strerror(errno)));
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				continue;
+			}
+
+			for(int32_t i = 0; i < eventCount; i++)
+			{
+				if(events[i].data.fd == _wakeUpDescriptor->descriptor)
+				{
+					uint64_t value = 0;
+					if(read(_wakeUpDescriptor->descriptor, &value, sizeof(value)) == -1 && errno != EAGAIN) _bl->out.printError("Error: Could not read from eventfd: " + std::string(strerror(errno)));
+					continue;
+				}
+
+				auto connectionIterator = _connections.find(events[i].data.fd);
+				if(connectionIterator == _connections.end()) continue;
+				PConnection connection = connectionIterator->second;
+				if(connection->connecting)
+				{
+					finishConnect(connection);
+					continue;
+				}
+				if(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) readFromConnection(connection);
+				if((events[i].events & EPOLLOUT) && connection->fileDescriptor->descriptor != -1) writeToConnection(connection);
+			}
+
+			takeNewRequests();
+			checkTimeouts();
+			dispatchRequests();
+		}
+		catch(const std::exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(BaseLib::Exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(...)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+		}
+	}
+
+	try
+	{
+		takeNewRequests();
+		std::unordered_map<int32_t, PConnection> connections = _connections;
+		for(auto& connection : connections)
+		{
+			closeConnection(connection.second, "HTTP client was stopped.", false);
+		}
+		for(auto& host : _hosts)
+		{
+			for(auto& request : host.second.queue)
+			{
+				failRequest(request, "HTTP client was stopped.");
+			}
+		}
+		_hosts.clear();
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void AsyncHttpClient::takeNewRequests()
+{
+	std::vector<PRequest> newRequests;
+	{
+		std::lock_guard<std::mutex> newRequestsGuard(_newRequestsMutex);
+		newRequests.swap(_newRequests);
+	}
+	for(auto& request : newRequests)
+	{
+		Host& host = _hosts[request->hostKey];
+		if(host.hostname.empty())
+		{
+			auto separatorPosition = request->hostKey.rfind(':');
+			host.hostname = request->hostKey.substr(0, separatorPosition);
+			host.port = request->hostKey.substr(separatorPosition + 1);
+		}
+
+		//The addresses change when the DNS cache entry expired and the hostname now resolves differently.
+		bool addressesChanged = host.addresses.size() != request->addresses.size();
+		for(size_t i = 0; i < host.addresses.size() && !addressesChanged; i++)
+		{
+			if(host.addresses[i].ipAddress != request->addresses[i].ipAddress) addressesChanged = true;
+		}
+		if(addressesChanged)
+		{
+			host.addresses.swap(request->addresses);
+			host.addressIndex = 0;
+			host.failedAddresses = 0;
+		}
+		request->addresses.clear();
+		host.queue.push_back(request);
+	}
+}
+
+void AsyncHttpClient::dispatchRequests()
+{
+	uint32_t maxPipelinedRequests = _maxPipelinedRequests;
+	uint32_t maxConnectionsPerHost = _maxConnectionsPerHost;
+	for(auto& hostPair : _hosts)
+	{
+		Host& host = hostPair.second;
+		while(!host.queue.empty())
+		{
+			//Prefer the connection with the fewest outstanding requests.
+			PConnection bestConnection;
+			for(auto& connection : host.connections)
+			{
+				size_t limit = connection->pipelining ? maxPipelinedRequests : 1;
+				if(connection->requests.size() >= limit) continue;
+				//HEAD responses can't be told apart from the following response without knowing the request, so they are never pipelined.
+				if(!connection->requests.empty() && (connection->requests.back()->head || host.queue.front()->head)) continue;
+				if(!bestConnection || connection->requests.size() < bestConnection->requests.size()) bestConnection = connection;
+			}
+
+			//Open a new connection instead of pipelining as long as the limit is not reached.
+			if((!bestConnection || !bestConnection->requests.empty()) && host.connections.size() < maxConnectionsPerHost)
+			{
+				openConnection(host);
+				continue;
+			}
+			if(!bestConnection) break;
+
+			PRequest request = host.queue.front();
+			host.queue.pop_front();
+			request->sendBufferOffset = bestConnection->sendBuffer.size();
+			bestConnection->requests.push_back(request);
+			bestConnection->sendBuffer.append(request->data);
+			if(!bestConnection->connecting) writeToConnection(bestConnection);
+		}
+	}
+}
+
+void AsyncHttpClient::checkTimeouts()
+{
+	int64_t time = HelperFunctions::getTime();
+	for(auto& hostPair : _hosts)
+	{
+		Host& host = hostPair.second;
+		for(auto requestIterator = host.queue.begin(); requestIterator != host.queue.end();)
+		{
+			if(time >= (*requestIterator)->deadline)
+			{
+				PRequest request = *requestIterator;
+				requestIterator = host.queue.erase(requestIterator);
+				failRequest(request, "Timeout waiting for connection.");
+			}
+			else requestIterator++;
+		}
+
+		std::vector<PConnection> connections = host.connections;
+		for(auto& connection : connections)
+		{
+			if(!connection->requests.empty())
+			{
+				if(time >= connection->requests.front()->deadline) closeConnection(connection, "Timeout waiting for response.", true);
+			}
+			else if(time - connection->lastActivity >= _idleTimeout) closeConnection(connection, "", false);
+		}
+	}
+
+	//Remove hosts which are not used anymore. Connections reference their host, so only hosts without connections are removed.
+	for(auto hostIterator = _hosts.begin(); hostIterator != _hosts.end();)
+	{
+		if(hostIterator->second.connections.empty() && hostIterator->second.queue.empty()) hostIterator = _hosts.erase(hostIterator);
+		else hostIterator++;
+	}
+}
+
+void AsyncHttpClient::openConnection(Host& host)
+{
+	if(host.addresses.empty())
+	{
+		failQueuedRequests(host, "Hostname has no addresses.");
+		return;
+	}
+	if(host.addressIndex >= host.addresses.size()) host.addressIndex = 0;
+	TcpSocket::ResolvedAddress& address = host.addresses[host.addressIndex];
+
+	PConnection connection = std::make_shared<Connection>();
+	connection->host = &host;
+	connection->addressIndex = host.addressIndex;
+	connection->ipAddress = address.ipAddress;
+	connection->http = std::make_shared<Http>();
+	connection->lastActivity = HelperFunctions::getTime();
+	connection->fileDescriptor = _bl->fileDescriptorManager.add(socket(address.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP));
+	if(connection->fileDescriptor->descriptor == -1)
+	{
+		failQueuedRequests(host, "Could not create socket: " + std::string(strerror(errno)));
+		return;
+	}
+	int32_t optionValue = 1;
+	setsockopt(connection->fileDescriptor->descriptor, IPPROTO_TCP, TCP_NODELAY, &optionValue, sizeof(optionValue));
+
+	host.connections.push_back(connection);
+	_connections.emplace(connection->fileDescriptor->descriptor, connection);
+
+	epoll_event event{};
+	event.events = EPOLLIN | EPOLLOUT;
+	event.data.fd = connection->fileDescriptor->descriptor;
+	connection->events = event.events;
+	epoll_ctl(_epollDescriptor->descriptor, EPOLL_CTL_ADD, connection->fileDescriptor->descriptor, &event);
+
+	//Completion of the connect is signaled by EPOLLOUT.
+	if(connect(connection->fileDescriptor->descriptor, (sockaddr*)&address.address, address.addressLength) == -1 && errno != EINPROGRESS)
+	{
+		connectFailed(connection, "Could not connect to " + address.ipAddress + ": " + std::string(strerror(errno)));
+	}
+}
+
+void AsyncHttpClient::finishConnect(PConnection connection)
+{
+	int32_t error = 0;
+	socklen_t errorLength = sizeof(error);
+	if(getsockopt(connection->fileDescriptor->descriptor, SOL_SOCKET, SO_ERROR, &error, &errorLength) == -1) error = errno;
+	if(error == EINPROGRESS) return;
+	if(error != 0)
+	{
+		connectFailed(connection, "Could not connect to " + connection->ipAddress + ": " + std::string(strerror(error)));
+		return;
+	}
+	connection->connecting = false;
+	connection->host->failedAddresses = 0;
+	connection->lastActivity = HelperFunctions::getTime();
+	writeToConnection(connection);
+}
+
+void AsyncHttpClient::connectFailed(PConnection connection, const std::string& error)
+{
+	Host& host = *connection->host;
+	//Nothing was written yet, so all requests can be sent on another connection.
+	std::deque<PRequest> requests;
+	requests.swap(connection->requests);
+	closeConnection(connection, error, false);
+	host.queue.insert(host.queue.begin(), requests.begin(), requests.end());
+
+	//Connections to an address that was already given up on don't count again.
+	if(connection->addressIndex != host.addressIndex) return;
+	host.addressIndex = (host.addressIndex + 1) % host.addresses.size();
+	host.failedAddresses++;
+	if(host.failedAddresses >= host.addresses.size())
+	{
+		//The host might have moved, so it is resolved again on the next request.
+		host.failedAddresses = 0;
+		TcpSocket::removeDnsCacheEntry(host.hostname, host.port);
+		failQueuedRequests(host, error);
+	}
+}
+
+void AsyncHttpClient::setEvents(PConnection& connection, uint32_t events)
+{
+	if(connection->events == events) return;
+	epoll_event event{};
+	event.events = events;
+	event.data.fd = connection->fileDescriptor->descriptor;
+	connection->events = events;
+	epoll_ctl(_epollDescriptor->descriptor, EPOLL_CTL_MOD, connection->fileDescriptor->descriptor, &event);
+}
+
+void AsyncHttpClient::writeToConnection(PConnection connection)
+{
+	while(connection->sendBufferPos < connection->sendBuffer.size())
+	{
+		ssize_t bytesWritten = send(connection->fileDescriptor->descriptor, connection->sendBuffer.data() + connection->sendBufferPos, connection->sendBuffer.size() - connection->sendBufferPos, MSG_NOSIGNAL);
+		if(bytesWritten == -1)
+		{
+			if(errno == EINTR) continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				setEvents(connection, EPOLLIN | EPOLLOUT);
+				return;
+			}
+			closeConnection(connection, "Could not write to HTTP server: " + std::string(strerror(errno)), true);
+			return;
+		}
+		connection->sendBufferPos += bytesWritten;
+	}
+	for(auto& request : connection->requests)
+	{
+		request->sent = true;
+	}
+	connection->sendBuffer.clear();
+	connection->sendBufferPos = 0;
+	setEvents(connection, EPOLLIN);
+}
+
+void AsyncHttpClient::readFromConnection(PConnection connection)
+{
+	std::array<char, 16385> buffer;
+	while(true)
+	{
+		ssize_t bytesRead = recv(connection->fileDescriptor->descriptor, buffer.data(), buffer.size() - 1, 0);
+		if(bytesRead == -1)
+		{
+			if(errno == EINTR) continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK) return;
+			closeConnection(connection, "Could not read from HTTP server: " + std::string(strerror(errno)), true);
+			return;
+		}
+		if(bytesRead == 0)
+		{
+			//Responses without "Content-Length" and "Transfer-Encoding" end when the connection is closed.
+			if(!connection->requests.empty() && connection->http->headerIsFinished() && !connection->http->hasHeaderField("content-length") && !(connection->http->getHeader().transferEncoding & Http::TransferEncoding::Enum::chunked))
+			{
+				connection->http->setFinished();
+				completeRequest(connection);
+			}
+			closeConnection(connection, "Connection closed by HTTP server.", true);
+			return;
+		}
+		connection->lastActivity = HelperFunctions::getTime();
+		//Http uses string functions to parse chunk sizes.
+		buffer[bytesRead] = '\0';
+
+		char* data = buffer.data();
+		int32_t length = bytesRead;
+		//The data might contain more than one response when requests are pipelined.
+		while(length > 0)
+		{
+			if(connection->requests.empty())
+			{
+				closeConnection(connection, "", false);
+				return;
+			}
+
+			int32_t processedBytes = 0;
+			try
+			{
+				size_t rawHeaderSize = connection->http->getRawHeader().size();
+				processedBytes = connection->http->process(data, length);
+				if(connection->requests.front()->head && connection->http->headerIsFinished() && !connection->http->isFinished())
+				{
+					//A response to HEAD has no body, even when it contains "Content-Length".
+					processedBytes = connection->http->getRawHeader().size() - rawHeaderSize;
+					connection->http->getContent().clear();
+					connection->http->setFinished();
+				}
+			}
+			catch(BaseLib::Exception& ex)
+			{
+				closeConnection(connection, "Could not parse response: " + std::string(ex.what()), false);
+				return;
+			}
+			if(!connection->http->isFinished()) break;
+
+			int32_t responseCode = connection->http->getHeader().responseCode;
+			if(responseCode >= 100 && responseCode < 200 && responseCode != 101)
+			{
+				//Interim response like "100 Continue". The final response follows.
+				connection->http = std::make_shared<Http>();
+			}
+			else if(!completeRequest(connection))
+			{
+				closeConnection(connection, "Connection closed by HTTP server.", true);
+				return;
+			}
+			if(processedBytes <= 0) break;
+			data += processedBytes;
+			length -= processedBytes;
+		}
+	}
+}
+
+bool AsyncHttpClient::completeRequest(PConnection& connection)
+{
+	PRequest request = connection->requests.front();
+	connection->requests.pop_front();
+	std::shared_ptr<Http> response = connection->http;
+	connection->http = std::make_shared<Http>();
+
+	Http::Header& header = response->getHeader();
+	bool framed = request->head || response->hasHeaderField("content-length") || (header.transferEncoding & Http::TransferEncoding::Enum::chunked) || (header.responseCode >= 100 && header.responseCode < 200) || header.responseCode == 204 || header.responseCode == 304;
+	bool keepAlive = framed && response->isKeepAlive();
+	if(keepAlive) connection->pipelining = _maxPipelinedRequests > 1;
+
+	try
+	{
+		if(request->callback) request->callback(response, "");
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return keepAlive;
+}
+
+void AsyncHttpClient::closeConnection(PConnection connection, const std::string& error, bool retry)
+{
+	if(connection->fileDescriptor->descriptor != -1)
+	{
+		_connections.erase(connection->fileDescriptor->descriptor);
+		epoll_ctl(_epollDescriptor->descriptor, EPOLL_CTL_DEL, connection->fileDescriptor->descriptor, nullptr);
+		_bl->fileDescriptorManager.close(connection->fileDescriptor);
+	}
+	Host& host = *connection->host;
+	for(auto connectionIterator = host.connections.begin(); connectionIterator != host.connections.end(); connectionIterator++)
+	{
+		if(*connectionIterator == connection)
+		{
+			host.connections.erase(connectionIterator);
+			break;
+		}
+	}
+
+	int64_t time = HelperFunctions::getTime();
+	std::vector<PRequest> retryRequests;
+	bool first = true;
+	for(auto& request : connection->requests)
+	{
+		//Requests without any response data were either not received or ignored by the server. They are sent again once. Non-idempotent requests might have
+		//been processed anyway, so they are only sent again when none of their bytes were written.
+		bool responseStarted = first && connection->http->headerProcessingStarted();
+		bool written = request->sent || connection->sendBufferPos > request->sendBufferOffset;
+		if(retry && !responseStarted && (request->idempotent || !written) && !request->retried && time < request->deadline)
+		{
+			request->retried = true;
+			retryRequests.push_back(request);
+		}
+		else failRequest(request, error);
+		first = false;
+	}
+	connection->requests.clear();
+	host.queue.insert(host.queue.begin(), retryRequests.begin(), retryRequests.end());
+}
+
+void AsyncHttpClient::failQueuedRequests(Host& host, const std::string& error)
+{
+	while(!host.queue.empty())
+	{
+		PRequest request = host.queue.front();
+		host.queue.pop_front();
+		failRequest(request, error);
+	}
+}
+
+void AsyncHttpClient::failRequest(PRequest& request, const std::string& error)
+{
+	try
+	{
+		if(request->callback) request->callback(std::shared_ptr<Http>(), error);
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+}
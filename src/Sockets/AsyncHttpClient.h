@@ -0,0 +1,269 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * 
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef ASYNCHTTPCLIENT_H_
+#define ASYNCHTTPCLIENT_H_
+
+#include "../Exception.h"
+#include "../Managers/FileDescriptorManager.h"
+#include "../Encoding/Http.h"
+#include "HttpClient.h"
+#include "TcpSocket.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+
+namespace BaseLib
+{
+
+class SharedObjects;
+
+/**
+ * Asynchronous HTTP client. All requests are processed by a single thread using epoll, so one object can keep hundreds of requests to different hosts in
+ * flight. Connections are kept open and reused. Once a connection has returned a keep-alive response, further requests to the same host are pipelined on it.
+ * Only plain HTTP is supported. Use HttpClient for HTTPS.
+ *
+ * Example:
+ *
+ *     BaseLib::AsyncHttpClient client(bl);
+ *     client.start();
+ *     client.get("192.168.0.10", 80, "/status", [](const std::shared_ptr<BaseLib::Http>& response, const std::string& error)
+ *     {
+ *         if(!response) std::cerr << error << std::endl;
+ *         else std::cout << response->getHeader().responseCode << std::endl;
+ *     });
+ *
+ * @see HttpClient
+ */
+class AsyncHttpClient
+{
+public:
+	/**
+	 * Callback called for every request. It is called from the event loop thread and must not block.
+	 *
+	 * @param response The response or nullptr on errors.
+	 * @param error The error message. Empty on success.
+	 */
+	typedef std::function<void(const std::shared_ptr<Http>& response, const std::string& error)> ResponseCallback;
+
+	AsyncHttpClient(BaseLib::SharedObjects* baseLib);
+	virtual ~AsyncHttpClient();
+
+	/**
+	 * Sets the maximum number of simultaneous connections per host.
+	 *
+	 * @param value The number of connections. The default is 2.
+	 */
+	void setMaxConnectionsPerHost(uint32_t value) { _maxConnectionsPerHost = value == 0 ? 1 : value; }
+
+	/**
+	 * Sets the maximum number of requests sent on one connection without waiting for the responses.
+	 *
+	 * @param value The number of requests. Set to 1 to disable pipelining. The default is 8.
+	 */
+	void setMaxPipelinedRequests(uint32_t value) { _maxPipelinedRequests = value == 0 ? 1 : value; }
+
+	/**
+	 * Sets the time after which unused connections are closed.
+	 *
+	 * @param value The timeout in milliseconds. The default is 30 seconds.
+	 */
+	void setIdleTimeout(uint32_t value) { _idleTimeout = value; }
+
+	/**
+	 * Starts the event loop thread.
+	 */
+	void start();
+
+	/**
+	 * Stops the event loop thread. The callbacks of all pending requests are called with an error.
+	 */
+	void stop();
+
+	/**
+	 * Queues an HTTP request. The method returns immediately.
+	 *
+	 * @param hostname The hostname or IP address of the HTTP server. The hostname is resolved in the calling thread using the DNS cache of TcpSocket (see
+	 * TcpSocket::setDnsCacheTtl()). When a connection can't be established, the next address of the host is tried.
+	 * @param port The port of the HTTP server.
+	 * @param request The HTTP request including the full header.
+	 * @param callback Called with the response or an error.
+	 * @param timeout (Optional, default 15000) The time in milliseconds to wait for the response including the time the request is queued.
+	 * @throws HttpClientException Thrown when the hostname can't be resolved or the event loop is not running.
+	 */
+	void sendRequest(const std::string& hostname, int32_t port, const std::string& request, ResponseCallback callback, uint32_t timeout = 15000);
+
+	/**
+	 * Queues an HTTP GET request.
+	 *
+	 * @see sendRequest()
+	 */
+	void get(const std::string& hostname, int32_t port, const std::string& path, ResponseCallback callback, uint32_t timeout = 15000);
+private:
+	struct Request
+	{
+		std::string hostKey;
+		std::string data;
+		ResponseCallback callback;
+		int64_t deadline = 0;
+		bool head = false;
+
+		/**
+		 * Set for methods which can be sent again without side effects (RFC 7231 section 4.2.2).
+		 */
+		bool idempotent = false;
+		bool retried = false;
+
+		/**
+		 * Set when the request was completely written to a connection.
+		 */
+		bool sent = false;
+
+		/**
+		 * The position of the request in the send buffer of its connection.
+		 */
+		size_t sendBufferOffset = 0;
+
+		/**
+		 * The resolved addresses of the host. Only used to pass them to the event loop thread.
+		 */
+		std::vector<TcpSocket::ResolvedAddress> addresses;
+	};
+	typedef std::shared_ptr<Request> PRequest;
+
+	struct Host;
+
+	struct Connection
+	{
+		PFileDescriptor fileDescriptor;
+		Host* host = nullptr;
+		size_t addressIndex = 0;
+		std::string ipAddress;
+		bool connecting = true;
+		uint32_t events = 0;
+
+		/**
+		 * Set after the first keep-alive response. Requests are only pipelined on connections that are known to stay open.
+		 */
+		bool pipelining = false;
+		std::deque<PRequest> requests;
+		std::string sendBuffer;
+		size_t sendBufferPos = 0;
+		std::shared_ptr<Http> http;
+		int64_t lastActivity = 0;
+	};
+	typedef std::shared_ptr<Connection> PConnection;
+
+	struct Host
+	{
+		std::string hostname;
+		std::string port;
+		std::vector<TcpSocket::ResolvedAddress> addresses;
+
+		/**
+		 * The index of the address new connections are opened to. It is advanced when connecting fails.
+		 */
+		size_t addressIndex = 0;
+
+		/**
+		 * The number of addresses that failed in a row. When all addresses failed, the queued requests fail.
+		 */
+		size_t failedAddresses = 0;
+		std::deque<PRequest> queue;
+		std::vector<PConnection> connections;
+	};
+
+	BaseLib::SharedObjects* _bl = nullptr;
+	std::atomic<uint32_t> _maxConnectionsPerHost{2};
+	std::atomic<uint32_t> _maxPipelinedRequests{8};
+	std::atomic<uint32_t> _idleTimeout{30000};
+
+	std::mutex _startStopMutex;
+	std::atomic_bool _stopEventLoop{true};
+	std::thread _eventLoopThread;
+	PFileDescriptor _epollDescriptor;
+	PFileDescriptor _wakeUpDescriptor;
+
+	std::mutex _newRequestsMutex;
+	std::vector<PRequest> _newRequests;
+
+	//Only accessed by the event loop thread
+	std::unordered_map<std::string, Host> _hosts;
+	std::unordered_map<int32_t, PConnection> _connections;
+
+	void eventLoop();
+	void wakeUp();
+	void takeNewRequests();
+	void dispatchRequests();
+	void checkTimeouts();
+	void openConnection(Host& host);
+	void finishConnect(PConnection connection);
+
+	/**
+	 * Closes a connection that couldn't be established. Its requests are queued again and the next address of the host is used for new connections.
+	 *
+	 * @param connection The connection to close.
+	 * @param error The error message passed to the queued requests when none of the addresses of the host can be connected to.
+	 */
+	void connectFailed(PConnection connection, const std::string& error);
+	void setEvents(PConnection& connection, uint32_t events);
+	void writeToConnection(PConnection connection);
+	void readFromConnection(PConnection connection);
+	/**
+	 * Removes the first request of a connection and passes the finished response to its callback.
+	 *
+	 * @return Returns "false" when the connection can't be used for further requests.
+	 */
+	bool completeRequest(PConnection& connection);
+
+	/**
+	 * Closes a connection. The request which response was partly received fails, all other requests are queued again once. Requests with non-idempotent methods
+	 * like POST are only queued again when none of their bytes were written, as the server might have processed them already.
+	 *
+	 * @param connection The connection to close.
+	 * @param error The error message passed to failing requests.
+	 * @param retry Set to "false" to let all requests fail.
+	 */
+	void closeConnection(PConnection connection, const std::string& error, bool retry);
+	void failQueuedRequests(Host& host, const std::string& error);
+	void failRequest(PRequest& request, const std::string& error);
+};
+
+}
+#endif
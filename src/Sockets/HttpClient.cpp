@@ -42,6 +42,11 @@ HttpClient::HttpClient(BaseLib::SharedObjects* baseLib, std::string hostname, in
 	if(_hostname.empty()) throw HttpClientException("The provided hostname is empty.");
 	if(port > 0 && port < 65536) _port = port;
 	_keepAlive = keepAlive;
+	_useSsl = useSSL;
+	_verifyCertificate = verifyCertificate;
+	_caFile = caFile;
+	_certPath = certPath;
+	_keyPath = keyPath;
 	_socket = std::unique_ptr<BaseLib::TcpSocket>(new BaseLib::TcpSocket(_bl, hostname, std::to_string(port), useSSL, caFile, verifyCertificate, certPath, keyPath));
 	_socket->setConnectionRetries(1);
 }
@@ -53,6 +58,14 @@ HttpClient::HttpClient(BaseLib::SharedObjects* baseLib, std::string hostname, in
 	if(_hostname.empty()) throw HttpClientException("The provided hostname is empty.");
 	if(port > 0 && port < 65536) _port = port;
 	_keepAlive = keepAlive;
+	_useSsl = useSSL;
+	_verifyCertificate = verifyCertificate;
+	_caFile = caFile;
+	_caData = caData;
+	_certPath = certPath;
+	_certData = certData;
+	_keyPath = keyPath;
+	_keyData = keyData;
 	_socket = std::unique_ptr<BaseLib::TcpSocket>(new BaseLib::TcpSocket(_bl, hostname, std::to_string(port), useSSL, verifyCertificate, caFile, caData, certPath, certData, keyPath, keyData));
 	_socket->setConnectionRetries(1);
 }
@@ -70,10 +83,31 @@ HttpClient::~HttpClient()
 void HttpClient::setTimeout(uint32_t value)
 {
 	if(value == 0) value = 1000;
+	_timeout = value;
+	std::lock_guard<std::mutex> socketGuard(_socketMutex);
 	_socket->setReadTimeout((int64_t)value * 1000);
 	_socket->setWriteTimeout((int64_t)value * 1000);
 }
 
+void HttpClient::enableConnectionPool(bool value)
+{
+	if(value && _poolKey.empty())
+	{
+		//The key needs to differ for every setting that results in a different connection.
+		std::hash<std::string> stringHash;
+		_poolKey = _hostname + ":" + std::to_string(_port) + ":" + (_useSsl ? "1" : "0") + ":" + (_verifyCertificate ? "1" : "0");
+		if(_useSsl) _poolKey += ":" + std::to_string(stringHash(_caFile + '\0' + _caData + '\0' + _certPath + '\0' + _certData + '\0' + _keyPath + '\0' + _keyData));
+	}
+	_useConnectionPool = value;
+}
+
+std::shared_ptr<TcpSocket> HttpClient::createSocket()
+{
+	std::shared_ptr<TcpSocket> socket = std::make_shared<TcpSocket>(_bl, _hostname, std::to_string(_port), _useSsl, _verifyCertificate, _caFile, _caData, _certPath, _certData, _keyPath, _keyData);
+	socket->setConnectionRetries(1);
+	return socket;
+}
+
 void HttpClient::get(const std::string& path, std::string& data)
 {
 	std::string fixedPath = path;
@@ -127,160 +161,161 @@ void HttpClient::sendRequest(const std::string& request, Http& http, bool respon
 	_rawContent.clear();
 	if(request.empty()) throw HttpClientException("Request is empty.");
 
-	_socketMutex.lock();
-	try
+	if(_useConnectionPool)
 	{
+		std::shared_ptr<TcpSocket> socket = _bl->httpConnectionPool.get(_poolKey, std::bind(&HttpClient::createSocket, this), _timeout);
+		socket->setReadTimeout((int64_t)_timeout * 1000);
+		socket->setWriteTimeout((int64_t)_timeout * 1000);
+		bool reuse = false;
 		try
 		{
-			if(!_socket->connected()) _socket->open();
+			reuse = sendRequest(*socket, request, http, responseIsHeaderOnly) && _keepAlive && !responseIsHeaderOnly && http.isKeepAlive();
 		}
-		catch(const BaseLib::SocketOperationException& ex)
+		catch(...)
 		{
-			_socketMutex.unlock();
-			throw HttpClientException("Unable to connect to HTTP server \"" + _hostname + "\": " + ex.what());
+			_bl->httpConnectionPool.put(_poolKey, socket, false);
+			throw;
 		}
-
+		_bl->httpConnectionPool.put(_poolKey, socket, reuse);
+	}
+	else
+	{
+		std::lock_guard<std::mutex> socketGuard(_socketMutex);
 		try
 		{
-			if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: Sending packet to HTTP server \"" + _hostname + "\": " + request);
-			_socket->proofwrite(request);
-		}
-		catch(BaseLib::SocketDataLimitException& ex)
-		{
-			if(!_keepAlive) _socket->close();
-			_socketMutex.unlock();
-			throw HttpClientException("Unable to write to HTTP server \"" + _hostname + "\": " + ex.what());
+			sendRequest(*_socket, request, http, responseIsHeaderOnly);
 		}
-		catch(const BaseLib::SocketOperationException& ex)
+		catch(...)
 		{
 			if(!_keepAlive) _socket->close();
-			_socketMutex.unlock();
-			throw HttpClientException("Unable to write to HTTP server \"" + _hostname + "\": " + ex.what());
+			throw;
 		}
+		if(!_keepAlive) _socket->close();
+	}
+}
 
-		ssize_t receivedBytes;
+bool HttpClient::sendRequest(TcpSocket& socket, const std::string& request, Http& http, bool responseIsHeaderOnly)
+{
+	try
+	{
+		if(!socket.connected()) socket.open();
+	}
+	catch(const BaseLib::SocketOperationException& ex)
+	{
+		throw HttpClientException("Unable to connect to HTTP server \"" + _hostname + "\": " + ex.what());
+	}
 
-		int32_t bufferPos = 0;
-		int32_t bufferMax = 4096;
-		char buffer[bufferMax + 1];
+	try
+	{
+		if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: Sending packet to HTTP server \"" + _hostname + "\": " + request);
+		socket.proofwrite(request);
+	}
+	catch(BaseLib::SocketDataLimitException& ex)
+	{
+		throw HttpClientException("Unable to write to HTTP server \"" + _hostname + "\": " + ex.what());
+	}
+	catch(const BaseLib::SocketOperationException& ex)
+	{
+		throw HttpClientException("Unable to write to HTTP server \"" + _hostname + "\": " + ex.what());
+	}
 
-		std::this_thread::sleep_for(std::chrono::milliseconds(5)); //Some servers need a little, before the socket can be read.
+	bool connectionClosed = false;
+	ssize_t receivedBytes;
 
-		bool firstLoop = true;
-		while(true)
-		{
-			if(!firstLoop && !_socket->connected())
-			{
-				if(http.getContentSize() == 0)
-				{
-					_socketMutex.unlock();
-					throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\": Connection closed.");
-				}
-				else
-				{
-					http.setFinished();
-					break;
-				}
-			}
-			firstLoop = false;
+	int32_t bufferPos = 0;
+	int32_t bufferMax = 4096;
+	char buffer[bufferMax + 1];
 
-			try
-			{
-				if(bufferPos > bufferMax - 1)
-				{
-					throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\" (1): Buffer overflow.");
-					bufferPos = 0;
-				}
-				receivedBytes = _socket->proofread(buffer + bufferPos, bufferMax - bufferPos);
+	std::this_thread::sleep_for(std::chrono::milliseconds(5)); //Some servers need a little, before the socket can be read.
 
-				//Some clients send only one byte in the first packet
-				if(receivedBytes == 1 && bufferPos == 0 && !http.headerIsFinished()) receivedBytes += _socket->proofread(buffer + bufferPos + 1, bufferMax - bufferPos - 1);
-			}
-			catch(const BaseLib::SocketTimeOutException& ex)
+	bool firstLoop = true;
+	while(true)
+	{
+		if(!firstLoop && !socket.connected())
+		{
+			if(http.getContentSize() == 0)
 			{
-				if(!_keepAlive) _socket->close();
-				_socketMutex.unlock();
-				throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\" (1): " + ex.what());
+				throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\": Connection closed.");
 			}
-			catch(const BaseLib::SocketClosedException& ex)
+			else
 			{
+				connectionClosed = true;
 				http.setFinished();
 				break;
 			}
-			catch(const BaseLib::SocketOperationException& ex)
-			{
-				if(!_keepAlive) _socket->close();
-				_socketMutex.unlock();
-				throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\" (3): " + ex.what());
-			}
-			if(bufferPos + receivedBytes > bufferMax)
-			{
-				if(!_keepAlive) _socket->close();
-				_socketMutex.unlock();
-				throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\" (2): Buffer overflow.");
-			}
+		}
+		firstLoop = false;
 
-			if(_keepRawContent)
+		try
+		{
+			if(bufferPos > bufferMax - 1)
 			{
-				if(_rawContent.size() + receivedBytes > _rawContent.capacity()) _rawContent.reserve(_rawContent.capacity() + 4096);
-				_rawContent.insert(_rawContent.end(), buffer, buffer + receivedBytes);
+				throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\" (1): Buffer overflow.");
+				bufferPos = 0;
 			}
+			receivedBytes = socket.proofread(buffer + bufferPos, bufferMax - bufferPos);
 
-			//We are using string functions to process the buffer. So just to make sure,
-			//they don't do something in the memory after buffer, we add '\0'
-			buffer[bufferPos + receivedBytes] = '\0';
+			//Some clients send only one byte in the first packet
+			if(receivedBytes == 1 && bufferPos == 0 && !http.headerIsFinished()) receivedBytes += socket.proofread(buffer + bufferPos + 1, bufferMax - bufferPos - 1);
+		}
+		catch(const BaseLib::SocketTimeOutException& ex)
+		{
+			throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\" (1): " + ex.what());
+		}
+		catch(const BaseLib::SocketClosedException& ex)
+		{
+			connectionClosed = true;
+			http.setFinished();
+			break;
+		}
+		catch(const BaseLib::SocketOperationException& ex)
+		{
+			throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\" (3): " + ex.what());
+		}
+		if(bufferPos + receivedBytes > bufferMax)
+		{
+			throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\" (2): Buffer overflow.");
+		}
 
-			if(!http.headerIsFinished() && (!strncmp(buffer, "401", 3) || !strncmp(&buffer[9], "401", 3))) //"401 Unauthorized" or "HTTP/1.X 401 Unauthorized"
-			{
-				_socketMutex.unlock();
-				throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\": Server requires authentication.", 401);
-			}
-			receivedBytes = bufferPos + receivedBytes;
-			bufferPos = 0;
+		if(_keepRawContent)
+		{
+			if(_rawContent.size() + receivedBytes > _rawContent.capacity()) _rawContent.reserve(_rawContent.capacity() + 4096);
+			_rawContent.insert(_rawContent.end(), buffer, buffer + receivedBytes);
+		}
 
-			try
-			{
-				if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: Received packet from HTTP server \"" + _hostname + "\": " + std::string(buffer, receivedBytes));
-				http.process(buffer, receivedBytes);
-				if(http.headerIsFinished() && responseIsHeaderOnly)
-				{
-					http.setFinished();
-					break;
-				}
-			}
-			catch(HttpException& ex)
-			{
-				if(!_keepAlive) _socket->close();
-				_socketMutex.unlock();
-				throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\": " + ex.what(), ex.responseCode());
-			}
-			if(http.getContentSize() > 104857600 || http.getHeader().contentLength > 104857600)
+		//We are using string functions to process the buffer. So just to make sure,
+		//they don't do something in the memory after buffer, we add '\0'
+		buffer[bufferPos + receivedBytes] = '\0';
+
+		if(!http.headerIsFinished() && (!strncmp(buffer, "401", 3) || !strncmp(&buffer[9], "401", 3))) //"401 Unauthorized" or "HTTP/1.X 401 Unauthorized"
+		{
+			throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\": Server requires authentication.", 401);
+		}
+		receivedBytes = bufferPos + receivedBytes;
+		bufferPos = 0;
+
+		try
+		{
+			if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: Received packet from HTTP server \"" + _hostname + "\": " + std::string(buffer, receivedBytes));
+			http.process(buffer, receivedBytes);
+			if(http.headerIsFinished() && responseIsHeaderOnly)
 			{
-				if(!_keepAlive) _socket->close();
-				_socketMutex.unlock();
-				throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\": Packet with data larger than 100 MiB received.");
+				http.setFinished();
+				break;
 			}
-
-			if(http.isFinished()) break;
 		}
-		if(!_keepAlive) _socket->close();
-		_socketMutex.unlock();
+		catch(HttpException& ex)
+		{
+			throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\": " + ex.what(), ex.responseCode());
+		}
+		if(http.getContentSize() > 104857600 || http.getHeader().contentLength > 104857600)
+		{
+			throw HttpClientException("Unable to read from HTTP server \"" + _hostname + "\": Packet with data larger than 100 MiB received.");
+		}
+
+		if(http.isFinished()) break;
 	}
-    catch(const std::exception& ex)
-    {
-    	_socketMutex.unlock();
-    	throw ex;
-    }
-    catch(BaseLib::Exception& ex)
-    {
-    	_socketMutex.unlock();
-    	throw ex;
-    }
-    catch(...)
-    {
-    	_socketMutex.unlock();
-    	throw Exception("Unknown exception.");
-    }
+	return !connectionClosed;
 }
 
 }
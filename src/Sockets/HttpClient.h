@@ -35,6 +35,7 @@
 #include "../Managers/FileDescriptorManager.h"
 #include "../Encoding/Http.h"
 #include "TcpSocket.h"
+#include "HttpConnectionPool.h"
 
 namespace BaseLib
 {
@@ -106,6 +107,15 @@ public:
 	 */
 	void setTimeout(uint32_t value);
 
+	/**
+	 * Enables borrowing connections from the connection pool shared by all HttpClient objects (SharedObjects::httpConnectionPool) instead of using the
+	 * client's own socket. This allows concurrent requests from multiple threads and reuses keep-alive connections across HttpClient objects with the same
+	 * host, port and TLS settings. Connections are only returned to the pool when "keepAlive" is set and the server doesn't close the connection.
+	 *
+	 * @param value Set to "true" to enable.
+	 */
+	void enableConnectionPool(bool value);
+
 	/**
 	 * Returns "true" if the socket is connected, otherwise "false".
 	 * @return "true" if the socket is connected, otherwise "false".
@@ -113,7 +123,7 @@ public:
 	bool connected() { return _socket && _socket->connected(); }
 
 	/**
-	 * Closes the socket.
+	 * Closes the socket. Pooled connections are not affected.
 	 */
 	void disconnect() { if(_socket) _socket->close(); }
 
@@ -226,6 +236,49 @@ protected:
 	 * Stores the raw response
 	 */
 	std::vector<char> _rawContent;
+
+	/**
+	 * The socket timeout in milliseconds.
+	 */
+	uint32_t _timeout = 15000;
+
+	/**
+	 * The TLS settings needed to create pooled sockets.
+	 */
+	bool _useSsl = false;
+	bool _verifyCertificate = true;
+	std::string _caFile;
+	std::string _caData;
+	std::string _certPath;
+	std::string _certData;
+	std::string _keyPath;
+	std::string _keyData;
+
+	/**
+	 * When true, connections are borrowed from SharedObjects::httpConnectionPool.
+	 */
+	bool _useConnectionPool = false;
+
+	/**
+	 * The key of this client's connections in the connection pool.
+	 */
+	std::string _poolKey;
+
+	/**
+	 * Creates a new socket for the connection pool.
+	 */
+	std::shared_ptr<TcpSocket> createSocket();
+
+	/**
+	 * Sends a request over the given socket and reads the response.
+	 *
+	 * @param socket The socket to use. It is opened if necessary.
+	 * @param request The HTTP request including the full header.
+	 * @param[out] http The HTTP response.
+	 * @param responseIsHeaderOnly Set to "true" to stop reading after the header.
+	 * @return Returns "false" when the connection was closed by the server.
+	 */
+	bool sendRequest(TcpSocket& socket, const std::string& request, Http& http, bool responseIsHeaderOnly);
 };
 
 }
@@ -0,0 +1,191 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * 
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "HttpConnectionPool.h"
+#include "../BaseLib.h"
+
+namespace BaseLib
+{
+
+HttpConnectionPool::HttpConnectionPool()
+{
+}
+
+HttpConnectionPool::~HttpConnectionPool()
+{
+	clear();
+}
+
+void HttpConnectionPool::init(BaseLib::SharedObjects* baseLib)
+{
+	_bl = baseLib;
+}
+
+void HttpConnectionPool::setMaxConnectionsPerHost(uint32_t value)
+{
+	std::lock_guard<std::mutex> hostsGuard(_hostsMutex);
+	_maxConnectionsPerHost = value == 0 ? 1 : value;
+}
+
+void HttpConnectionPool::setIdleTimeout(uint32_t value)
+{
+	std::lock_guard<std::mutex> hostsGuard(_hostsMutex);
+	_idleTimeout = value;
+}
+
+std::shared_ptr<TcpSocket> HttpConnectionPool::get(const std::string& key, std::function<std::shared_ptr<TcpSocket>()> factory, uint32_t timeout)
+{
+	std::vector<std::shared_ptr<TcpSocket>> connectionsToClose;
+	std::shared_ptr<TcpSocket> socket;
+	{
+		std::unique_lock<std::mutex> hostsGuard(_hostsMutex);
+		evictIdleConnections(connectionsToClose);
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+		while(true)
+		{
+			//Looked up again after every wait, because the lock is released while waiting and unused hosts are removed by evictIdleConnections().
+			Host& host = _hosts[key];
+
+			//Health check: Skip connections closed by the server or with unexpected data.
+			while(!host.idleConnections.empty())
+			{
+				std::shared_ptr<TcpSocket> idleSocket = host.idleConnections.back().socket;
+				host.idleConnections.pop_back();
+				if(idleSocket->isReusable())
+				{
+					socket = idleSocket;
+					break;
+				}
+				host.connections--;
+				connectionsToClose.push_back(idleSocket);
+			}
+			if(socket) break;
+			if(host.connections < _maxConnectionsPerHost)
+			{
+				host.connections++;
+				break;
+			}
+			if(_connectionReturned.wait_until(hostsGuard, deadline) == std::cv_status::timeout && _hosts[key].idleConnections.empty() && _hosts[key].connections >= _maxConnectionsPerHost)
+			{
+				hostsGuard.unlock();
+				for(auto& connection : connectionsToClose) connection->close();
+				throw HttpConnectionPoolException("No connection to \"" + key + "\" became available in time.");
+			}
+		}
+	}
+
+	for(auto& connection : connectionsToClose) connection->close();
+	if(socket) return socket;
+
+	try
+	{
+		socket = factory();
+		if(!socket) throw HttpConnectionPoolException("Could not create socket.");
+	}
+	catch(...)
+	{
+		std::lock_guard<std::mutex> hostsGuard(_hostsMutex);
+		_hosts[key].connections--;
+		_connectionReturned.notify_all();
+		throw;
+	}
+	return socket;
+}
+
+void HttpConnectionPool::put(const std::string& key, std::shared_ptr<TcpSocket>& socket, bool reuse)
+{
+	if(!socket) return;
+	std::vector<std::shared_ptr<TcpSocket>> connectionsToClose;
+	{
+		std::lock_guard<std::mutex> hostsGuard(_hostsMutex);
+		Host& host = _hosts[key];
+		if(reuse && socket->connected())
+		{
+			IdleConnection idleConnection;
+			idleConnection.socket = socket;
+			idleConnection.lastUsed = HelperFunctions::getTime();
+			host.idleConnections.push_back(idleConnection);
+		}
+		else
+		{
+			if(host.connections > 0) host.connections--;
+			connectionsToClose.push_back(socket);
+		}
+		evictIdleConnections(connectionsToClose);
+	}
+	_connectionReturned.notify_all();
+	socket.reset();
+	for(auto& connection : connectionsToClose) connection->close();
+}
+
+void HttpConnectionPool::clear()
+{
+	std::vector<std::shared_ptr<TcpSocket>> connectionsToClose;
+	{
+		std::lock_guard<std::mutex> hostsGuard(_hostsMutex);
+		for(auto& host : _hosts)
+		{
+			for(auto& idleConnection : host.second.idleConnections)
+			{
+				connectionsToClose.push_back(idleConnection.socket);
+			}
+			host.second.connections -= host.second.idleConnections.size();
+			host.second.idleConnections.clear();
+		}
+	}
+	_connectionReturned.notify_all();
+	for(auto& connection : connectionsToClose) connection->close();
+}
+
+void HttpConnectionPool::evictIdleConnections(std::vector<std::shared_ptr<TcpSocket>>& connectionsToClose)
+{
+	int64_t time = HelperFunctions::getTime();
+	if(time - _lastEviction < 1000) return;
+	_lastEviction = time;
+
+	for(auto hostIterator = _hosts.begin(); hostIterator != _hosts.end();)
+	{
+		Host& host = hostIterator->second;
+		//The connections are ordered by the time of last use, so only the front needs to be checked.
+		auto idleConnectionIterator = host.idleConnections.begin();
+		while(idleConnectionIterator != host.idleConnections.end() && time - idleConnectionIterator->lastUsed >= _idleTimeout)
+		{
+			connectionsToClose.push_back(idleConnectionIterator->socket);
+			host.connections--;
+			idleConnectionIterator++;
+		}
+		host.idleConnections.erase(host.idleConnections.begin(), idleConnectionIterator);
+
+		if(host.connections == 0 && host.idleConnections.empty()) hostIterator = _hosts.erase(hostIterator);
+		else hostIterator++;
+	}
+}
+
+}
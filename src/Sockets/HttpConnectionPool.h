@@ -0,0 +1,148 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * 
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef HTTPCONNECTIONPOOL_H_
+#define HTTPCONNECTIONPOOL_H_
+
+#include "../Exception.h"
+#include "TcpSocket.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace BaseLib
+{
+
+class SharedObjects;
+
+/**
+ * Exception class for the HTTP connection pool.
+ *
+ * @see HttpConnectionPool
+ */
+class HttpConnectionPoolException : public Exception
+{
+public:
+	HttpConnectionPoolException(std::string message) : Exception(message) {}
+};
+
+/**
+ * Thread safe pool of persistent HTTP client connections shared by all HttpClient objects. Connections are grouped by a key describing host, port and TLS
+ * settings. Idle connections are checked before they are handed out and closed after the idle timeout. The number of connections per key is limited.
+ *
+ * @see HttpClient::enableConnectionPool()
+ */
+class HttpConnectionPool
+{
+public:
+	HttpConnectionPool();
+	virtual ~HttpConnectionPool();
+
+	void init(BaseLib::SharedObjects* baseLib);
+
+	/**
+	 * Sets the maximum number of connections per key including the connections in use.
+	 *
+	 * @param value The maximum number of connections. The default is 6.
+	 */
+	void setMaxConnectionsPerHost(uint32_t value);
+
+	/**
+	 * Sets the time after which unused connections are closed.
+	 *
+	 * @param value The timeout in milliseconds. The default is 30 seconds.
+	 */
+	void setIdleTimeout(uint32_t value);
+
+	/**
+	 * Borrows a connection. The most recently used idle connection is returned when there is one, otherwise a new socket is created using "factory". The
+	 * returned socket needs to be returned with put().
+	 *
+	 * @param key The key identifying host, port and TLS settings.
+	 * @param factory Creates a new socket when no idle connection is available. The socket doesn't need to be connected.
+	 * @param timeout The time in milliseconds to wait for a connection when the maximum number of connections is in use.
+	 * @return The socket.
+	 * @throws HttpConnectionPoolException Thrown when no connection became available within "timeout".
+	 */
+	std::shared_ptr<TcpSocket> get(const std::string& key, std::function<std::shared_ptr<TcpSocket>()> factory, uint32_t timeout);
+
+	/**
+	 * Returns a connection borrowed with get().
+	 *
+	 * @param key The key passed to get().
+	 * @param socket The socket returned by get(). It is reset by this method.
+	 * @param reuse Set to "false" when the connection can't be used for further requests (e. g. on errors or "Connection: close"). It is closed then.
+	 */
+	void put(const std::string& key, std::shared_ptr<TcpSocket>& socket, bool reuse);
+
+	/**
+	 * Closes all idle connections.
+	 */
+	void clear();
+private:
+	struct IdleConnection
+	{
+		std::shared_ptr<TcpSocket> socket;
+		int64_t lastUsed = 0;
+	};
+
+	struct Host
+	{
+		uint32_t connections = 0;
+
+		/**
+		 * Idle connections ordered by the time of last use. The most recently used connection is at the back.
+		 */
+		std::vector<IdleConnection> idleConnections;
+	};
+
+	BaseLib::SharedObjects* _bl = nullptr;
+	uint32_t _maxConnectionsPerHost = 6;
+	int64_t _idleTimeout = 30000;
+	std::mutex _hostsMutex;
+	std::condition_variable _connectionReturned;
+	std::unordered_map<std::string, Host> _hosts;
+	int64_t _lastEviction = 0;
+
+	/**
+	 * Removes idle connections older than the idle timeout. The caller needs to lock _hostsMutex. Closing is done by the caller outside of the lock.
+	 *
+	 * @param[out] connectionsToClose The removed connections.
+	 */
+	void evictIdleConnections(std::vector<std::shared_ptr<TcpSocket>>& connectionsToClose);
+};
+
+}
+#endif
@@ -31,6 +31,8 @@
 #include "../BaseLib.h"
 #include "HttpServer.h"
 
+#include <sys/mman.h>
+
 namespace BaseLib
 {
 
@@ -46,14 +48,33 @@ HttpServer::HttpServer(BaseLib::SharedObjects* baseLib, HttpServerInfo& serverIn
 	tcpServerInfo.dhParamFile = serverInfo.dhParamFile;
 	tcpServerInfo.dhParamData = serverInfo.dhParamData;
 	tcpServerInfo.requireClientCert = serverInfo.requireClientCert;
+	tcpServerInfo.connectionIdleTimeout = serverInfo.keepAliveTimeout;
+	tcpServerInfo.tlsHandshakeTimeout = serverInfo.tlsHandshakeTimeout;
+	tcpServerInfo.useSendQueue = serverInfo.useSendQueue;
+	tcpServerInfo.sendQueueHighWatermark = serverInfo.sendQueueHighWatermark;
+	tcpServerInfo.sendQueueLowWatermark = serverInfo.sendQueueLowWatermark;
+	tcpServerInfo.slowClientPolicy = serverInfo.slowClientPolicy;
+	tcpServerInfo.sendQueueStallTimeout = serverInfo.sendQueueStallTimeout;
+	tcpServerInfo.unixPeerCredentialsCallback.swap(serverInfo.unixPeerCredentialsCallback);
     tcpServerInfo.newConnectionCallback = std::bind(&HttpServer::newConnection, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3);
     tcpServerInfo.connectionClosedCallback = std::bind(&HttpServer::connectionClosed, this, std::placeholders::_1);
-	tcpServerInfo.packetReceivedCallback = std::bind(&HttpServer::packetReceived, this, std::placeholders::_1, std::placeholders::_2);
+	tcpServerInfo.packetViewReceivedCallback = std::bind(&HttpServer::packetReceived, this, std::placeholders::_1, std::placeholders::_2);
 
     _newConnectionCallback.swap(serverInfo.newConnectionCallback);
     _connectionClosedCallback.swap(serverInfo.connectionClosedCallback);
 	_packetReceivedCallback.swap(serverInfo.packetReceivedCallback);
 
+	_keepAlive = serverInfo.keepAlive;
+	_useSsl = serverInfo.useSsl;
+	_contentPath = serverInfo.contentPath;
+	while(!_contentPath.empty() && _contentPath.back() == '/') _contentPath.pop_back();
+	_formDataDirectory = serverInfo.formDataDirectory;
+	_maxUploadSize = serverInfo.maxUploadSize;
+	_compressionThreshold = serverInfo.compressionThreshold;
+	_compressedFiles.setMaxSize(serverInfo.compressionCacheSize);
+	_maxPipelinedRequests = serverInfo.maxPipelinedRequests;
+	if(_maxPipelinedRequests == 0) _maxPipelinedRequests = 1;
+
 	_socket = std::make_shared<TcpSocket>(baseLib, tcpServerInfo);
 }
 
@@ -62,6 +83,11 @@ HttpServer::~HttpServer()
 	stop();
 }
 
+HttpServer::MappedFile::~MappedFile()
+{
+	if(data) munmap(data, size);
+}
+
 void HttpServer::start(std::string address, std::string port, std::string& listenAddress)
 {
 	_socket->startServer(address, port, listenAddress);
@@ -77,16 +103,27 @@ void HttpServer::waitForStop()
 	_socket->waitForServerStopped();
 }
 
+PVariable HttpServer::getMetrics(bool includeClients)
+{
+	PVariable metrics = _socket->getMetrics(includeClients);
+	metrics->structValue->emplace("requests", std::make_shared<Variable>(_requests.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("badRequests", std::make_shared<Variable>(_badRequests.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("responseTime", _responseTime.toVariable());
+	return metrics;
+}
+
 void HttpServer::newConnection(int32_t clientId, std::string address, uint16_t port)
 {
 	try
 	{
-		HttpClientInfo clientInfo;
-		clientInfo.http = std::make_shared<BaseLib::Http>();
+		PHttpClientInfo clientInfo = std::make_shared<HttpClientInfo>();
+		clientInfo->http = std::make_shared<BaseLib::Http>();
+		clientInfo->http->setFormDataDirectory(_formDataDirectory);
+		clientInfo->http->setMaxContentSize(_maxUploadSize);
 
         {
             std::lock_guard<std::mutex> httpClientInfoGuard(_httpClientInfoMutex);
-            _httpClientInfo[clientId] = std::move(clientInfo);
+            _httpClientInfo[clientId] = clientInfo;
         }
 
         if(_newConnectionCallback) _newConnectionCallback(clientId, address, port);
@@ -128,25 +165,750 @@ void HttpServer::connectionClosed(int32_t clientId)
 	}
 }
 
-void HttpServer::packetReceived(int32_t clientId, TcpSocket::TcpPacket packet)
+void HttpServer::packetReceived(int32_t clientId, const TcpSocket::TcpPacketView& packet)
 {
-	std::shared_ptr<BaseLib::Http> http;
+	PHttpClientInfo clientInfo;
 	try
 	{
+		clientInfo = getClientInfo(clientId);
+		if(!clientInfo) return;
+
 		{
-			std::lock_guard<std::mutex> httpClientInfoGuard(_httpClientInfoMutex);
-			auto clientIterator = _httpClientInfo.find(clientId);
-			if(clientIterator == _httpClientInfo.end()) return;
-			http = clientIterator->second.http;
+			std::lock_guard<std::mutex> clientInfoGuard(clientInfo->mutex);
+			//"400 Bad Request" is sent after the outstanding responses. Data received until then is discarded.
+			if(clientInfo->badRequest) return;
+			char* buffer = (char*)packet.data;
+			int32_t bufferLength = packet.size;
+			//The packet might contain more than one request when the client pipelines requests.
+			while(bufferLength > 0)
+			{
+				int32_t processedBytes = clientInfo->http->process(buffer, bufferLength);
+				if(!clientInfo->http->isFinished()) break;
+				if(clientInfo->requests.size() >= _maxPipelinedRequests) throw HttpServerException("Client " + std::to_string(clientId) + " exceeded the maximum number of pipelined requests.");
+
+				clientInfo->requests.push_back(clientInfo->http);
+				SocketMetrics::increment(_requests);
+				if(clientInfo->unusedHttp.empty())
+				{
+					clientInfo->http = std::make_shared<BaseLib::Http>();
+					clientInfo->http->setFormDataDirectory(_formDataDirectory);
+					clientInfo->http->setMaxContentSize(_maxUploadSize);
+				}
+				else
+				{
+					clientInfo->http = clientInfo->unusedHttp.back();
+					clientInfo->unusedHttp.pop_back();
+				}
+
+				if(processedBytes <= 0) break;
+				buffer += processedBytes;
+				bufferLength -= processedBytes;
+			}
 		}
 
-		http->process((char*)packet.data(), packet.size());
-		if(http->isFinished())
+		processRequests(clientId, clientInfo);
+		return;
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+
+	//The start of the next request can't be found anymore, so the connection can't be reused. Requests received before are answered first to keep the
+	//order of the responses.
+	if(clientInfo)
+	{
+		std::unique_lock<std::mutex> clientInfoGuard(clientInfo->mutex);
+		clientInfo->http->reset();
+		if(!clientInfo->requests.empty())
 		{
-			if(_packetReceivedCallback) _packetReceivedCallback(clientId, *http);
-			http->reset();
+			clientInfo->badRequest = true;
+			clientInfoGuard.unlock();
+			processRequests(clientId, clientInfo);
+			return;
 		}
-		return;
+	}
+	sendError(clientId, 400, "Bad Request");
+}
+
+void HttpServer::sendError(int32_t clientId, int32_t code, const std::string& codeDescription)
+{
+	try
+	{
+		if(code == 400) SocketMetrics::increment(_badRequests);
+		std::string header;
+		std::vector<std::string> additionalHeaders;
+		Http::constructHeader(0, "", code, codeDescription, additionalHeaders, header);
+		_socket->sendToClient(clientId, TcpSocket::TcpPacket(header.begin(), header.end()), true);
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void HttpServer::processRequests(int32_t clientId, PHttpClientInfo& clientInfo)
+{
+	try
+	{
+		while(true)
+		{
+			std::shared_ptr<BaseLib::Http> request;
+			{
+				std::lock_guard<std::mutex> clientInfoGuard(clientInfo->mutex);
+				if(clientInfo->requestInProgress || clientInfo->dispatching || clientInfo->requests.empty()) return;
+				request = clientInfo->requests.front();
+				clientInfo->requestInProgress = true;
+				clientInfo->dispatching = true;
+				clientInfo->requestStartTime = HelperFunctions::getTimeMicroseconds();
+			}
+
+			bool callbackFailed = true;
+			try
+			{
+				if(_packetReceivedCallback) _packetReceivedCallback(clientId, *request);
+				callbackFailed = false;
+			}
+			catch(const std::exception& ex)
+			{
+				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+			}
+			catch(BaseLib::Exception& ex)
+			{
+				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+			}
+			catch(...)
+			{
+				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+			}
+
+			{
+				std::unique_lock<std::mutex> clientInfoGuard(clientInfo->mutex);
+				clientInfo->dispatching = false;
+				if(callbackFailed && clientInfo->requestInProgress)
+				{
+					//The request won't be answered. The queued requests are discarded as the connection is closed. Late responses are dropped by send().
+					clientInfo->requests.clear();
+					clientInfo->requestInProgress = false;
+					clientInfo->badRequest = false;
+					clientInfoGuard.unlock();
+					sendError(clientId, 500, "Internal Server Error");
+					return;
+				}
+				if(clientInfo->requestInProgress) return; //The response is sent asynchronously, send() continues with the next request.
+
+				//The callback doesn't use the request anymore, so the object can be reused.
+				request->reset();
+				if(clientInfo->unusedHttp.size() < 2) clientInfo->unusedHttp.push_back(request);
+			}
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+HttpServer::PHttpClientInfo HttpServer::getClientInfo(int32_t clientId)
+{
+	std::lock_guard<std::mutex> httpClientInfoGuard(_httpClientInfoMutex);
+	auto clientIterator = _httpClientInfo.find(clientId);
+	if(clientIterator == _httpClientInfo.end()) return PHttpClientInfo();
+	return clientIterator->second;
+}
+
+bool HttpServer::finishRequest(int32_t clientId, PHttpClientInfo& clientInfo, bool& closeConnection, bool& processNextRequest, bool& badRequestPending)
+{
+	clientInfo = getClientInfo(clientId);
+	processNextRequest = false;
+	badRequestPending = false;
+
+	if(!_keepAlive) closeConnection = true;
+	if(!clientInfo) return true;
+
+	std::lock_guard<std::mutex> clientInfoGuard(clientInfo->mutex);
+	if(!clientInfo->requestInProgress || clientInfo->requests.empty()) return false;
+	if(!clientInfo->requests.front()->isKeepAlive() || clientInfo->closeAfterResponse) closeConnection = true;
+	clientInfo->closeAfterResponse = false;
+	clientInfo->requests.pop_front();
+	clientInfo->requestInProgress = false;
+	_responseTime.record(HelperFunctions::getTimeMicroseconds() - clientInfo->requestStartTime);
+	if(closeConnection) return true;
+	badRequestPending = clientInfo->badRequest && clientInfo->requests.empty();
+	processNextRequest = !clientInfo->dispatching && !clientInfo->requests.empty();
+	return true;
+}
+
+bool HttpServer::closesConnection(const TcpSocket::TcpPacket& packet)
+{
+	if(packet.size() < 5 || strncmp((const char*)packet.data(), "HTTP/", 5) != 0) return false;
+	const char* data = (const char*)packet.data();
+	size_t searchSize = packet.size() > 8192 ? 8192 : packet.size();
+	const char* headerEnd = (const char*)memmem(data, searchSize, "\r\n\r\n", 4);
+	std::string header(data, headerEnd ? headerEnd - data : searchSize);
+	HelperFunctions::toLower(header);
+	std::string::size_type pos = header.find("\r\nconnection:");
+	if(pos == std::string::npos) return false;
+	std::string::size_type lineEnd = header.find("\r\n", pos + 2);
+	return header.substr(pos, lineEnd == std::string::npos ? std::string::npos : lineEnd - pos).find("close") != std::string::npos;
+}
+
+void HttpServer::send(int32_t clientId, TcpSocket::TcpPacket packet, bool closeConnection, bool lastPacket)
+{
+	try
+	{
+		if(!closeConnection && closesConnection(packet)) closeConnection = true;
+
+		if(!lastPacket)
+		{
+			PHttpClientInfo clientInfo = getClientInfo(clientId);
+			if(!clientInfo) return;
+			{
+				std::lock_guard<std::mutex> clientInfoGuard(clientInfo->mutex);
+				if(!clientInfo->requestInProgress)
+				{
+					_bl->out.printWarning("Warning: Dropping response to client " + std::to_string(clientId) + ", because no request is in progress.");
+					return;
+				}
+				if(closeConnection) clientInfo->closeAfterResponse = true;
+			}
+			_socket->sendToClient(clientId, packet, false);
+			return;
+		}
+
+		PHttpClientInfo clientInfo;
+		bool processNextRequest = false;
+		bool badRequestPending = false;
+		if(!finishRequest(clientId, clientInfo, closeConnection, processNextRequest, badRequestPending))
+		{
+			_bl->out.printWarning("Warning: Dropping response to client " + std::to_string(clientId) + ", because no request is in progress. Set \"lastPacket\" to false when sending a response in multiple parts.");
+			return;
+		}
+
+		_socket->sendToClient(clientId, packet, closeConnection);
+
+		if(badRequestPending) sendError(clientId, 400, "Bad Request");
+		else if(processNextRequest) processRequests(clientId, clientInfo);
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+bool HttpServer::serveStaticFile(int32_t clientId, Http& http)
+{
+	int32_t fileDescriptor = -1;
+	try
+	{
+		if(_contentPath.empty()) return false;
+		Http::Header& requestHeader = http.getHeader();
+		bool headRequest = requestHeader.method == "HEAD";
+		if(requestHeader.method != "GET" && !headRequest) return false;
+
+		std::string path = requestHeader.path;
+		if(path.empty() || path.front() != '/' || path.find("/..") != std::string::npos) return false;
+		if(path.back() == '/') path.append("index.html");
+		std::string filename = _contentPath + path;
+
+		fileDescriptor = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fileDescriptor == -1) return false;
+		struct stat fileInfo;
+		if(fstat(fileDescriptor, &fileInfo) == -1 || !S_ISREG(fileInfo.st_mode))
+		{
+			::close(fileDescriptor);
+			return false;
+		}
+
+		std::string contentType;
+		std::string::size_type dotPos = path.find_last_of('.');
+		if(dotPos != std::string::npos && path.find('/', dotPos) == std::string::npos)
+		{
+			std::string extension = path.substr(dotPos + 1);
+			contentType = http.getMimeType(HelperFunctions::toLower(extension));
+		}
+
+		// {{{ Compression
+			//Range requests are always answered from the uncompressed file.
+			bool compressible = _compressionThreshold > 0 && fileInfo.st_size >= _compressionThreshold && fileInfo.st_size <= 16777216 && isCompressible(contentType);
+			Http::ContentEncoding::Enum contentEncoding = compressible && !http.hasHeaderField("range") ? http.getAcceptedContentEncoding() : Http::ContentEncoding::Enum::none;
+			PCompressedFile compressedFile;
+			std::string bodyFilename = filename;
+			struct stat bodyFileInfo = fileInfo;
+			if(contentEncoding == Http::ContentEncoding::Enum::gzip)
+			{
+				//Prefer a file compressed in advance (e.g. "app.js.gz") when it isn't older than the original file.
+				int32_t gzipFileDescriptor = open((filename + ".gz").c_str(), O_RDONLY | O_CLOEXEC);
+				struct stat gzipFileInfo;
+				if(gzipFileDescriptor != -1 && fstat(gzipFileDescriptor, &gzipFileInfo) != -1 && S_ISREG(gzipFileInfo.st_mode) && gzipFileInfo.st_mtim.tv_sec >= fileInfo.st_mtim.tv_sec)
+				{
+					::close(fileDescriptor);
+					fileDescriptor = gzipFileDescriptor;
+					bodyFilename = filename + ".gz";
+					bodyFileInfo = gzipFileInfo;
+				}
+				else if(gzipFileDescriptor != -1) ::close(gzipFileDescriptor);
+			}
+			if(contentEncoding != Http::ContentEncoding::Enum::none && bodyFilename == filename)
+			{
+				compressedFile = getCompressedFile(filename, fileDescriptor, fileInfo, contentEncoding);
+				if(!compressedFile) contentEncoding = Http::ContentEncoding::Enum::none;
+			}
+		// }}}
+
+		int64_t fileSize = compressedFile ? compressedFile->data.size() : bodyFileInfo.st_size;
+		char etagBuffer[64];
+		snprintf(etagBuffer, sizeof(etagBuffer), "\"%llx-%lx-%llx%s\"", (unsigned long long)fileInfo.st_mtim.tv_sec, (unsigned long)fileInfo.st_mtim.tv_nsec, (unsigned long long)fileInfo.st_size, contentEncoding == Http::ContentEncoding::Enum::gzip ? "-gzip" : (contentEncoding == Http::ContentEncoding::Enum::deflate ? "-deflate" : ""));
+		std::string etag(etagBuffer);
+		std::string lastModified = getHttpDate(fileInfo.st_mtim.tv_sec);
+		bool keepAlive = _keepAlive && http.isKeepAlive();
+
+		std::string header;
+		header.reserve(512);
+
+		// {{{ Conditional requests
+			bool notModified = false;
+			std::string ifNoneMatch = http.getHeaderField("if-none-match");
+			if(!ifNoneMatch.empty()) notModified = ifNoneMatch == "*" || ifNoneMatch.find(etag) != std::string::npos;
+			else
+			{
+				std::string ifModifiedSince = http.getHeaderField("if-modified-since");
+				if(!ifModifiedSince.empty())
+				{
+					time_t time = parseHttpDate(ifModifiedSince);
+					notModified = time != -1 && fileInfo.st_mtim.tv_sec <= time;
+				}
+			}
+
+			if(notModified)
+			{
+				::close(fileDescriptor);
+				header.append("HTTP/1.1 304 Not Modified\r\n");
+				header.append("ETag: ").append(etag).append("\r\n");
+				header.append("Last-Modified: ").append(lastModified).append("\r\n");
+				if(compressible) header.append("Vary: Accept-Encoding\r\n");
+				header.append(keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+				send(clientId, TcpSocket::TcpPacket(header.begin(), header.end()));
+				return true;
+			}
+		// }}}
+
+		// {{{ Range requests
+			int64_t start = 0;
+			int64_t end = fileSize - 1;
+			bool partial = false;
+			std::string range = http.getHeaderField("range");
+			std::string ifRange = http.getHeaderField("if-range");
+			//Only single ranges are supported. Requests for multiple ranges are answered with the complete file.
+			if(range.compare(0, 6, "bytes=") == 0 && range.find(',') == std::string::npos && (ifRange.empty() || ifRange == etag || ifRange == lastModified))
+			{
+				std::string::size_type dashPos = range.find('-', 6);
+				if(dashPos != std::string::npos)
+				{
+					std::string first = range.substr(6, dashPos - 6);
+					std::string last = range.substr(dashPos + 1);
+					HelperFunctions::trim(first);
+					HelperFunctions::trim(last);
+					bool valid = (!first.empty() || !last.empty()) && first.find_first_not_of("0123456789") == std::string::npos && last.find_first_not_of("0123456789") == std::string::npos;
+					//A last position smaller than the first one is syntactically invalid. The header is ignored then (RFC 7233, section 2.1).
+					if(valid && !first.empty() && !last.empty() && Math::getNumber64(last) < Math::getNumber64(first)) valid = false;
+					if(valid)
+					{
+						if(first.empty())
+						{
+							int64_t suffixLength = Math::getNumber64(last);
+							start = suffixLength >= fileSize ? 0 : fileSize - suffixLength;
+							if(suffixLength == 0) start = fileSize;
+						}
+						else
+						{
+							start = Math::getNumber64(first);
+							if(!last.empty() && Math::getNumber64(last) < end) end = Math::getNumber64(last);
+						}
+
+						if(start >= fileSize)
+						{
+							::close(fileDescriptor);
+							header.append("HTTP/1.1 416 Requested Range Not Satisfiable\r\n");
+							header.append("Content-Range: bytes */").append(std::to_string(fileSize)).append("\r\n");
+							header.append("Content-Length: 0\r\n");
+							header.append(keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+							send(clientId, TcpSocket::TcpPacket(header.begin(), header.end()));
+							return true;
+						}
+						partial = true;
+					}
+				}
+			}
+		// }}}
+
+		size_t length = fileSize == 0 ? 0 : end - start + 1;
+
+		header.append(partial ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n");
+		if(!contentType.empty()) header.append("Content-Type: ").append(contentType).append("\r\n");
+		header.append("Content-Length: ").append(std::to_string(length)).append("\r\n");
+		if(partial) header.append("Content-Range: bytes ").append(std::to_string(start)).append("-").append(std::to_string(end)).append("/").append(std::to_string(fileSize)).append("\r\n");
+		header.append("Accept-Ranges: bytes\r\n");
+		header.append("ETag: ").append(etag).append("\r\n");
+		header.append("Last-Modified: ").append(lastModified).append("\r\n");
+		if(contentEncoding == Http::ContentEncoding::Enum::gzip) header.append("Content-Encoding: gzip\r\n");
+		else if(contentEncoding == Http::ContentEncoding::Enum::deflate) header.append("Content-Encoding: deflate\r\n");
+		if(compressible) header.append("Vary: Accept-Encoding\r\n");
+		header.append(keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+		TcpSocket::TcpPacket packet(header.begin(), header.end());
+
+		if(headRequest || length == 0)
+		{
+			::close(fileDescriptor);
+			send(clientId, packet);
+			return true;
+		}
+
+		PHttpClientInfo clientInfo;
+		bool closeConnection = !keepAlive;
+		bool processNextRequest = false;
+		bool badRequestPending = false;
+		if(!finishRequest(clientId, clientInfo, closeConnection, processNextRequest, badRequestPending))
+		{
+			::close(fileDescriptor);
+			return true;
+		}
+		//Files are mapped for TLS connections, unless the kernel encrypts (kTLS) and sendfile() can be used.
+		PMappedFile mappedFile = _useSsl && !compressedFile && !_socket->clientKernelTlsSendEnabled(clientId) ? getMappedFile(bodyFilename, fileDescriptor, bodyFileInfo) : PMappedFile();
+		if(compressedFile) _socket->sendToClient(clientId, packet, compressedFile->data.data() + start, length, closeConnection);
+		else if(mappedFile) _socket->sendToClient(clientId, packet, mappedFile->data + start, length, closeConnection);
+		else _socket->sendFileToClient(clientId, packet, fileDescriptor, start, length, closeConnection);
+		::close(fileDescriptor);
+		fileDescriptor = -1;
+
+		if(badRequestPending) sendError(clientId, 400, "Bad Request");
+		else if(processNextRequest) processRequests(clientId, clientInfo);
+		return true;
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	if(fileDescriptor != -1) ::close(fileDescriptor);
+	return false;
+}
+
+HttpServer::PMappedFile HttpServer::getMappedFile(const std::string& filename, int32_t fileDescriptor, struct stat& fileInfo)
+{
+	try
+	{
+		//Larger files are read in blocks.
+		if(fileInfo.st_size == 0 || fileInfo.st_size > 16777216) return PMappedFile();
+
+		std::lock_guard<std::mutex> mappedFilesGuard(_mappedFilesMutex);
+		PMappedFile cachedFile = _mappedFiles.get(filename);
+		if(cachedFile)
+		{
+			if(cachedFile->size == (size_t)fileInfo.st_size && cachedFile->modificationTime.tv_sec == fileInfo.st_mtim.tv_sec && cachedFile->modificationTime.tv_nsec == fileInfo.st_mtim.tv_nsec) return cachedFile;
+			_mappedFiles.erase(filename);
+		}
+
+		PMappedFile mappedFile = std::make_shared<MappedFile>();
+		void* data = mmap(nullptr, fileInfo.st_size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+		if(data == MAP_FAILED) return PMappedFile();
+		mappedFile->data = (char*)data;
+		mappedFile->size = fileInfo.st_size;
+		mappedFile->modificationTime = fileInfo.st_mtim;
+
+		_mappedFiles.insert(filename, mappedFile, mappedFile->size);
+		return mappedFile;
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return PMappedFile();
+}
+
+void HttpServer::sendResponse(int32_t clientId, Http& http, int32_t code, const std::string& contentType, const std::vector<char>& content, std::vector<std::string> additionalHeaders, bool closeConnection)
+{
+	try
+	{
+		const std::vector<char>* body = &content;
+		std::vector<char> compressedContent;
+		if(_compressionThreshold > 0 && content.size() >= _compressionThreshold && isCompressible(contentType))
+		{
+			additionalHeaders.push_back("Vary: Accept-Encoding");
+			Http::ContentEncoding::Enum contentEncoding = http.getAcceptedContentEncoding();
+			if(contentEncoding != Http::ContentEncoding::Enum::none)
+			{
+				GZip::compress(content.data(), content.size(), compressedContent, contentEncoding == Http::ContentEncoding::Enum::gzip);
+				additionalHeaders.push_back(contentEncoding == Http::ContentEncoding::Enum::gzip ? "Content-Encoding: gzip" : "Content-Encoding: deflate");
+				body = &compressedContent;
+			}
+		}
+
+		std::string header;
+		Http::constructHeader(body->size(), contentType, code, http.getStatusText(code), additionalHeaders, header, !closeConnection && _keepAlive && http.isKeepAlive());
+		TcpSocket::TcpPacket packet;
+		packet.reserve(header.size() + body->size());
+		packet.insert(packet.end(), header.begin(), header.end());
+		packet.insert(packet.end(), body->begin(), body->end());
+		send(clientId, std::move(packet), closeConnection);
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void HttpServer::beginResponse(int32_t clientId, Http& http, int32_t code, const std::string& contentType, const std::vector<std::string>& additionalHeaders)
+{
+	try
+	{
+		PHttpClientInfo clientInfo = getClientInfo(clientId);
+		if(!clientInfo) return;
+
+		//Chunked transfer encoding was introduced with HTTP/1.1.
+		bool chunked = http.getHeader().protocol == Http::Protocol::Enum::http11 || http.getHeader().protocol == Http::Protocol::Enum::http20;
+		{
+			std::lock_guard<std::mutex> clientInfoGuard(clientInfo->mutex);
+			if(clientInfo->streaming) throw HttpServerException("A streamed response to client " + std::to_string(clientId) + " was already started.");
+			clientInfo->streaming = true;
+			clientInfo->chunked = chunked;
+			clientInfo->chunkEndPending = false;
+		}
+
+		std::string header;
+		header.reserve(1024);
+		header.append("HTTP/1.1 ").append(std::to_string(code)).append(" ").append(http.getStatusText(code)).append("\r\n");
+		header.append(chunked && _keepAlive && http.isKeepAlive() ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+		if(!contentType.empty()) header.append("Content-Type: ").append(contentType).append("\r\n");
+		for(auto& additionalHeader : additionalHeaders)
+		{
+			if(!additionalHeader.empty()) header.append(additionalHeader).append("\r\n");
+		}
+		if(chunked) header.append("Transfer-Encoding: chunked\r\n");
+		header.append("\r\n");
+
+		_socket->sendToClient(clientId, TcpSocket::TcpPacket(header.begin(), header.end()), false);
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void HttpServer::sendChunk(int32_t clientId, const char* data, size_t size)
+{
+	try
+	{
+		if(size == 0 || !getClientInfo(clientId)) return;
+
+		std::string chunkHeader = getChunkHeader(clientId, size);
+		_socket->sendToClient(clientId, TcpSocket::TcpPacket(chunkHeader.begin(), chunkHeader.end()), data, size, false);
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void HttpServer::sendChunkToClients(const std::vector<int32_t>& clientIds, const std::shared_ptr<const std::vector<char>>& data)
+{
+	try
+	{
+		if(!data || data->empty()) return;
+		for(auto clientId : clientIds)
+		{
+			try
+			{
+				if(!getClientInfo(clientId)) continue;
+				std::string chunkHeader = getChunkHeader(clientId, data->size());
+				//Only the chunk size line is created per client. The data itself is queued as is.
+				_socket->sendToClient(clientId, TcpSocket::TcpPacket(chunkHeader.begin(), chunkHeader.end()), data, false);
+			}
+			catch(const HttpServerException& ex)
+			{
+				_bl->out.printError("Error: " + ex.what());
+			}
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+std::string HttpServer::getChunkHeader(int32_t clientId, size_t size)
+{
+	PHttpClientInfo clientInfo = getClientInfo(clientId);
+	if(!clientInfo) return "";
+
+	std::lock_guard<std::mutex> clientInfoGuard(clientInfo->mutex);
+	if(!clientInfo->streaming) throw HttpServerException("No streamed response to client " + std::to_string(clientId) + " was started.");
+	if(!clientInfo->chunked) return "";
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), clientInfo->chunkEndPending ? "\r\n%zx\r\n" : "%zx\r\n", size);
+	clientInfo->chunkEndPending = true;
+	return std::string(buffer);
+}
+
+void HttpServer::finishResponse(int32_t clientId, bool closeConnection)
+{
+	try
+	{
+		PHttpClientInfo clientInfo = getClientInfo(clientId);
+		if(!clientInfo) return;
+
+		std::string terminator;
+		{
+			std::lock_guard<std::mutex> clientInfoGuard(clientInfo->mutex);
+			if(!clientInfo->streaming) throw HttpServerException("No streamed response to client " + std::to_string(clientId) + " was started.");
+			if(clientInfo->chunked) terminator = clientInfo->chunkEndPending ? "\r\n0\r\n\r\n" : "0\r\n\r\n";
+			else closeConnection = true; //Without chunked encoding the end of the body is signaled by closing the connection.
+			clientInfo->streaming = false;
+			clientInfo->chunkEndPending = false;
+		}
+
+		bool processNextRequest = false;
+		bool badRequestPending = false;
+		if(!finishRequest(clientId, clientInfo, closeConnection, processNextRequest, badRequestPending)) return;
+
+		_socket->sendToClient(clientId, TcpSocket::TcpPacket(terminator.begin(), terminator.end()), closeConnection);
+
+		if(badRequestPending) sendError(clientId, 400, "Bad Request");
+		else if(processNextRequest) processRequests(clientId, clientInfo);
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(BaseLib::Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+HttpServer::PCompressedFile HttpServer::getCompressedFile(const std::string& filename, int32_t fileDescriptor, struct stat& fileInfo, Http::ContentEncoding::Enum contentEncoding)
+{
+	try
+	{
+		std::string key = filename + (contentEncoding == Http::ContentEncoding::Enum::gzip ? ":gzip" : ":deflate");
+		{
+			std::lock_guard<std::mutex> compressedFilesGuard(_compressedFilesMutex);
+			PCompressedFile cachedFile = _compressedFiles.get(key);
+			if(cachedFile)
+			{
+				if(cachedFile->originalSize == (size_t)fileInfo.st_size && cachedFile->modificationTime.tv_sec == fileInfo.st_mtim.tv_sec && cachedFile->modificationTime.tv_nsec == fileInfo.st_mtim.tv_nsec) return cachedFile;
+				_compressedFiles.erase(key);
+			}
+		}
+
+		std::vector<char> content(fileInfo.st_size);
+		size_t totalBytesRead = 0;
+		while(totalBytesRead < content.size())
+		{
+			ssize_t bytesRead = pread(fileDescriptor, content.data() + totalBytesRead, content.size() - totalBytesRead, totalBytesRead);
+			if(bytesRead <= 0)
+			{
+				if(bytesRead == -1 && errno == EINTR) continue;
+				return PCompressedFile();
+			}
+			totalBytesRead += bytesRead;
+		}
+
+		//Compression is done once per file version, so the smallest output is worth the time.
+		PCompressedFile compressedFile = std::make_shared<CompressedFile>();
+		compressedFile->modificationTime = fileInfo.st_mtim;
+		compressedFile->originalSize = fileInfo.st_size;
+		GZip::compress(content.data(), content.size(), compressedFile->data, contentEncoding == Http::ContentEncoding::Enum::gzip, 9);
+		compressedFile->data.shrink_to_fit();
+
+		{
+			std::lock_guard<std::mutex> compressedFilesGuard(_compressedFilesMutex);
+			_compressedFiles.insert(key, compressedFile, compressedFile->data.size());
+		}
+		return compressedFile;
 	}
 	catch(const std::exception& ex)
 	{
@@ -160,12 +922,34 @@ void HttpServer::packetReceived(int32_t clientId, TcpSocket::TcpPacket packet)
 	{
 		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
 	}
-	http->reset();
+	return PCompressedFile();
+}
+
+bool HttpServer::isCompressible(const std::string& fullContentType)
+{
+	//Parameters like "charset" don't matter.
+	std::string contentType = fullContentType.substr(0, fullContentType.find(';'));
+	HelperFunctions::toLower(HelperFunctions::trim(contentType));
+	if(contentType.compare(0, 5, "text/") == 0) return true;
+	if(contentType == "application/json" || contentType == "application/javascript" || contentType == "application/xml" || contentType == "image/svg+xml" || contentType == "application/xml-dtd") return true;
+	return contentType.size() > 4 && (contentType.compare(contentType.size() - 4, 4, "+xml") == 0 || contentType.compare(contentType.size() - 5, 5, "+json") == 0);
+}
+
+std::string HttpServer::getHttpDate(time_t time)
+{
+	struct tm timeStruct;
+	gmtime_r(&time, &timeStruct);
+	char buffer[64];
+	size_t size = strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &timeStruct);
+	return std::string(buffer, size);
 }
 
-void HttpServer::send(int32_t clientId, TcpSocket::TcpPacket packet, bool closeConnection)
+time_t HttpServer::parseHttpDate(const std::string& date)
 {
-	_socket->sendToClient(clientId, packet, closeConnection);
+	struct tm timeStruct;
+	memset(&timeStruct, 0, sizeof(struct tm));
+	if(!strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &timeStruct)) return -1;
+	return timegm(&timeStruct);
 }
 
 }
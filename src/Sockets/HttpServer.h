@@ -37,6 +37,10 @@
 #include "TcpSocket.h"
 
 #include <atomic>
+#include <deque>
+#include <list>
+
+#include <sys/stat.h>
 
 namespace BaseLib
 {
@@ -55,12 +59,15 @@ public:
 /**
  * This class provides a basic HTTP server. The class is thread safe.
  *
+ * Connections are kept open after a response when the client supports it (HTTP/1.1 or "Connection: keep-alive"). Pipelined requests are queued per client and passed
+ * to packetReceivedCallback one at a time in the order they were received. The next request is passed on after the response to the current one was sent using send().
+ *
  * HTTP Server Example Code
  * ========================
  *
  * Save the example below in `main.cpp` and compile with:
  *
- *     g++ -o main -std=c++11 main.cpp -lhomegear-base -lgcrypt -lgnutls
+ *     g++ -o main -std=c++11 main.cpp -lhomegear-base -lgcrypt -lgnutls -lz
  *
  * Start and connect using a browser:
  *
@@ -88,7 +95,6 @@ public:
  *
  *         std::string header;
  *         header.append("HTTP/1.1 200 OK\r\n");
- *         header.append("Connection: close\r\n");
  *         header.append("Content-Type: application/json\r\n");
  *         header.append("Content-Length: ").append(std::to_string(json.size())).append("\r\n\r\n");
  *
@@ -134,6 +140,73 @@ public:
 		std::string dhParamData;
 		bool requireClientCert = false;
 
+		/**
+		 * Keep connections open after a response when the client supports it.
+		 */
+		bool keepAlive = true;
+
+		/**
+		 * Time in milliseconds after which idle connections are closed. Set to "0" to disable the timeout.
+		 */
+		uint32_t keepAliveTimeout = 30000;
+
+		/**
+		 * Time in milliseconds a client has to complete the TLS handshake. See TcpSocket::TcpServerInfo::tlsHandshakeTimeout.
+		 */
+		uint32_t tlsHandshakeTimeout = 10000;
+
+		/**
+		 * The maximum number of unanswered requests per client. The connection is closed when the client exceeds it.
+		 */
+		uint32_t maxPipelinedRequests = 16;
+
+		/**
+		 * The directory serveStaticFile() serves files from. Leave empty to disable static file serving.
+		 */
+		std::string contentPath;
+
+		/**
+		 * Responses sent with sendResponse() and static files are compressed with gzip or deflate when they are at least this number of bytes large, have a
+		 * text based content type and the client accepts it. Set to "0" to disable compression.
+		 */
+		uint32_t compressionThreshold = 1024;
+
+		/**
+		 * The maximum number of bytes of compressed static files kept in memory.
+		 */
+		uint32_t compressionCacheSize = 33554432;
+
+		/**
+		 * When set, files uploaded with "multipart/form-data" are written to temporary files in this directory while they are received instead of being
+		 * kept in memory. Http::decodeMultipartFormdata() returns the parts with FormData::filePath set. The files are deleted when the request is
+		 * finished, so move them to keep them.
+		 */
+		std::string formDataDirectory;
+
+		/**
+		 * The maximum size of request bodies in bytes. Larger requests are answered with "400 Bad Request". The limit also applies to uploads written to
+		 * "formDataDirectory".
+		 */
+		uint64_t maxUploadSize = 104857600;
+
+		/**
+		 * Queue responses and chunks per client instead of writing them on the calling thread. See TcpSocket::TcpServerInfo::useSendQueue.
+		 */
+		bool useSendQueue = false;
+		size_t sendQueueHighWatermark = 4194304;
+		size_t sendQueueLowWatermark = 1048576;
+
+		/**
+		 * Responses are never discarded, so TcpSocket::SlowClientPolicy::drop behaves like TcpSocket::SlowClientPolicy::block.
+		 */
+		TcpSocket::SlowClientPolicy slowClientPolicy = TcpSocket::SlowClientPolicy::block;
+		uint32_t sendQueueStallTimeout = 60000;
+
+		/**
+		 * Only used when listening on a Unix domain socket. See TcpSocket::TcpServerInfo::unixPeerCredentialsCallback.
+		 */
+		std::function<bool(pid_t pid, uid_t uid, gid_t gid)> unixPeerCredentialsCallback;
+
         std::function<void(int32_t clientId, std::string address, uint16_t port)> newConnectionCallback;
         std::function<void(int32_t clientId)> connectionClosedCallback;
 		std::function<void(int32_t clientId, Http& http)> packetReceivedCallback;
@@ -142,30 +215,344 @@ public:
 	HttpServer(BaseLib::SharedObjects* baseLib, HttpServerInfo& serverInfo);
 	virtual ~HttpServer();
 
+	/**
+	 * Starts listening.
+	 *
+	 * @param address The address to bind the server to (e. g. `::` or `0.0.0.0`) or the path of a Unix domain socket starting with "/".
+	 * @param port The port number to bind the server to. Ignored for Unix domain sockets.
+	 * @param[out] listenAddress The IP address or socket path the server was bound to.
+	 */
 	void start(std::string address, std::string port, std::string& listenAddress);
 	void stop();
 	void waitForStop();
 
-	void send(int32_t clientId, TcpSocket::TcpPacket packet, bool closeConnection = true);
+	/**
+	 * Sends the response to the request currently processed for a client. A response can be sent in multiple parts (e. g. header and body) by setting
+	 * "lastPacket" to false for all parts but the last one. The request is answered when a packet with "lastPacket" set to true is sent. Responses for clients
+	 * without a request in progress (e. g. after the request was answered with an error) are dropped with a warning.
+	 *
+	 * Since version 2 of the library the connection is kept open by default. It is closed when "closeConnection" is set, when the response header contains
+	 * "Connection: close" (like headers created by Http::constructHeader() without "keepAlive"), or when keep-alive is disabled or not supported by the client.
+	 *
+	 * @param clientId The ID of the client as passed to packetReceivedCallback.
+	 * @param packet The response or the part of the response to send.
+	 * @param closeConnection (Optional, default "false") Close the connection after sending the response.
+	 * @param lastPacket (Optional, default "true") Set to false when more parts of the response follow.
+	 */
+	void send(int32_t clientId, TcpSocket::TcpPacket packet, bool closeConnection = false, bool lastPacket = true);
+
+	/**
+	 * Answers a GET or HEAD request with a file from HttpServerInfo::contentPath. "index.html" is served for paths ending with "/". The response contains "ETag"
+	 * and "Last-Modified", conditional requests are answered with "304 Not Modified" and single byte ranges are supported. On plain connections the file is sent
+	 * using sendfile(), on TLS connections it is encrypted from a cached memory mapping.
+	 *
+	 * @param clientId The ID of the client as passed to packetReceivedCallback.
+	 * @param http The request as passed to packetReceivedCallback.
+	 * @return Returns true when a response was sent. Returns false when the request isn't a GET or HEAD request or the file doesn't exist. In this case nothing
+	 * is sent and the request needs to be answered by the caller.
+	 */
+	bool serveStaticFile(int32_t clientId, Http& http);
+
+	/**
+	 * Builds and sends a response. The content is compressed as described for HttpServerInfo::compressionThreshold.
+	 *
+	 * @param clientId The ID of the client as passed to packetReceivedCallback.
+	 * @param http The request as passed to packetReceivedCallback.
+	 * @param code The status code.
+	 * @param contentType The content type of "content".
+	 * @param content The response body.
+	 * @param additionalHeaders (Optional) Further header fields without line endings.
+	 * @param closeConnection (Optional, default "false") Close the connection after sending the response.
+	 */
+	void sendResponse(int32_t clientId, Http& http, int32_t code, const std::string& contentType, const std::vector<char>& content, std::vector<std::string> additionalHeaders = std::vector<std::string>(), bool closeConnection = false);
+
+	/**
+	 * Starts a streamed response and sends its header with "Transfer-Encoding: chunked". Send the body with sendChunk() and complete the response with
+	 * finishResponse(). HTTP/1.0 clients don't support chunked encoding. For them the body is sent as is and the connection is closed by finishResponse().
+	 *
+	 * @param clientId The ID of the client as passed to packetReceivedCallback.
+	 * @param http The request as passed to packetReceivedCallback.
+	 * @param code The status code.
+	 * @param contentType The content type of the body.
+	 * @param additionalHeaders (Optional) Further header fields without line endings.
+	 */
+	void beginResponse(int32_t clientId, Http& http, int32_t code, const std::string& contentType, const std::vector<std::string>& additionalHeaders = std::vector<std::string>());
+
+	/**
+	 * Sends a part of the body of a response started with beginResponse(). The data is not copied.
+	 *
+	 * @param clientId The ID of the client as passed to packetReceivedCallback.
+	 * @param data The data to send.
+	 * @param size The size of "data". Calls with a size of "0" are ignored.
+	 */
+	void sendChunk(int32_t clientId, const char* data, size_t size);
+
+	/**
+	 * Sends the same part of a body to multiple clients with a response started with beginResponse(), e. g. an event to all clients listening on
+	 * an event stream. The data is serialized once by the caller and not copied for the single clients. Only the chunk size line is created per
+	 * client. With the send queue of TcpSocket enabled, parts are discarded completely for slow clients according to SlowClientPolicy::drop.
+	 *
+	 * @param clientIds The IDs of the clients as passed to packetReceivedCallback.
+	 * @param data The data to send.
+	 */
+	void sendChunkToClients(const std::vector<int32_t>& clientIds, const std::shared_ptr<const std::vector<char>>& data);
+
+	/**
+	 * Completes a response started with beginResponse().
+	 *
+	 * @param clientId The ID of the client as passed to packetReceivedCallback.
+	 * @param closeConnection (Optional, default "false") Close the connection after the response.
+	 */
+	void finishResponse(int32_t clientId, bool closeConnection = false);
+
+	/**
+	 * Returns the metrics of the TCP server as described for TcpSocket::getMetrics() with the additional elements "requests" (number of completely
+	 * received requests), "badRequests" (number of requests answered with "400 Bad Request") and "responseTime" (histogram of the times in microseconds
+	 * from passing a request to packetReceivedCallback until the response is sent).
+	 *
+	 * @param includeClients Add the metrics of every connected client.
+	 */
+	PVariable getMetrics(bool includeClients = false);
 protected:
 	struct HttpClientInfo
 	{
+		std::mutex mutex;
+
+		/**
+		 * The parser for incoming data.
+		 */
 		std::shared_ptr<Http> http;
+
+		/**
+		 * Completely received requests in the order they arrived. The first element is the request currently processed when "requestInProgress" is true.
+		 */
+		std::deque<std::shared_ptr<Http>> requests;
+
+		/**
+		 * Parser objects of answered requests for reuse.
+		 */
+		std::vector<std::shared_ptr<Http>> unusedHttp;
+		bool requestInProgress = false;
+		bool dispatching = false;
+
+		/**
+		 * Invalid data was received after the queued requests. "400 Bad Request" is sent and the connection is closed after they are answered.
+		 */
+		bool badRequest = false;
+		int64_t requestStartTime = 0;
+
+		/**
+		 * A part of the current response sent with send() and "lastPacket" set to false requested to close the connection.
+		 */
+		bool closeAfterResponse = false;
+
+		// {{{ Streamed responses
+			bool streaming = false;
+			bool chunked = false;
+
+			/**
+			 * The line break after the last chunk. It is sent together with the next chunk or the terminating chunk.
+			 */
+			bool chunkEndPending = false;
+		// }}}
 	};
+	typedef std::shared_ptr<HttpClientInfo> PHttpClientInfo;
+
+	/**
+	 * A memory mapped file used to send static files over TLS connections.
+	 */
+	struct MappedFile
+	{
+		struct timespec modificationTime;
+		size_t size = 0;
+		char* data = nullptr;
+
+		virtual ~MappedFile();
+	};
+	typedef std::shared_ptr<MappedFile> PMappedFile;
+
+	/**
+	 * Cache of file data limited by the total size of its entries. When the limit is exceeded, the least recently used entries are removed. The class is not
+	 * thread safe. Entries still in use are kept alive by their shared pointers.
+	 */
+	template<typename T>
+	class FileCache
+	{
+	public:
+		FileCache(size_t maxSize) : _maxSize(maxSize) {}
+
+		void setMaxSize(size_t value) { _maxSize = value; }
+		size_t maxSize() { return _maxSize; }
+
+		/**
+		 * Returns an entry and marks it as most recently used.
+		 *
+		 * @return The entry or nullptr when it doesn't exist.
+		 */
+		std::shared_ptr<T> get(const std::string& key)
+		{
+			auto indexIterator = _index.find(key);
+			if(indexIterator == _index.end()) return std::shared_ptr<T>();
+			_entries.splice(_entries.begin(), _entries, indexIterator->second);
+			return indexIterator->second->value;
+		}
+
+		void erase(const std::string& key)
+		{
+			auto indexIterator = _index.find(key);
+			if(indexIterator == _index.end()) return;
+			_size -= indexIterator->second->size;
+			_entries.erase(indexIterator->second);
+			_index.erase(indexIterator);
+		}
+
+		/**
+		 * Inserts or replaces an entry and removes the least recently used entries until the cache doesn't exceed its maximum size.
+		 *
+		 * @return Returns false when the entry is larger than the maximum size. It is not inserted then.
+		 */
+		bool insert(const std::string& key, const std::shared_ptr<T>& value, size_t size)
+		{
+			erase(key);
+			if(size > _maxSize) return false;
+			while(!_entries.empty() && _size + size > _maxSize)
+			{
+				_size -= _entries.back().size;
+				_index.erase(_entries.back().key);
+				_entries.pop_back();
+			}
+			_entries.push_front(Entry{key, value, size});
+			_index[key] = _entries.begin();
+			_size += size;
+			return true;
+		}
+	private:
+		struct Entry
+		{
+			std::string key;
+			std::shared_ptr<T> value;
+			size_t size;
+		};
+
+		size_t _maxSize = 0;
+		size_t _size = 0;
+
+		/**
+		 * The most recently used entry is the first element.
+		 */
+		std::list<Entry> _entries;
+		std::unordered_map<std::string, typename std::list<Entry>::iterator> _index;
+	};
+
+	/**
+	 * The compressed content of a static file.
+	 */
+	struct CompressedFile
+	{
+		struct timespec modificationTime;
+		size_t originalSize = 0;
+		std::vector<char> data;
+	};
+	typedef std::shared_ptr<CompressedFile> PCompressedFile;
 
 	BaseLib::SharedObjects* _bl = nullptr;
 	std::shared_ptr<TcpSocket> _socket;
 
 	std::mutex _httpClientInfoMutex;
-	std::unordered_map<int32_t, HttpClientInfo> _httpClientInfo;
+	std::unordered_map<int32_t, PHttpClientInfo> _httpClientInfo;
+	bool _keepAlive = true;
+	uint32_t _maxPipelinedRequests = 16;
+	bool _useSsl = false;
+	std::string _contentPath;
+	std::string _formDataDirectory;
+	uint64_t _maxUploadSize = 104857600;
+
+	std::mutex _mappedFilesMutex;
+	FileCache<MappedFile> _mappedFiles{268435456};
+
+	uint32_t _compressionThreshold = 1024;
+	std::mutex _compressedFilesMutex;
+	FileCache<CompressedFile> _compressedFiles{33554432};
 
     std::function<void(int32_t clientId, std::string address, uint16_t port)> _newConnectionCallback;
     std::function<void(int32_t clientId)> _connectionClosedCallback;
 	std::function<void(int32_t clientId, Http& http)> _packetReceivedCallback;
 
+	std::atomic<uint64_t> _requests{0};
+	std::atomic<uint64_t> _badRequests{0};
+	LatencyHistogram _responseTime;
+
 	void newConnection(int32_t clientId, std::string address, uint16_t port);
 	void connectionClosed(int32_t clientId);
-	void packetReceived(int32_t clientId, TcpSocket::TcpPacket packet);
+	void packetReceived(int32_t clientId, const TcpSocket::TcpPacketView& packet);
+
+	/**
+	 * Passes queued requests to packetReceivedCallback until the queue is empty or a request is answered asynchronously.
+	 */
+	void processRequests(int32_t clientId, PHttpClientInfo& clientInfo);
+
+	/**
+	 * Marks the request currently processed for a client as answered.
+	 *
+	 * @param clientId The ID of the client.
+	 * @param[out] clientInfo The client's information. It is nullptr when the client is not connected anymore.
+	 * @param[in,out] closeConnection Set to true when the connection needs to be closed after the response.
+	 * @param[out] processNextRequest Set to true when the next queued request needs to be passed on by calling processRequests() after the response was sent.
+	 * @param[out] badRequestPending Set to true when "400 Bad Request" needs to be sent with sendError() after the response.
+	 * @return Returns false when no request is in progress for the client. The response must not be sent in this case.
+	 */
+	bool finishRequest(int32_t clientId, PHttpClientInfo& clientInfo, bool& closeConnection, bool& processNextRequest, bool& badRequestPending);
+
+	/**
+	 * Sends a response without body and closes the connection.
+	 */
+	void sendError(int32_t clientId, int32_t code, const std::string& codeDescription);
+
+	/**
+	 * Returns the chunk size line to send in front of a part of a streamed response and marks the chunk as started.
+	 *
+	 * @param clientId The ID of the client.
+	 * @param size The size of the part.
+	 * @return The chunk size line or an empty string when the response is not chunked (HTTP/1.0).
+	 * @throws HttpServerException Thrown when no streamed response was started.
+	 */
+	std::string getChunkHeader(int32_t clientId, size_t size);
+
+	/**
+	 * Checks if the header of a response contains "Connection: close". Only packets starting with a status line are checked and only the first 8 KiB are
+	 * searched for the end of the header.
+	 */
+	static bool closesConnection(const TcpSocket::TcpPacket& packet);
+
+	PHttpClientInfo getClientInfo(int32_t clientId);
+
+	/**
+	 * Returns a cached memory mapping of a file and creates it if it doesn't exist or the file was changed.
+	 *
+	 * @param filename The path of the file.
+	 * @param fileDescriptor The opened file.
+	 * @param fileInfo The result of fstat() for the opened file.
+	 * @return The mapping or nullptr when the file is too large or can't be mapped.
+	 */
+	PMappedFile getMappedFile(const std::string& filename, int32_t fileDescriptor, struct stat& fileInfo);
+
+	/**
+	 * Returns the compressed content of a file from the cache and compresses it if it isn't cached yet or the file was changed.
+	 *
+	 * @param filename The path of the file.
+	 * @param fileDescriptor The opened file.
+	 * @param fileInfo The result of fstat() for the opened file.
+	 * @param contentEncoding Either Http::ContentEncoding::gzip or Http::ContentEncoding::deflate.
+	 * @return The compressed file or nullptr on errors.
+	 */
+	PCompressedFile getCompressedFile(const std::string& filename, int32_t fileDescriptor, struct stat& fileInfo, Http::ContentEncoding::Enum contentEncoding);
+
+	/**
+	 * Checks if content of a content type benefits from compression. Parameters of the content type (e. g. "charset") are ignored.
+	 */
+	static bool isCompressible(const std::string& fullContentType);
+	static std::string getHttpDate(time_t time);
+	static time_t parseHttpDate(const std::string& date);
 };
 
 }
@@ -0,0 +1,99 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * 
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "SocketMetrics.h"
+#include "../Variable.h"
+
+namespace BaseLib
+{
+
+LatencyHistogram::LatencyHistogram()
+{
+	for(auto& bucket : _buckets)
+	{
+		bucket.store(0, std::memory_order_relaxed);
+	}
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+	//Bucket i contains the values from 2^(i - 1) to 2^i - 1, bucket 0 only contains 0.
+	uint32_t index = value == 0 ? 0 : 64 - __builtin_clzll(value);
+	if(index >= _bucketCount) index = _bucketCount - 1;
+	_buckets[index].fetch_add(1, std::memory_order_relaxed);
+	_count.fetch_add(1, std::memory_order_relaxed);
+	_sum.fetch_add(value, std::memory_order_relaxed);
+	uint64_t max = _max.load(std::memory_order_relaxed);
+	while(value > max && !_max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+}
+
+PVariable LatencyHistogram::toVariable()
+{
+	PVariable histogram = std::make_shared<Variable>(VariableType::tStruct);
+	histogram->structValue->emplace("count", std::make_shared<Variable>(_count.load(std::memory_order_relaxed)));
+	histogram->structValue->emplace("sum", std::make_shared<Variable>(_sum.load(std::memory_order_relaxed)));
+	histogram->structValue->emplace("max", std::make_shared<Variable>(_max.load(std::memory_order_relaxed)));
+	PVariable buckets = std::make_shared<Variable>(VariableType::tArray);
+	for(uint32_t i = 0; i < _bucketCount; i++)
+	{
+		uint64_t count = _buckets[i].load(std::memory_order_relaxed);
+		if(count == 0) continue;
+		PVariable bucket = std::make_shared<Variable>(VariableType::tStruct);
+		bucket->structValue->emplace("upperBound", std::make_shared<Variable>(i == _bucketCount - 1 ? (int64_t)-1 : (int64_t)1 << i));
+		bucket->structValue->emplace("count", std::make_shared<Variable>(count));
+		buckets->arrayValue->push_back(bucket);
+	}
+	histogram->structValue->emplace("buckets", buckets);
+	return histogram;
+}
+
+void SocketMetrics::addTo(PVariable& metrics)
+{
+	metrics->structValue->emplace("bytesReceived", std::make_shared<Variable>(bytesReceived.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("bytesSent", std::make_shared<Variable>(bytesSent.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("reads", std::make_shared<Variable>(reads.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("writes", std::make_shared<Variable>(writes.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("readTimeouts", std::make_shared<Variable>(readTimeouts.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("writeTimeouts", std::make_shared<Variable>(writeTimeouts.load(std::memory_order_relaxed)));
+}
+
+void TcpServerMetrics::addTo(PVariable& metrics)
+{
+	metrics->structValue->emplace("connectionsAccepted", std::make_shared<Variable>(connectionsAccepted.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("connectionsRejected", std::make_shared<Variable>(connectionsRejected.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("tlsHandshakeFailures", std::make_shared<Variable>(tlsHandshakeFailures.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("tlsHandshakeTimeouts", std::make_shared<Variable>(tlsHandshakeTimeouts.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("idleTimeouts", std::make_shared<Variable>(idleTimeouts.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("sendQueueStallTimeouts", std::make_shared<Variable>(sendQueueStallTimeouts.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("droppedPackets", std::make_shared<Variable>(droppedPackets.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("tlsHandshakeTime", tlsHandshakeTime.toVariable());
+}
+
+}
@@ -0,0 +1,154 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * 
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef SOCKETMETRICS_H_
+#define SOCKETMETRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace BaseLib
+{
+
+class Variable;
+typedef std::shared_ptr<Variable> PVariable;
+
+/**
+ * Histogram of latencies in microseconds. The buckets have power-of-two upper bounds, so recording a value is a few relaxed atomic additions and can be
+ * done from any thread without locking. As the counters are updated independently, a snapshot taken while values are recorded might be slightly
+ * inconsistent.
+ */
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	/**
+	 * Records a value.
+	 *
+	 * @param value The latency in microseconds.
+	 */
+	void record(uint64_t value);
+
+	uint64_t count() { return _count.load(std::memory_order_relaxed); }
+
+	/**
+	 * Returns the histogram as a struct with the elements "count", "sum", "max" and "buckets". "buckets" is an array of structs with the elements
+	 * "upperBound" (exclusive, in microseconds, -1 for the last bucket) and "count". Empty buckets are left out.
+	 */
+	PVariable toVariable();
+private:
+	static const uint32_t _bucketCount = 32;
+
+	std::atomic<uint64_t> _buckets[_bucketCount];
+	std::atomic<uint64_t> _count{0};
+	std::atomic<uint64_t> _sum{0};
+	std::atomic<uint64_t> _max{0};
+};
+
+/**
+ * Data transfer counters of a socket. All counters are updated with relaxed atomic operations.
+ */
+class SocketMetrics
+{
+public:
+	std::atomic<uint64_t> bytesReceived{0};
+	std::atomic<uint64_t> bytesSent{0};
+
+	/**
+	 * Number of successful read calls or received datagrams.
+	 */
+	std::atomic<uint64_t> reads{0};
+
+	/**
+	 * Number of successful write calls or sent datagrams.
+	 */
+	std::atomic<uint64_t> writes{0};
+
+	/**
+	 * Number of reads that threw a SocketTimeOutException.
+	 */
+	std::atomic<uint64_t> readTimeouts{0};
+
+	/**
+	 * Number of writes that threw a SocketTimeOutException or, for queued server writes, exceeded the write timeout.
+	 */
+	std::atomic<uint64_t> writeTimeouts{0};
+
+	static void increment(std::atomic<uint64_t>& counter, uint64_t value = 1) { counter.fetch_add(value, std::memory_order_relaxed); }
+
+	void received(uint64_t bytes) { increment(bytesReceived, bytes); increment(reads); }
+	void sent(uint64_t bytes) { increment(bytesSent, bytes); increment(writes); }
+
+	/**
+	 * Adds the counters as elements to a struct variable.
+	 */
+	void addTo(PVariable& metrics);
+};
+
+/**
+ * Connection counters and latencies of a TCP server.
+ */
+class TcpServerMetrics
+{
+public:
+	std::atomic<uint64_t> connectionsAccepted{0};
+
+	/**
+	 * Connections closed right after accepting them because the maximum number of connections was reached or the Unix peer credentials callback
+	 * rejected them.
+	 */
+	std::atomic<uint64_t> connectionsRejected{0};
+
+	std::atomic<uint64_t> tlsHandshakeFailures{0};
+	std::atomic<uint64_t> tlsHandshakeTimeouts{0};
+	std::atomic<uint64_t> idleTimeouts{0};
+	std::atomic<uint64_t> sendQueueStallTimeouts{0};
+
+	/**
+	 * Packets not sent to slow clients because of SlowClientPolicy::drop.
+	 */
+	std::atomic<uint64_t> droppedPackets{0};
+
+	/**
+	 * Time from accepting a connection until the TLS handshake is completed.
+	 */
+	LatencyHistogram tlsHandshakeTime;
+
+	/**
+	 * Adds the counters as elements to a struct variable.
+	 */
+	void addTo(PVariable& metrics);
+};
+
+}
+
+#endif
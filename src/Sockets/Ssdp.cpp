@@ -36,6 +36,9 @@
 namespace BaseLib
 {
 
+std::mutex Ssdp::_deviceInfoCacheMutex;
+std::unordered_map<std::string, Ssdp::DeviceInfoCacheEntry> Ssdp::_deviceInfoCache;
+
 SsdpInfo::SsdpInfo()
 {
 }
@@ -142,16 +145,14 @@ std::shared_ptr<FileDescriptor> Ssdp::getSocketDescriptor(int32_t port, bool bin
 			return serverSocketDescriptor;
 		}
 
-        if(!bindToMulticast)
+        //Sockets bound to the multicast address need to join the group, too. Otherwise NOTIFY packets are only received when another socket on this host joined it.
+        struct ip_mreq group;
+        group.imr_multiaddr.s_addr = inet_addr("239.255.255.250");
+        group.imr_interface.s_addr = inet_addr(_address.c_str());
+
+        if (setsockopt(serverSocketDescriptor->descriptor, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char*) &group, sizeof(group)) == -1)
         {
-            struct ip_mreq group;
-            group.imr_multiaddr.s_addr = inet_addr("239.255.255.250");
-            group.imr_interface.s_addr = inet_addr(_address.c_str());
-
-            if (setsockopt(serverSocketDescriptor->descriptor, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char*) &group, sizeof(group)) == -1)
-            {
-                _bl->out.printWarning("Warning: Could set SSDP socket options: " + std::string(strerror(errno)));
-            }
+            _bl->out.printWarning("Warning: Could set SSDP socket options: " + std::string(strerror(errno)));
         }
 	}
 	catch(const std::exception& ex)
@@ -403,14 +404,14 @@ void Ssdp::processPacket(Http& http, const std::string& stHeader, std::map<std::
 	try
 	{
 		Http::Header& header = http.getHeader();
-		if(header.responseCode != 200 || (header.fields.at("st") != stHeader && stHeader != "ssdp:all")) return;
+		if(header.responseCode != 200 || (http.getHeaderField("st") != stHeader && stHeader != "ssdp:all")) return;
 
-		std::string location = header.fields.at("location");
+		std::string location = http.getHeaderField("location");
 		if(location.size() < 7) return;
 		SsdpInfo currentInfo;
 		currentInfo.setLocation(location);
 
-		for(auto& field : header.fields)
+		for(auto& field : http.getHeaderFields())
 		{
 			currentInfo.addField(field.first, field.second);
 		}
@@ -437,15 +438,14 @@ void Ssdp::processPacketPassive(Http& http, const std::string& stHeader, std::ma
     {
         Http::Header& header = http.getHeader();
         if(header.method != "NOTIFY") return;
-        auto headerIterator = header.fields.find("nt");
-        if(headerIterator == header.fields.end() || (headerIterator->second != stHeader && stHeader != "ssdp:all")) return;
+        if(!http.hasHeaderField("nt") || (http.getHeaderField("nt") != stHeader && stHeader != "ssdp:all")) return;
 
-        std::string location = header.fields.at("location");
+        std::string location = http.getHeaderField("location");
         if(location.size() < 7) return;
         SsdpInfo currentInfo;
         currentInfo.setLocation(location);
 
-        for(auto& field : header.fields)
+        for(auto& field : http.getHeaderFields())
         {
             currentInfo.addField(field.first, field.second);
         }
@@ -466,59 +466,181 @@ void Ssdp::processPacketPassive(Http& http, const std::string& stHeader, std::ma
     }
 }
 
+void Ssdp::clearDeviceInfoCache()
+{
+	std::lock_guard<std::mutex> deviceInfoCacheGuard(_deviceInfoCacheMutex);
+	_deviceInfoCache.clear();
+}
+
+int32_t Ssdp::getMaxAge(const std::string& cacheControl)
+{
+	std::string directives = cacheControl;
+	HelperFunctions::toLower(directives);
+	std::string::size_type pos = directives.find("max-age");
+	if(pos != std::string::npos)
+	{
+		pos = directives.find('=', pos);
+		if(pos != std::string::npos)
+		{
+			std::string value = directives.substr(pos + 1, directives.find(',', pos) - pos - 1);
+			HelperFunctions::trim(value);
+			int32_t maxAge = Math::getNumber(value, false);
+			if(maxAge > 0) return maxAge > 86400 ? 86400 : maxAge;
+		}
+	}
+	return 1800;
+}
+
+bool Ssdp::parseLocation(SsdpInfo& info)
+{
+	std::string location = info.location();
+	std::string::size_type posSlash = location.find('/');
+	std::string::size_type posPort = location.find_last_of(':');
+	if(posSlash == std::string::npos || posSlash >= posPort || posPort == std::string::npos) return false;
+	std::string::size_type posPath = location.find('/', posPort);
+	if(posPath == std::string::npos) posPath = location.size();
+	std::string ip = location.substr(posSlash + 2, posPort - posSlash - 2);
+	std::string portString = location.substr(posPort + 1, posPath - posPort - 1);
+	int32_t port = Math::getNumber(portString, false);
+	if(port <= 0 || port > 65535) return false;
+	std::string path = posPath == location.size() ? "/" : location.substr(posPath);
+
+	info.setIp(ip);
+	info.setPort(port);
+	info.setPath(path);
+	return true;
+}
+
+PVariable Ssdp::parseDeviceInfo(char* xml)
+{
+	xml_document<> doc;
+	doc.parse<parse_no_entity_translation | parse_validate_closing_tags>(xml);
+	xml_node<>* node = doc.first_node("root");
+	if(!node) return PVariable();
+	node = node->first_node("device");
+	if(!node) return PVariable();
+	return std::make_shared<Variable>(node);
+}
+
+void Ssdp::fetchDeviceInfo(std::vector<SsdpInfo*>& devices)
+{
+	std::mutex responsesMutex;
+	std::condition_variable responsesConditionVariable;
+	std::vector<std::pair<SsdpInfo*, std::shared_ptr<Http>>> responses;
+	size_t pendingRequests = 0;
+
+	//Declared after the variables used by the callbacks, so it is stopped (and all callbacks are called) before they are destroyed.
+	AsyncHttpClient client(_bl);
+	client.setMaxConnectionsPerHost(_maxConcurrentRequests);
+	client.setMaxPipelinedRequests(1);
+	client.start();
+
+	size_t nextDevice = 0;
+	std::unique_lock<std::mutex> responsesGuard(responsesMutex);
+	while(nextDevice < devices.size() || pendingRequests > 0)
+	{
+		while(nextDevice < devices.size() && pendingRequests < _maxConcurrentRequests)
+		{
+			SsdpInfo* device = devices.at(nextDevice++);
+			pendingRequests++;
+			responsesGuard.unlock();
+			try
+			{
+				client.get(device->ip(), device->port(), device->path(), [&, device](const std::shared_ptr<Http>& response, const std::string& error)
+				{
+					std::lock_guard<std::mutex> responsesGuard(responsesMutex);
+					if(!response) _bl->out.printDebug("Debug: Could not get additional SSDP information from " + device->location() + ": " + error);
+					responses.emplace_back(device, response);
+					responsesConditionVariable.notify_one();
+				}, 1000);
+				responsesGuard.lock();
+			}
+			catch(Exception& ex)
+			{
+				_bl->out.printDebug("Debug: Could not get additional SSDP information from " + device->location() + ": " + ex.what());
+				responsesGuard.lock();
+				pendingRequests--;
+			}
+		}
+		if(pendingRequests == 0) continue;
+
+		responsesConditionVariable.wait(responsesGuard, [&] { return !responses.empty(); });
+		std::vector<std::pair<SsdpInfo*, std::shared_ptr<Http>>> currentResponses;
+		currentResponses.swap(responses);
+		pendingRequests -= currentResponses.size();
+		responsesGuard.unlock();
+
+		//The XML is parsed while further responses are received.
+		for(auto& response : currentResponses)
+		{
+			SsdpInfo* device = response.first;
+			if(!response.second || response.second->getHeader().responseCode != 200 || response.second->getContentSize() == 0) continue;
+			try
+			{
+				PVariable infoStruct = parseDeviceInfo(response.second->getContent().data());
+				if(!infoStruct) continue;
+				device->setInfo(infoStruct);
+
+				int64_t time = HelperFunctions::getTime();
+				std::lock_guard<std::mutex> deviceInfoCacheGuard(_deviceInfoCacheMutex);
+				if(_deviceInfoCache.size() >= 1000)
+				{
+					for(auto entryIterator = _deviceInfoCache.begin(); entryIterator != _deviceInfoCache.end();)
+					{
+						if(entryIterator->second.expirationTime <= time) entryIterator = _deviceInfoCache.erase(entryIterator);
+						else ++entryIterator;
+					}
+					if(_deviceInfoCache.size() >= 1000) continue;
+				}
+				DeviceInfoCacheEntry& entry = _deviceInfoCache[device->location()];
+				entry.expirationTime = time + (int64_t)getMaxAge(device->getField("cache-control")) * 1000;
+				entry.info = infoStruct;
+			}
+			catch(const std::exception& ex)
+			{
+				_bl->out.printDebug("Debug: Could not parse SSDP information from " + device->location() + ": " + ex.what());
+			}
+		}
+		responsesGuard.lock();
+	}
+}
+
 void Ssdp::getDeviceInfo(std::map<std::string, SsdpInfo>& info, std::vector<SsdpInfo>& devices)
 {
 	try
 	{
-		devices.reserve(info.size());
+		std::vector<SsdpInfo*> validDevices;
+		std::vector<SsdpInfo*> uncachedDevices;
+		validDevices.reserve(info.size());
+		int64_t time = HelperFunctions::getTime();
 		for(auto& currentInfo : info)
-        {
+		{
+			if(!parseLocation(currentInfo.second)) continue;
 			std::string location = currentInfo.second.location();
-            std::string::size_type posSlash = location.find('/');
-			std::string::size_type posPort = location.find_last_of(':');
-			if(posSlash == std::string::npos || posSlash >= posPort || posPort == std::string::npos) return;
-			std::string::size_type posPath = location.find('/', posPort);
-			if(posPath == std::string::npos) posPath = location.size();
-			std::string ip = location.substr(posSlash + 2, posPort - posSlash - 2);
-			std::string portString = location.substr(posPort + 1, posPath - posPort - 1);
-			int32_t port = Math::getNumber(portString, false);
-			if(port <= 0 || port > 65535) return;
-			std::string path = posPath == location.size() ? "/" : location.substr(posPath);
-
-			currentInfo.second.setIp(ip);
-			currentInfo.second.setPort(port);
-			currentInfo.second.setPath(path);
-
-			HttpClient client(_bl, ip, port, false);
-            client.setTimeout(1000);
-			std::string xml;
-            try
-            {
-                client.get(path, xml);
-            }
-            catch(Exception& ex)
-            {
-                _bl->out.printDebug("Debug: Could not get additional SSDP information from " + location);
-            }
-
-			PVariable infoStruct;
-			if(!xml.empty())
+			validDevices.push_back(&currentInfo.second);
+
 			{
-				xml_document<> doc;
-				doc.parse<parse_no_entity_translation | parse_validate_closing_tags>(&xml.at(0));
-				xml_node<>* node = doc.first_node("root");
-				if(node)
+				std::lock_guard<std::mutex> deviceInfoCacheGuard(_deviceInfoCacheMutex);
+				auto entryIterator = _deviceInfoCache.find(location);
+				if(entryIterator != _deviceInfoCache.end())
 				{
-					node = node->first_node("device");
-					if(node)
+					if(entryIterator->second.expirationTime > time)
 					{
-						infoStruct.reset(new Variable(node));
-						currentInfo.second.setInfo(infoStruct);
+						currentInfo.second.setInfo(entryIterator->second.info);
+						continue;
 					}
+					_deviceInfoCache.erase(entryIterator);
 				}
 			}
+			uncachedDevices.push_back(&currentInfo.second);
+		}
+
+		if(!uncachedDevices.empty()) fetchDeviceInfo(uncachedDevices);
 
-			devices.push_back(currentInfo.second);
+		devices.reserve(devices.size() + validDevices.size());
+		for(auto& device : validDevices)
+		{
+			devices.push_back(*device);
 		}
 	}
 	catch(const std::exception& ex)
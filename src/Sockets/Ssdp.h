@@ -40,6 +40,7 @@
 #include <set>
 #include <unordered_map>
 #include <atomic>
+#include <mutex>
 
 namespace BaseLib
 {
@@ -57,6 +58,7 @@ public:
 	void setIp(std::string value) { _ip = value; }
 	int32_t port() { return _port; }
 	void setPort(int32_t value) { _port = value; }
+	std::string path() { return _path; }
 	void setPath(std::string value) { _path = value; }
 	std::string location() { return _location; }
 	void setLocation(std::string value) { _location = value; }
@@ -67,7 +69,7 @@ public:
     std::unordered_map<std::string, std::string>& getFields() { return _fields; };
 private:
 	std::string _ip;
-	int32_t _port;
+	int32_t _port = 0;
 	std::string _path;
 	std::string _location;
 	PVariable _info;
@@ -76,6 +78,7 @@ private:
 
 class Ssdp
 {
+	friend class SsdpMonitor;
 public:
 	Ssdp(BaseLib::SharedObjects* baseLib);
 	virtual ~Ssdp();
@@ -98,15 +101,65 @@ public:
 	 * @param[in] abort When set to true during the search, the search is aborted.
 	 */
 	void searchDevicesPassive(const std::string& stHeader, uint32_t timeout, std::vector<SsdpInfo>& devices, std::atomic_bool& abort);
+
+	/**
+	 * Sets the maximum number of device descriptions requested at the same time after a search.
+	 *
+	 * @param value The number of requests. The default is 8.
+	 */
+	void setMaxConcurrentRequests(uint32_t value) { _maxConcurrentRequests = value == 0 ? 1 : value; }
+
+	/**
+	 * Removes all device descriptions from the cache. Device descriptions are cached by location for all Ssdp objects for the time given in the
+	 * "max-age" directive of the CACHE-CONTROL header of the search response or announcement.
+	 */
+	static void clearDeviceInfoCache();
 private:
+	struct DeviceInfoCacheEntry
+	{
+		int64_t expirationTime = 0;
+		PVariable info;
+	};
+
+	static std::mutex _deviceInfoCacheMutex;
+	static std::unordered_map<std::string, DeviceInfoCacheEntry> _deviceInfoCache;
+
 	BaseLib::SharedObjects* _bl = nullptr;
 	std::string _address;
+	std::atomic<uint32_t> _maxConcurrentRequests{8};
 
 	void getAddress();
 	void sendSearchBroadcast(std::shared_ptr<FileDescriptor>& serverSocketDescriptor, const std::string& stHeader, uint32_t timeout);
 	void processPacket(Http& http, const std::string& stHeader, std::map<std::string, SsdpInfo>& info);
 	void processPacketPassive(Http& http, const std::string& stHeader, std::map<std::string, SsdpInfo>& info);
 	void getDeviceInfo(std::map<std::string, SsdpInfo>& info, std::vector<SsdpInfo>& devices);
+
+	/**
+	 * Requests the device descriptions of multiple devices concurrently, sets the parsed descriptions and stores them in the cache.
+	 */
+	void fetchDeviceInfo(std::vector<SsdpInfo*>& devices);
+
+	/**
+	 * Parses the "device" element of a device description.
+	 *
+	 * @param xml The null terminated XML. It is modified by the parser.
+	 * @return Returns the device information or nullptr when the XML doesn't contain a device description.
+	 */
+	PVariable parseDeviceInfo(char* xml);
+
+	/**
+	 * Returns the "max-age" directive of a CACHE-CONTROL header in seconds.
+	 *
+	 * @return Returns the value or 1800 (the minimum recommended by the UPnP device architecture) when there is no valid directive.
+	 */
+	static int32_t getMaxAge(const std::string& cacheControl);
+
+	/**
+	 * Sets IP address, port and path of a device from its location.
+	 *
+	 * @return Returns false when the location is invalid.
+	 */
+	static bool parseLocation(SsdpInfo& info);
 	std::shared_ptr<FileDescriptor> getSocketDescriptor(int32_t port, bool bindToMulticast);
 };
 
@@ -0,0 +1,398 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * 
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#include "SsdpMonitor.h"
+#include "../BaseLib.h"
+
+#include <poll.h>
+
+namespace BaseLib
+{
+
+SsdpMonitor::SsdpMonitor()
+{
+}
+
+SsdpMonitor::~SsdpMonitor()
+{
+	stop();
+}
+
+void SsdpMonitor::init(BaseLib::SharedObjects* baseLib)
+{
+	_bl = baseLib;
+}
+
+void SsdpMonitor::start()
+{
+	try
+	{
+		std::lock_guard<std::mutex> startGuard(_startMutex);
+		if(!_bl) return;
+		if(_running)
+		{
+			if(!_stopThread) return;
+			if(std::this_thread::get_id() == _listenThread.get_id())
+			{
+				//stop() and start() were called from a callback. The thread just keeps running.
+				_stopThread = false;
+				return;
+			}
+			//stop() was called from a callback, so the thread was not joined yet.
+			_bl->threadManager.join(_listenThread);
+			_running = false;
+		}
+		//Created here as the settings are not loaded yet when init() is called.
+		if(!_ssdp) _ssdp.reset(new Ssdp(_bl));
+		_stopThread = false;
+		_running = _bl->threadManager.start(_listenThread, true, &SsdpMonitor::listen, this);
+		if(!_running) _bl->out.printError("Error: Could not start SSDP monitor.");
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+void SsdpMonitor::stop()
+{
+	try
+	{
+		std::lock_guard<std::mutex> startGuard(_startMutex);
+		if(!_running) return;
+		_stopThread = true;
+		//The thread can't join itself when stop() is called from a callback. It exits after the callback returns and is joined by the next call to start()
+		//or stop(). Until then isRunning() returns false already.
+		if(std::this_thread::get_id() != _listenThread.get_id())
+		{
+			_bl->threadManager.join(_listenThread);
+			_running = false;
+		}
+
+		std::lock_guard<std::mutex> devicesGuard(_devicesMutex);
+		_devices.clear();
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+}
+
+std::vector<SsdpInfo> SsdpMonitor::getDevices(const std::string& notificationType)
+{
+	std::vector<SsdpInfo> devices;
+	try
+	{
+		if(!isRunning()) start();
+
+		std::lock_guard<std::mutex> devicesGuard(_devicesMutex);
+		devices.reserve(_devices.size());
+		for(auto& device : _devices)
+		{
+			if(notificationType == "ssdp:all" || device.second.info.getField("nt") == notificationType) devices.push_back(device.second.info);
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return devices;
+}
+
+int32_t SsdpMonitor::subscribe(const std::string& notificationType, ChangeCallback callback, bool sendCurrentDevices)
+{
+	try
+	{
+		if(!callback) return -1;
+		if(!isRunning()) start();
+
+		int32_t id = -1;
+		std::vector<SsdpInfo> devices;
+		{
+			//The monitor thread holds the subscription lock while changing the table and copying the subscriptions. So registering the subscription and
+			//copying the table at once makes sure no change is missed or reported twice.
+			std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+			id = _currentSubscriptionId++;
+			Subscription& subscription = _subscriptions[id];
+			subscription.notificationType = notificationType;
+			subscription.callback = callback;
+
+			if(sendCurrentDevices)
+			{
+				std::lock_guard<std::mutex> devicesGuard(_devicesMutex);
+				for(auto& device : _devices)
+				{
+					if(notificationType == "ssdp:all" || device.second.info.getField("nt") == notificationType) devices.push_back(device.second.info);
+				}
+			}
+		}
+
+		//Called without holding the lock, so the callback can call subscribe(), unsubscribe() or stop().
+		for(auto& device : devices)
+		{
+			try
+			{
+				callback(Event::added, device);
+			}
+			catch(const std::exception& ex)
+			{
+				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+			}
+		}
+		return id;
+	}
+	catch(const std::exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(Exception& ex)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+	}
+	catch(...)
+	{
+		_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+	}
+	return -1;
+}
+
+void SsdpMonitor::unsubscribe(int32_t id)
+{
+	std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+	_subscriptions.erase(id);
+}
+
+void SsdpMonitor::listen()
+{
+	char buffer[4096];
+	int64_t lastSocketAttempt = 0;
+	int64_t lastExpirationCheck = HelperFunctions::getTime();
+	Http http;
+	std::vector<Change> changes;
+	while(!_stopThread)
+	{
+		try
+		{
+			if(!_socketDescriptor || _socketDescriptor->descriptor == -1)
+			{
+				//Retried, because the network might not be up yet when the monitor is started.
+				if(HelperFunctions::getTime() - lastSocketAttempt < 30000)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(100));
+					continue;
+				}
+				lastSocketAttempt = HelperFunctions::getTime();
+				_socketDescriptor = _ssdp->getSocketDescriptor(1900, true);
+				if(!_socketDescriptor || _socketDescriptor->descriptor == -1) continue;
+				if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: SSDP monitor: Listening for NOTIFY packets.");
+			}
+
+			int64_t time = HelperFunctions::getTime();
+			if(time - lastExpirationCheck >= 1000)
+			{
+				lastExpirationCheck = time;
+				std::map<int32_t, Subscription> subscriptions;
+				{
+					std::lock_guard<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+					removeExpiredDevices(changes);
+					if(!changes.empty()) subscriptions = _subscriptions;
+				}
+				raiseChanges(changes, subscriptions);
+			}
+
+			pollfd pollInfo{};
+			pollInfo.fd = _socketDescriptor->descriptor;
+			pollInfo.events = POLLIN;
+			int32_t result = poll(&pollInfo, 1, 100);
+			if(result == 0 || (result == -1 && errno == EINTR)) continue;
+			if(result == -1 || (pollInfo.revents & (POLLERR | POLLNVAL)))
+			{
+				_bl->out.printError("Error: SSDP monitor: Socket closed.");
+				_bl->fileDescriptorManager.shutdown(_socketDescriptor);
+				continue;
+			}
+
+			//Read all queued packets before waiting again.
+			std::map<int32_t, Subscription> subscriptions;
+			std::unique_lock<std::mutex> subscriptionsGuard(_subscriptionsMutex);
+			while(true)
+			{
+				int32_t bytesReceived = recv(_socketDescriptor->descriptor, buffer, sizeof(buffer), MSG_DONTWAIT);
+				if(bytesReceived <= 0) break;
+				if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: SSDP monitor: Packet received:\n" + std::string(buffer, bytesReceived));
+				try
+				{
+					http.reset();
+					http.process(buffer, bytesReceived, false);
+					if(http.headerIsFinished()) processPacket(http, changes);
+				}
+				catch(const std::exception& ex)
+				{
+					if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: SSDP monitor: Could not parse packet: " + std::string(ex.what()));
+				}
+			}
+			if(!changes.empty()) subscriptions = _subscriptions;
+			subscriptionsGuard.unlock();
+			raiseChanges(changes, subscriptions);
+		}
+		catch(const std::exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(Exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(...)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+		}
+	}
+	_bl->fileDescriptorManager.shutdown(_socketDescriptor);
+	_socketDescriptor.reset();
+}
+
+void SsdpMonitor::processPacket(Http& http, std::vector<Change>& changes)
+{
+	if(http.getHeader().method != "NOTIFY") return;
+	std::string usn = http.getHeaderField("usn");
+	std::string notificationType = http.getHeaderField("nt");
+	std::string subType = http.getHeaderField("nts");
+	if(usn.empty() || notificationType.empty()) return;
+
+	if(subType == "ssdp:byebye")
+	{
+		std::lock_guard<std::mutex> devicesGuard(_devicesMutex);
+		auto deviceIterator = _devices.find(usn);
+		if(deviceIterator == _devices.end()) return;
+		changes.push_back(Change{Event::removed, notificationType, deviceIterator->second.info});
+		_devices.erase(deviceIterator);
+	}
+	else if(subType == "ssdp:alive" || subType == "ssdp:update")
+	{
+		SsdpInfo info;
+		info.setLocation(http.getHeaderField("location"));
+		if(!Ssdp::parseLocation(info)) return;
+		for(auto& field : http.getHeaderFields())
+		{
+			info.addField(field.first, field.second);
+		}
+
+		std::lock_guard<std::mutex> devicesGuard(_devicesMutex);
+		auto deviceIterator = _devices.find(usn);
+		if(deviceIterator == _devices.end())
+		{
+			//"ssdp:update" has no CACHE-CONTROL header, so unknown devices are added by their next "ssdp:alive".
+			if(subType == "ssdp:update") return;
+			if(_devices.size() >= 10000)
+			{
+				_bl->out.printWarning("Warning: SSDP monitor: Device table is full. Ignoring announcement of " + usn + ".");
+				return;
+			}
+			Device& device = _devices[usn];
+			device.expirationTime = HelperFunctions::getTime() + (int64_t)Ssdp::getMaxAge(http.getHeaderField("cache-control")) * 1000;
+			device.info = info;
+			changes.push_back(Change{Event::added, notificationType, info});
+		}
+		else
+		{
+			if(subType == "ssdp:alive") deviceIterator->second.expirationTime = HelperFunctions::getTime() + (int64_t)Ssdp::getMaxAge(http.getHeaderField("cache-control")) * 1000;
+			bool locationChanged = deviceIterator->second.info.location() != info.location();
+			deviceIterator->second.info = info;
+			if(locationChanged) changes.push_back(Change{Event::changed, notificationType, info});
+		}
+	}
+}
+
+void SsdpMonitor::removeExpiredDevices(std::vector<Change>& changes)
+{
+	int64_t time = HelperFunctions::getTime();
+	std::lock_guard<std::mutex> devicesGuard(_devicesMutex);
+	for(auto deviceIterator = _devices.begin(); deviceIterator != _devices.end();)
+	{
+		if(deviceIterator->second.expirationTime <= time)
+		{
+			changes.push_back(Change{Event::expired, deviceIterator->second.info.getField("nt"), deviceIterator->second.info});
+			deviceIterator = _devices.erase(deviceIterator);
+		}
+		else ++deviceIterator;
+	}
+}
+
+void SsdpMonitor::raiseChanges(std::vector<Change>& changes, const std::map<int32_t, Subscription>& subscriptions)
+{
+	if(changes.empty()) return;
+	for(auto& change : changes)
+	{
+		for(auto& subscription : subscriptions)
+		{
+			if(subscription.second.notificationType != "ssdp:all" && subscription.second.notificationType != change.notificationType) continue;
+			try
+			{
+				subscription.second.callback(change.event, change.info);
+			}
+			catch(const std::exception& ex)
+			{
+				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+			}
+			catch(...)
+			{
+				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+			}
+		}
+	}
+	changes.clear();
+}
+
+}
@@ -0,0 +1,180 @@
+/* Copyright 2013-2017 Sathya Laufer
+ *
+ * libhomegear-base is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ * 
+ * libhomegear-base is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ * 
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with libhomegear-base.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ * 
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ * You must obey the GNU Lesser General Public License in all respects
+ * for all of the code used other than OpenSSL.  If you modify
+ * file(s) with this exception, you may extend this exception to your
+ * version of the file(s), but you are not obligated to do so.  If you
+ * do not wish to do so, delete this exception statement from your
+ * version.  If you delete this exception statement from all source
+ * files in the program, then also delete it here.
+*/
+
+#ifndef SSDPMONITOR_H_
+#define SSDPMONITOR_H_
+
+#include "Ssdp.h"
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace BaseLib
+{
+
+class SharedObjects;
+class FileDescriptor;
+
+/**
+ * Long-running passive SSDP listener shared by all device families. The monitor joins the SSDP multicast group once and keeps a table of all devices
+ * announced by NOTIFY packets. Entries are identified by their USN. They are added or refreshed by "ssdp:alive" and "ssdp:update" and removed by
+ * "ssdp:byebye" or when the "max-age" of the CACHE-CONTROL header expires. Unlike Ssdp::searchDevicesPassive() querying the table doesn't open a socket
+ * or wait for announcements.
+ *
+ * The monitor is started by the first call to start(), getDevices() or subscribe().
+ *
+ * @see Ssdp
+ */
+class SsdpMonitor
+{
+public:
+	enum class Event
+	{
+		added,
+		changed,
+		removed,
+		expired
+	};
+
+	/**
+	 * Called when a device is added to or removed from the table or when its location changes.
+	 *
+	 * @param event The type of the change.
+	 * @param device The device. For "removed" and "expired" the last known information is passed.
+	 */
+	typedef std::function<void(Event event, SsdpInfo device)> ChangeCallback;
+
+	SsdpMonitor();
+	virtual ~SsdpMonitor();
+
+	void init(BaseLib::SharedObjects* baseLib);
+
+	/**
+	 * Joins the SSDP multicast group and starts listening. Does nothing when the monitor is already running.
+	 */
+	void start();
+
+	/**
+	 * Stops listening and clears the device table. When called from a callback, the monitor thread exits after the callback returns.
+	 */
+	void stop();
+
+	/**
+	 * Returns false when the monitor was not started or stop() was called, even when stop() was called from a callback and the thread is still exiting.
+	 */
+	bool isRunning() { return _running && !_stopThread; }
+
+	/**
+	 * Returns the devices currently announced on the network. The returned objects have IP address, port, path, location and all header fields of the
+	 * last announcement set. The device description is not requested.
+	 *
+	 * @param notificationType The NT header to filter for (e. g. urn:schemas-upnp-org:device:basic:1) or "ssdp:all" to return all devices.
+	 * @return Returns the matching devices.
+	 */
+	std::vector<SsdpInfo> getDevices(const std::string& notificationType);
+
+	/**
+	 * Registers a callback for changes of the device table. The callback is called from the monitor thread, so it should return quickly.
+	 *
+	 * @param notificationType The NT header to filter for or "ssdp:all" to receive changes of all devices.
+	 * @param callback The callback to call.
+	 * @param sendCurrentDevices When set to true, "added" is called immediately on the calling thread for all devices already in the table. Changes
+	 * happening meanwhile might be reported on the monitor thread before these calls are completed.
+	 * @return Returns the ID of the subscription, which is needed to unsubscribe.
+	 */
+	int32_t subscribe(const std::string& notificationType, ChangeCallback callback, bool sendCurrentDevices = true);
+
+	/**
+	 * Removes a subscription. Changes already being reported on the monitor thread can still be passed to the callback once when this method is not called
+	 * from the callback itself. After that the callback is not called anymore.
+	 *
+	 * @param id The ID returned by subscribe().
+	 */
+	void unsubscribe(int32_t id);
+private:
+	struct Device
+	{
+		int64_t expirationTime = 0;
+		SsdpInfo info;
+	};
+
+	struct Subscription
+	{
+		std::string notificationType;
+		ChangeCallback callback;
+	};
+
+	struct Change
+	{
+		Event event;
+		std::string notificationType;
+		SsdpInfo info;
+	};
+
+	BaseLib::SharedObjects* _bl = nullptr;
+	std::unique_ptr<Ssdp> _ssdp;
+	std::shared_ptr<FileDescriptor> _socketDescriptor;
+
+	std::mutex _startMutex;
+	std::atomic_bool _running{false};
+	std::atomic_bool _stopThread{false};
+	std::thread _listenThread;
+
+	std::mutex _devicesMutex;
+	std::unordered_map<std::string, Device> _devices;
+
+	//Held while the device table is changed and the subscriptions are copied, but never while callbacks are called.
+	std::mutex _subscriptionsMutex;
+	int32_t _currentSubscriptionId = 0;
+	std::map<int32_t, Subscription> _subscriptions;
+
+	void listen();
+	void processPacket(Http& http, std::vector<Change>& changes);
+	void removeExpiredDevices(std::vector<Change>& changes);
+
+	/**
+	 * Calls the callbacks of the subscriptions for all changes and clears "changes". "_subscriptionsMutex" must not be locked, so callbacks can call
+	 * subscribe(), unsubscribe() or stop().
+	 *
+	 * @param changes The collected changes.
+	 * @param subscriptions A copy of the subscriptions made while the changes were collected.
+	 */
+	void raiseChanges(std::vector<Change>& changes, const std::map<int32_t, Subscription>& subscriptions);
+};
+
+}
+#endif
@@ -29,11 +29,20 @@
 */
 
 #include <gnutls/gnutls.h>
+#if GNUTLS_VERSION_NUMBER >= 0x030703
+#include <gnutls/socket.h>
+#endif
 #include "../BaseLib.h"
 #include "TcpSocket.h"
 
 namespace BaseLib
 {
+std::mutex TcpSocket::_tlsSessionCacheMutex;
+std::unordered_map<std::string, std::vector<uint8_t>> TcpSocket::_tlsSessionCache;
+std::mutex TcpSocket::_dnsCacheMutex;
+std::unordered_map<std::string, TcpSocket::DnsCacheEntry> TcpSocket::_dnsCache;
+std::atomic<int32_t> TcpSocket::_dnsCacheTtl{60};
+
 TcpSocket::TcpSocket(BaseLib::SharedObjects* baseLib)
 {
 	_bl = baseLib;
@@ -156,11 +165,32 @@ TcpSocket::TcpSocket(BaseLib::SharedObjects* baseLib, TcpServerInfo& serverInfo)
 	_dhParamFile = serverInfo.dhParamFile;
 	_dhParamData = serverInfo.dhParamData;
 	_requireClientCert = serverInfo.requireClientCert;
+	_useSessionTickets = serverInfo.useSessionTickets;
+	_sessionTicketKeyLifetime = serverInfo.sessionTicketKeyLifetime;
+	_connectionIdleTimeout = serverInfo.connectionIdleTimeout;
+	_tlsHandshakeTimeout = serverInfo.tlsHandshakeTimeout;
+	_sendQueueStallTimeout = serverInfo.sendQueueStallTimeout;
+	_useSendQueue = serverInfo.useSendQueue;
+	_sendQueueHighWatermark = serverInfo.sendQueueHighWatermark;
+	_sendQueueLowWatermark = serverInfo.sendQueueLowWatermark < serverInfo.sendQueueHighWatermark ? serverInfo.sendQueueLowWatermark : serverInfo.sendQueueHighWatermark;
+	_slowClientPolicy = serverInfo.slowClientPolicy;
 	_newConnectionCallback.swap(serverInfo.newConnectionCallback);
     _connectionClosedCallback.swap(serverInfo.connectionClosedCallback);
 	_packetReceivedCallback.swap(serverInfo.packetReceivedCallback);
+	_packetViewReceivedCallback.swap(serverInfo.packetViewReceivedCallback);
+	_unixPeerCredentialsCallback.swap(serverInfo.unixPeerCredentialsCallback);
 
+    //At most one read per server thread is in progress at any time, so one slab is enough unless clients are read from elsewhere.
+    _receiveBufferPool.reset(new ReceiveBufferPool(serverInfo.receiveBufferSize > 0 ? serverInfo.receiveBufferSize : 16384, serverInfo.serverThreads > 0 ? serverInfo.serverThreads : 1));
     _serverThreads.resize(serverInfo.serverThreads);
+    _serverShards.reserve(serverInfo.serverThreads);
+    for(uint32_t i = 0; i < serverInfo.serverThreads; i++)
+    {
+        PServerShard shard = std::make_shared<ServerShard>();
+        shard->index = i;
+        shard->nextClientId = i;
+        _serverShards.push_back(shard);
+    }
 }
 
 TcpSocket::~TcpSocket()
@@ -172,14 +202,18 @@ TcpSocket::~TcpSocket()
     }
 
 	_bl->fileDescriptorManager.close(_socketDescriptor);
+    closeListeners();
     freeCredentials();
 	if(_tlsPriorityCache) gnutls_priority_deinit(_tlsPriorityCache);
 	if(_dhParams) gnutls_dh_params_deinit(_dhParams);
+	std::lock_guard<std::mutex> sessionTicketKeyGuard(_sessionTicketKeyMutex);
+	freeSessionTicketKey();
 }
 
 std::string TcpSocket::getIpAddress()
 {
 	if(!_ipAddress.empty()) return _ipAddress;
+	if(isUnixSocketPath(_hostname)) return _hostname;
 	_ipAddress = Net::resolveHostname(_hostname);
 	return _ipAddress;
 }
@@ -188,7 +222,44 @@ std::string TcpSocket::getIpAddress()
 // {{{ Server
 	void TcpSocket::bindSocket()
 	{
-		_socketDescriptor = bindAndReturnSocket(_bl->fileDescriptorManager, _listenAddress, _listenPort, _ipAddress, _boundListenPort);
+		for(auto& shard : _serverShards)
+		{
+			bindSocket(shard);
+		}
+	}
+
+	void TcpSocket::bindSocket(PServerShard& shard)
+	{
+		if(isUnixSocketPath(_listenAddress) && shard->index > 0)
+		{
+			//SO_REUSEPORT doesn't work for Unix domain sockets, so all shards accept on the listening socket of the first one.
+			std::lock_guard<std::mutex> socketDescriptorGuard(_socketDescriptorMutex);
+			PServerShard& firstShard = _serverShards.front();
+			if(!firstShard->socketDescriptor || firstShard->socketDescriptor->descriptor == -1) return;
+			shard->socketDescriptor = _bl->fileDescriptorManager.add(dup(firstShard->socketDescriptor->descriptor));
+			return;
+		}
+
+		//When a dynamically assigned port was requested, the other shards need to listen on the port assigned to the first one.
+		std::string port = (_listenPort == "0" && _boundListenPort > 0) ? std::to_string(_boundListenPort) : _listenPort;
+		PFileDescriptor socketDescriptor = bindAndReturnSocket(_bl->fileDescriptorManager, _listenAddress, port, _ipAddress, _boundListenPort, _serverShards.size() > 1);
+		std::lock_guard<std::mutex> socketDescriptorGuard(_socketDescriptorMutex);
+		shard->socketDescriptor = socketDescriptor;
+		if(isUnixSocketPath(_listenAddress)) _boundUnixSocketPath = _listenAddress;
+	}
+
+	void TcpSocket::closeListeners()
+	{
+		std::lock_guard<std::mutex> socketDescriptorGuard(_socketDescriptorMutex);
+		for(auto& shard : _serverShards)
+		{
+			_bl->fileDescriptorManager.close(shard->socketDescriptor);
+		}
+		if(!_boundUnixSocketPath.empty())
+		{
+			unlink(_boundUnixSocketPath.c_str());
+			_boundUnixSocketPath.clear();
+		}
 	}
 
 	void TcpSocket::startServer(std::string address, std::string port, std::string& listenAddress)
@@ -200,11 +271,12 @@ std::string TcpSocket::getIpAddress()
 		_stopServer = false;
 		_listenAddress = address;
 		_listenPort = port;
+		_boundListenPort = -1;
 		bindSocket();
 		listenAddress = _ipAddress;
-        for(auto& serverThread : _serverThreads)
+        for(uint32_t i = 0; i < _serverThreads.size(); i++)
         {
-            _bl->threadManager.start(serverThread, true, &TcpSocket::serverThread, this);
+            _bl->threadManager.start(_serverThreads[i], true, &TcpSocket::serverThread, this, i);
         }
 	}
 
@@ -217,12 +289,13 @@ std::string TcpSocket::getIpAddress()
 		_stopServer = false;
 		_listenAddress = address;
 		_listenPort = "0";
+		_boundListenPort = -1;
 		bindSocket();
 		listenAddress = _ipAddress;
 		listenPort = _boundListenPort;
-        for(auto& serverThread : _serverThreads)
+        for(uint32_t i = 0; i < _serverThreads.size(); i++)
         {
-            _bl->threadManager.start(serverThread, true, &TcpSocket::serverThread, this);
+            _bl->threadManager.start(_serverThreads[i], true, &TcpSocket::serverThread, this, i);
         }
 	}
 
@@ -240,6 +313,7 @@ std::string TcpSocket::getIpAddress()
         }
 
 		_bl->fileDescriptorManager.close(_socketDescriptor);
+        closeListeners();
         freeCredentials();
 		if(_tlsPriorityCache) gnutls_priority_deinit(_tlsPriorityCache);
 		if(_dhParams) gnutls_dh_params_deinit(_dhParams);
@@ -322,7 +396,7 @@ std::string TcpSocket::getIpAddress()
 			throw SocketSSLException("Error: Could not initiate TLS connection. _x509Credentials is empty.");
 		}
 		int32_t result = 0;
-		if((result = gnutls_init(&fileDescriptor->tlsSession, GNUTLS_SERVER)) != GNUTLS_E_SUCCESS)
+		if((result = gnutls_init(&fileDescriptor->tlsSession, GNUTLS_SERVER | GNUTLS_NO_SIGNAL)) != GNUTLS_E_SUCCESS)
 		{
 			fileDescriptor->tlsSession = nullptr;
 			_bl->fileDescriptorManager.shutdown(fileDescriptor);
@@ -342,6 +416,30 @@ std::string TcpSocket::getIpAddress()
 			throw SocketSSLException("Error: Could not set cipher priority on TLS session: " + std::string(gnutls_strerror(result)));
 		}
 
+		if(_useSessionTickets)
+		{
+			std::lock_guard<std::mutex> sessionTicketKeyGuard(_sessionTicketKeyMutex);
+			int64_t time = HelperFunctions::getTimeSeconds();
+			if(!_sessionTicketKey.data || time - _sessionTicketKeyCreationTime >= _sessionTicketKeyLifetime)
+			{
+				//The key is copied into the session, so established sessions are not affected. Tickets issued with the old key can't be decrypted anymore
+				//though, so their clients do one full handshake. Tickets expire after half the key lifetime (see below), so only tickets issued in the
+				//second half of the key lifetime are affected.
+				freeSessionTicketKey();
+				if((result = gnutls_session_ticket_key_generate(&_sessionTicketKey)) == GNUTLS_E_SUCCESS) _sessionTicketKeyCreationTime = time;
+				else
+				{
+					_sessionTicketKey = gnutls_datum_t{nullptr, 0};
+					_bl->out.printError("Error: Could not generate session ticket key: " + std::string(gnutls_strerror(result)));
+				}
+			}
+			if(_sessionTicketKey.data)
+			{
+				if((result = gnutls_session_ticket_enable_server(fileDescriptor->tlsSession, &_sessionTicketKey)) == GNUTLS_E_SUCCESS) gnutls_db_set_cache_expiration(fileDescriptor->tlsSession, _sessionTicketKeyLifetime > 1 ? _sessionTicketKeyLifetime / 2 : 1);
+				else _bl->out.printError("Error: Could not enable session tickets: " + std::string(gnutls_strerror(result)));
+			}
+		}
+
         gnutls_handshake_set_post_client_hello_function(fileDescriptor->tlsSession, &postClientHello);
 
 		gnutls_certificate_server_set_request(fileDescriptor->tlsSession, _requireClientCert ? GNUTLS_CERT_REQUIRE : GNUTLS_CERT_IGNORE);
@@ -351,46 +449,158 @@ std::string TcpSocket::getIpAddress()
 			throw SocketSSLException("Error setting TLS socket descriptor: Provided socket descriptor is invalid.");
 		}
 		gnutls_transport_set_ptr(fileDescriptor->tlsSession, (gnutls_transport_ptr_t)(uintptr_t)fileDescriptor->descriptor);
-		result = gnutls_handshake(fileDescriptor->tlsSession);
-		if(result < 0)
+
+		//The handshake is driven by the server thread's socket events, so a client not completing it doesn't block other clients.
+		if(fcntl(fileDescriptor->descriptor, F_SETFL, fcntl(fileDescriptor->descriptor, F_GETFL) | O_NONBLOCK) < 0)
 		{
 			_bl->fileDescriptorManager.shutdown(fileDescriptor);
-			throw SocketSSLException("TLS handshake has failed: " + std::string(gnutls_strerror(result)));
+			throw SocketOperationException("Could not set socket options: " + std::string(strerror(errno)));
 		}
 	}
 
+	void TcpSocket::continueTlsHandshake(PTcpClientData& clientData)
+	{
+		try
+		{
+			gnutls_session_t tlsSession = clientData->fileDescriptor->tlsSession;
+			int32_t descriptor = clientData->fileDescriptor->descriptor;
+			if(!tlsSession || descriptor == -1) throw SocketClosedException("Connection to client number " + std::to_string(clientData->id) + " closed.");
+
+			int32_t result = gnutls_handshake(tlsSession);
+			if(result == GNUTLS_E_AGAIN || result == GNUTLS_E_INTERRUPTED)
+			{
+				//Modifying the registration also reports the socket again when it is ready already, so no edge-triggered event can get lost.
+				epoll_event event{};
+				event.events = EPOLLRDHUP | EPOLLET | (gnutls_record_get_direction(tlsSession) == 1 ? EPOLLOUT : EPOLLIN);
+				event.data.u64 = (uint32_t)clientData->id;
+				if(epoll_ctl(clientData->epollDescriptor, EPOLL_CTL_MOD, descriptor, &event) == -1) throw SocketOperationException("Could not modify epoll registration: " + std::string(strerror(errno)));
+				return;
+			}
+			if(result < 0)
+			{
+				SocketMetrics::increment(_tcpServerMetrics.tlsHandshakeFailures);
+				throw SocketSSLException("TLS handshake has failed: " + std::string(gnutls_strerror(result)));
+			}
+			_tlsHandshakes++;
+			_tcpServerMetrics.tlsHandshakeTime.record(HelperFunctions::getTimeMicroseconds() - clientData->connectTimeMicroseconds);
+			if(gnutls_session_is_resumed(tlsSession)) _tlsResumedHandshakes++;
+
+			//The socket stays non-blocking, so writing the send queue never blocks the server thread. proofwrite() waits for the socket when GnuTLS
+			//returns GNUTLS_E_AGAIN, proofread() returns 0 and readClient() waits for the next EPOLLIN.
+			epoll_event event{};
+			event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+			event.data.u64 = (uint32_t)clientData->id;
+			if(epoll_ctl(clientData->epollDescriptor, EPOLL_CTL_MOD, descriptor, &event) == -1) throw SocketOperationException("Could not modify epoll registration: " + std::string(strerror(errno)));
+			clientData->lastActivity = HelperFunctions::getTime();
+			clientData->tlsHandshakePending = false;
+		}
+		catch(const std::exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+			closeClient(clientData);
+			return;
+		}
+		catch(BaseLib::Exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+			closeClient(clientData);
+			return;
+		}
+		catch(...)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+			closeClient(clientData);
+			return;
+		}
+
+		if(_newConnectionCallback) _newConnectionCallback(clientData->id, clientData->address, clientData->port);
+		//The client might have sent data together with the end of the handshake.
+		readClient(clientData);
+	}
+
 	void TcpSocket::readClient(PTcpClientData clientData)
 	{
+		uint8_t* buffer = nullptr;
 		try
 		{
 			int32_t bytesRead = 0;
-			bool moreData = true;
+			//Data can be buffered by GnuTLS without the socket being readable.
+			bool moreData = clientData->fileDescriptor->tlsSession && gnutls_record_check_pending(clientData->fileDescriptor->tlsSession) > 0;
+			int32_t bufferSize = _receiveBufferPool->bufferSize();
 
-			while(moreData)
+			while(true)
 			{
-				bytesRead = clientData->socket->proofread((char*)clientData->buffer.data(), clientData->buffer.size(), moreData);
+				//proofread() would wait for data, so only call it when the descriptor is readable. This also filters out events for data that was already
+				//read in a previous call.
+				if(!moreData)
+				{
+					pollfd pollInfo{ clientData->fileDescriptor->descriptor, (short)POLLIN, (short)0 };
+					if(pollInfo.fd == -1 || poll(&pollInfo, 1, 0) != 1) break;
+				}
+				if(!buffer) buffer = _receiveBufferPool->get();
+				bytesRead = clientData->socket->proofread((char*)buffer, bufferSize, moreData);
+				if(bytesRead == 0) break; //Incomplete TLS record
 
-				if(bytesRead > (signed)clientData->buffer.size()) bytesRead = clientData->buffer.size();
+				if(bytesRead > bufferSize) bytesRead = bufferSize;
+				clientData->lastActivity = HelperFunctions::getTime();
 
-				std::vector<uint8_t> bytesReceived(clientData->buffer.data(), clientData->buffer.data() + bytesRead);
-				if(_packetReceivedCallback) _packetReceivedCallback(clientData->id, bytesReceived);
+				if(_packetViewReceivedCallback)
+				{
+					TcpPacketView packet;
+					packet.data = buffer;
+					packet.size = bytesRead;
+					_packetViewReceivedCallback(clientData->id, packet);
+				}
+				else if(_packetReceivedCallback)
+				{
+					std::vector<uint8_t> bytesReceived(buffer, buffer + bytesRead);
+					_packetReceivedCallback(clientData->id, bytesReceived);
+				}
 			}
+			if(buffer) _receiveBufferPool->put(buffer);
+			return;
 		}
 		catch(const std::exception& ex)
 		{
-			_bl->fileDescriptorManager.close(clientData->fileDescriptor);
-            if(_connectionClosedCallback) _connectionClosedCallback(clientData->id);
 		}
 		catch(BaseLib::Exception& ex)
 		{
-			_bl->fileDescriptorManager.close(clientData->fileDescriptor);
-            if(_connectionClosedCallback) _connectionClosedCallback(clientData->id);
 		}
 		catch(...)
 		{
-			_bl->fileDescriptorManager.close(clientData->fileDescriptor);
-            if(_connectionClosedCallback) _connectionClosedCallback(clientData->id);
 		}
+		if(buffer) _receiveBufferPool->put(buffer);
+		closeClient(clientData);
+	}
+
+	TcpSocket::ReceiveBufferPool::ReceiveBufferPool(size_t bufferSize, size_t buffersPerSlab)
+	{
+		_bufferSize = bufferSize;
+		_buffersPerSlab = buffersPerSlab > 0 ? buffersPerSlab : 1;
+	}
+
+	uint8_t* TcpSocket::ReceiveBufferPool::get()
+	{
+		std::lock_guard<std::mutex> buffersGuard(_buffersMutex);
+		if(_freeBuffers.empty())
+		{
+			_slabs.emplace_back(new uint8_t[_bufferSize * _buffersPerSlab]);
+			uint8_t* slab = _slabs.back().get();
+			_freeBuffers.reserve(_slabs.size() * _buffersPerSlab);
+			for(size_t i = 0; i < _buffersPerSlab; i++)
+			{
+				_freeBuffers.push_back(slab + i * _bufferSize);
+			}
+		}
+		uint8_t* buffer = _freeBuffers.back();
+		_freeBuffers.pop_back();
+		return buffer;
+	}
+
+	void TcpSocket::ReceiveBufferPool::put(uint8_t* buffer)
+	{
+		std::lock_guard<std::mutex> buffersGuard(_buffersMutex);
+		_freeBuffers.push_back(buffer);
 	}
 
 	void TcpSocket::sendToClient(int32_t clientId, TcpPacket packet, bool closeConnection)
@@ -398,251 +608,851 @@ std::string TcpSocket::getIpAddress()
 		PTcpClientData clientData;
 		try
 		{
+			clientData = getClientData(clientId);
+			if(!clientData) return;
+
+			if(_useSendQueue)
 			{
-				std::lock_guard<std::mutex> clientsGuard(_clientsMutex);
-				auto clientIterator = _clients.find(clientId);
-				if(clientIterator == _clients.end()) return;
-				clientData = clientIterator->second;
+				queueData(clientData, packet.empty() ? std::shared_ptr<const std::vector<char>>() : std::make_shared<const std::vector<char>>(packet.begin(), packet.end()), closeConnection);
+				return;
 			}
 
 			clientData->socket->proofwrite((char*)packet.data(), packet.size());
+			clientData->lastActivity = HelperFunctions::getTime();
 			if(closeConnection)
 			{
-				_bl->fileDescriptorManager.close(clientData->fileDescriptor);
-				if(_connectionClosedCallback) _connectionClosedCallback(clientData->id);
+				closeClient(clientData);
 			}
 		}
 		catch(const std::exception& ex)
 		{
-			_bl->fileDescriptorManager.close(clientData->fileDescriptor);
-			if(_connectionClosedCallback) _connectionClosedCallback(clientData->id);
+			closeClient(clientData);
 		}
 		catch(BaseLib::Exception& ex)
 		{
-			_bl->fileDescriptorManager.close(clientData->fileDescriptor);
-			if(_connectionClosedCallback) _connectionClosedCallback(clientData->id);
+			closeClient(clientData);
 		}
 		catch(...)
 		{
-			_bl->fileDescriptorManager.close(clientData->fileDescriptor);
-			if(_connectionClosedCallback) _connectionClosedCallback(clientData->id);
+			closeClient(clientData);
 		}
 	}
 
-    int32_t TcpSocket::clientCount()
-    {
-        std::lock_guard<std::mutex> clientsGuard(_clientsMutex);
-        return _clients.size();
-    }
+	void TcpSocket::sendToClient(int32_t clientId, const TcpPacket& header, const char* data, size_t size, bool closeConnection)
+	{
+		PTcpClientData clientData;
+		try
+		{
+			clientData = getClientData(clientId);
+			if(!clientData) return;
+
+			std::unique_lock<std::mutex> sendQueueGuard(clientData->sendQueueMutex, std::defer_lock);
+			if(_useSendQueue)
+			{
+				if(header.size() + size <= _sendQueueHighWatermark)
+				{
+					std::shared_ptr<std::vector<char>> buffer = std::make_shared<std::vector<char>>();
+					buffer->reserve(header.size() + size);
+					buffer->insert(buffer->end(), header.begin(), header.end());
+					buffer->insert(buffer->end(), data, data + size);
+					queueData(clientData, buffer, closeConnection);
+					return;
+				}
+
+				//Too large to be copied. Keep the lock while writing, so nothing else is written in between.
+				sendQueueGuard.lock();
+				if(!drainSendQueue(clientData, sendQueueGuard)) throw SocketOperationException("Could not write send queue.");
+			}
+
+			//Cork plain and kTLS connections, so the header and the start of the data are sent in one segment.
+			int32_t socketDescriptor = clientData->fileDescriptor->descriptor;
+			bool cork = (!clientData->fileDescriptor->tlsSession || clientData->socket->kernelTlsSendEnabled()) && socketDescriptor != -1;
+			int32_t enable = 1;
+			if(cork) setsockopt(socketDescriptor, IPPROTO_TCP, TCP_CORK, &enable, sizeof(int32_t));
+			clientData->socket->proofwrite((char*)header.data(), header.size());
+			size_t totalBytesWritten = 0;
+			while(totalBytesWritten < size)
+			{
+				//proofwrite() doesn't accept more than 100 MiB at once.
+				int32_t bytesToWrite = size - totalBytesWritten > 16777216 ? 16777216 : size - totalBytesWritten;
+				clientData->socket->proofwrite(data + totalBytesWritten, bytesToWrite);
+				totalBytesWritten += bytesToWrite;
+			}
+			enable = 0;
+			if(cork) setsockopt(socketDescriptor, IPPROTO_TCP, TCP_CORK, &enable, sizeof(int32_t));
+			clientData->lastActivity = HelperFunctions::getTime();
+			if(closeConnection)
+			{
+				closeClient(clientData);
+			}
+		}
+		catch(const std::exception& ex)
+		{
+			closeClient(clientData);
+		}
+		catch(BaseLib::Exception& ex)
+		{
+			closeClient(clientData);
+		}
+		catch(...)
+		{
+			closeClient(clientData);
+		}
+	}
 
-	void TcpSocket::serverThread()
+	void TcpSocket::sendToClient(int32_t clientId, const TcpPacket& header, const std::shared_ptr<const std::vector<char>>& data, bool closeConnection)
 	{
-		int32_t result = 0;
-        int32_t socketDescriptor = -1;
-        std::map<int32_t, PTcpClientData> clients;
-		while(!_stopServer)
+		if(!_useSendQueue)
+		{
+			if(data) sendToClient(clientId, header, data->data(), data->size(), closeConnection);
+			else sendToClient(clientId, header, nullptr, 0, closeConnection);
+			return;
+		}
+
+		PTcpClientData clientData;
+		try
+		{
+			clientData = getClientData(clientId);
+			if(!clientData) return;
+
+			queueData(clientData, data, closeConnection, true, header.empty() ? std::shared_ptr<const std::vector<char>>() : std::make_shared<const std::vector<char>>(header.begin(), header.end()));
+		}
+		catch(const std::exception& ex)
+		{
+			closeClient(clientData);
+		}
+		catch(BaseLib::Exception& ex)
+		{
+			closeClient(clientData);
+		}
+		catch(...)
+		{
+			closeClient(clientData);
+		}
+	}
+
+	void TcpSocket::sendToClients(const std::vector<int32_t>& clientIds, const std::shared_ptr<const std::vector<char>>& packet)
+	{
+		if(!packet || packet->empty()) return;
+
+		std::vector<PTcpClientData> clients;
+		clients.reserve(clientIds.size());
+		for(auto clientId : clientIds)
+		{
+			PTcpClientData clientData = getClientData(clientId);
+			if(clientData) clients.push_back(clientData);
+		}
+
+		for(auto& clientData : clients)
 		{
 			try
 			{
-                {
-                    std::lock_guard<std::mutex> socketDescriptorGuard(_socketDescriptorMutex);
-                    if(!_socketDescriptor || _socketDescriptor->descriptor == -1)
-                    {
-                        if(_stopServer) break;
-                        std::this_thread::sleep_for(std::chrono::milliseconds(5000));
-                        bindSocket();
-                        continue;
-                    }
-                    socketDescriptor = _socketDescriptor->descriptor;
-                }
+				if(_useSendQueue)
+				{
+					queueData(clientData, packet, false, true);
+					continue;
+				}
 
-				timeval timeout;
-				timeout.tv_sec = 0;
-				timeout.tv_usec = 100000;
-				fd_set readFileDescriptor;
-				int32_t maxfd = 0;
-				FD_ZERO(&readFileDescriptor);
+				size_t totalBytesWritten = 0;
+				while(totalBytesWritten < packet->size())
 				{
-					auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
-					fileDescriptorGuard.lock();
-					maxfd = socketDescriptor;
-					FD_SET(socketDescriptor, &readFileDescriptor);
+					//proofwrite() doesn't accept more than 100 MiB at once.
+					int32_t bytesToWrite = packet->size() - totalBytesWritten > 16777216 ? 16777216 : packet->size() - totalBytesWritten;
+					clientData->socket->proofwrite(packet->data() + totalBytesWritten, bytesToWrite);
+					totalBytesWritten += bytesToWrite;
+				}
+				clientData->lastActivity = HelperFunctions::getTime();
+			}
+			catch(const std::exception& ex)
+			{
+				closeClient(clientData);
+			}
+			catch(BaseLib::Exception& ex)
+			{
+				closeClient(clientData);
+			}
+			catch(...)
+			{
+				closeClient(clientData);
+			}
+		}
+	}
 
+	void TcpSocket::sendFileToClient(int32_t clientId, const TcpPacket& header, int32_t fileDescriptor, off_t offset, size_t length, bool closeConnection)
+	{
+		PTcpClientData clientData;
+		try
+		{
+			clientData = getClientData(clientId);
+			if(!clientData) return;
+
+			std::unique_lock<std::mutex> sendQueueGuard(clientData->sendQueueMutex, std::defer_lock);
+			if(_useSendQueue)
+			{
+				sendQueueGuard.lock();
+				if(!drainSendQueue(clientData, sendQueueGuard)) throw SocketOperationException("Could not write send queue.");
+			}
+
+			int32_t socketDescriptor = clientData->fileDescriptor->descriptor;
+			bool cork = (!clientData->fileDescriptor->tlsSession || clientData->socket->kernelTlsSendEnabled()) && socketDescriptor != -1;
+			int32_t enable = 1;
+			if(cork) setsockopt(socketDescriptor, IPPROTO_TCP, TCP_CORK, &enable, sizeof(int32_t));
+			clientData->socket->proofwrite((char*)header.data(), header.size());
+			clientData->socket->proofsendfile(fileDescriptor, offset, length);
+			enable = 0;
+			if(cork) setsockopt(socketDescriptor, IPPROTO_TCP, TCP_CORK, &enable, sizeof(int32_t));
+			clientData->lastActivity = HelperFunctions::getTime();
+			if(closeConnection)
+			{
+				closeClient(clientData);
+			}
+		}
+		catch(const std::exception& ex)
+		{
+			closeClient(clientData);
+		}
+		catch(BaseLib::Exception& ex)
+		{
+			closeClient(clientData);
+		}
+		catch(...)
+		{
+			closeClient(clientData);
+		}
+	}
+
+	bool TcpSocket::clientKernelTlsSendEnabled(int32_t clientId)
+	{
+		PTcpClientData clientData = getClientData(clientId);
+		return clientData && clientData->socket->kernelTlsSendEnabled();
+	}
+
+    int32_t TcpSocket::clientCount()
+    {
+        int32_t count = 0;
+        for(auto& shard : _serverShards)
+        {
+            std::lock_guard<std::mutex> clientsGuard(shard->clientsMutex);
+            count += shard->clients.size();
+        }
+        return count;
+    }
+
+	TcpSocket::PTcpClientData TcpSocket::getClientData(int32_t clientId)
+	{
+		if(clientId < 0 || _serverShards.empty()) return PTcpClientData();
+		PServerShard& shard = _serverShards.at(clientId % _serverShards.size());
+		std::lock_guard<std::mutex> clientsGuard(shard->clientsMutex);
+		auto clientIterator = shard->clients.find(clientId);
+		if(clientIterator == shard->clients.end()) return PTcpClientData();
+		return clientIterator->second;
+	}
+
+	void TcpSocket::queueData(PTcpClientData& clientData, const std::shared_ptr<const std::vector<char>>& data, bool closeConnection, bool droppable, const std::shared_ptr<const std::vector<char>>& header)
+	{
+		bool close = false;
+		{
+			std::unique_lock<std::mutex> sendQueueGuard(clientData->sendQueueMutex);
+			if(clientData->closeAfterSend || clientData->fileDescriptor->descriptor == -1) return;
+
+			if(clientData->congested)
+			{
+				if(_slowClientPolicy == SlowClientPolicy::disconnect) close = true;
+				else if(_slowClientPolicy == SlowClientPolicy::drop && droppable)
+				{
+					//Only complete messages are dropped, so the framing of the stream stays intact.
+					SocketMetrics::increment(_tcpServerMetrics.droppedPackets);
+					if(closeConnection) clientData->closeAfterSend = true;
+					return;
+				}
+				else
+				{
+					//Write on this thread until the queue is below the low watermark. The lock is released while waiting, so the server thread can write as well.
+					int64_t endTime = HelperFunctions::getTime() + _writeTimeout / 1000;
+					while(true)
 					{
-						for(auto& client : clients)
+						if(!flushSendQueue(clientData))
+						{
+							close = true;
+							break;
+						}
+						if(!clientData->congested) break;
+						int64_t timeout = endTime - HelperFunctions::getTime();
+						if(timeout <= 0)
 						{
-							if(!client.second->fileDescriptor || client.second->fileDescriptor->descriptor == -1) continue;
-							FD_SET(client.second->fileDescriptor->descriptor, &readFileDescriptor);
-							if(client.second->fileDescriptor->descriptor > maxfd) maxfd = client.second->fileDescriptor->descriptor;
+							close = true;
+							break;
 						}
+						pollfd pollInfo{ clientData->fileDescriptor->descriptor, (short)POLLOUT, (short)0 };
+						sendQueueGuard.unlock();
+						poll(&pollInfo, 1, timeout > 100 ? 100 : timeout);
+						sendQueueGuard.lock();
+						if(clientData->closeAfterSend || clientData->fileDescriptor->descriptor == -1) return;
 					}
 				}
+			}
 
-				result = select(maxfd + 1, &readFileDescriptor, NULL, NULL, &timeout);
-				if(result == 0)
+			if(!close)
+			{
+				for(auto& buffer : { header, data })
 				{
-					if(HelperFunctions::getTime() - _lastGarbageCollection > 60000 || _clients.size() >= _maxConnections)
-                    {
-                        collectGarbage();
-                        collectGarbage(clients);
-                    }
-					continue;
+					if(!buffer || buffer->empty()) continue;
+					if(clientData->sendQueue.empty() && _sendQueueStallTimeout > 0)
+					{
+						clientData->lastSendProgress = HelperFunctions::getTime();
+						_serverShards.at(clientData->id % _serverShards.size())->timers.schedule(clientData, clientData->lastSendProgress + _sendQueueStallTimeout);
+					}
+					clientData->sendQueue.push_back(buffer);
+					clientData->sendQueueSize += buffer->size();
 				}
-				else if(result == -1)
+				if(clientData->sendQueueSize > _sendQueueHighWatermark) clientData->congested = true;
+				if(closeConnection) clientData->closeAfterSend = true;
+
+				if(!flushSendQueue(clientData)) close = true;
+				else if(clientData->sendQueue.empty() && clientData->closeAfterSend) close = true;
+				else if(clientData->congested && _slowClientPolicy == SlowClientPolicy::disconnect) close = true;
+				else updateWriteEvent(clientData);
+			}
+		}
+		if(close) closeClient(clientData);
+	}
+
+	bool TcpSocket::flushSendQueue(PTcpClientData& clientData)
+	{
+		int32_t descriptor = clientData->fileDescriptor->descriptor;
+		if(descriptor == -1) return false;
+
+		while(!clientData->sendQueue.empty())
+		{
+			ssize_t bytesWritten = 0;
+			if(clientData->fileDescriptor->tlsSession && !clientData->socket->kernelTlsSendEnabled())
+			{
+				//Write at most one record (16 KiB) at a time. On GNUTLS_E_AGAIN, GnuTLS needs to be called again with the same data. The data stays at the
+				//front of the queue and the offset is not changed, so the next call passes the same buffer once EPOLLOUT is reported.
+				auto& buffer = clientData->sendQueue.front();
+				size_t bytesToWrite = buffer->size() - clientData->sendQueueOffset;
+				if(bytesToWrite > 16384) bytesToWrite = 16384;
+				bytesWritten = gnutls_record_send(clientData->fileDescriptor->tlsSession, buffer->data() + clientData->sendQueueOffset, bytesToWrite);
+				if(bytesWritten == GNUTLS_E_INTERRUPTED) continue;
+				if(bytesWritten == GNUTLS_E_AGAIN) return true;
+				if(bytesWritten <= 0) return false;
+			}
+			else
+			{
+				//With kTLS the kernel creates the TLS records, so the queue is written like on plain connections.
+				std::array<iovec, 64> buffers;
+				size_t bufferCount = 0;
+				size_t offset = clientData->sendQueueOffset;
+				for(auto& element : clientData->sendQueue)
+				{
+					buffers[bufferCount].iov_base = (void*)(element->data() + offset);
+					buffers[bufferCount].iov_len = element->size() - offset;
+					offset = 0;
+					bufferCount++;
+					if(bufferCount == buffers.size()) break;
+				}
+
+				msghdr message{};
+				message.msg_iov = buffers.data();
+				message.msg_iovlen = bufferCount;
+				bytesWritten = sendmsg(descriptor, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+				if(bytesWritten == -1)
 				{
 					if(errno == EINTR) continue;
-					_bl->out.printError("Error: select returned -1: " + std::string(strerror(errno)));
-					continue;
+					return errno == EAGAIN || errno == EWOULDBLOCK;
 				}
+			}
+
+			clientData->socket->countSent(bytesWritten);
 
-				if (FD_ISSET(socketDescriptor, &readFileDescriptor) && !_stopServer)
+			//Remove everything written from the queue
+			clientData->lastActivity = HelperFunctions::getTime();
+			clientData->lastSendProgress = clientData->lastActivity;
+			clientData->sendQueueSize -= bytesWritten;
+			while(bytesWritten > 0)
+			{
+				size_t remainingBytes = clientData->sendQueue.front()->size() - clientData->sendQueueOffset;
+				if((size_t)bytesWritten < remainingBytes)
 				{
-					struct sockaddr_storage clientInfo;
-					socklen_t addressSize = sizeof(addressSize);
-					std::shared_ptr<BaseLib::FileDescriptor> clientFileDescriptor = _bl->fileDescriptorManager.add(accept(socketDescriptor, (struct sockaddr *) &clientInfo, &addressSize));
-					if(!clientFileDescriptor || clientFileDescriptor->descriptor == -1) continue;
+					clientData->sendQueueOffset += bytesWritten;
+					break;
+				}
+				bytesWritten -= remainingBytes;
+				clientData->sendQueueOffset = 0;
+				clientData->sendQueue.pop_front();
+			}
+			if(clientData->sendQueueSize <= _sendQueueLowWatermark) clientData->congested = false;
+		}
+		return true;
+	}
 
-					try
-					{
-						getpeername(clientFileDescriptor->descriptor, (struct sockaddr*)&clientInfo, &addressSize);
-
-						uint16_t port = 0;
-						char ipString[INET6_ADDRSTRLEN];
-						if (clientInfo.ss_family == AF_INET) {
-							struct sockaddr_in *s = (struct sockaddr_in *)&clientInfo;
-							port = ntohs(s->sin_port);
-							inet_ntop(AF_INET, &s->sin_addr, ipString, sizeof(ipString));
-						} else { // AF_INET6
-							struct sockaddr_in6 *s = (struct sockaddr_in6 *)&clientInfo;
-							port = ntohs(s->sin6_port);
-							inet_ntop(AF_INET6, &s->sin6_addr, ipString, sizeof(ipString));
-						}
-						std::string address = std::string(ipString);
+	bool TcpSocket::drainSendQueue(PTcpClientData& clientData, std::unique_lock<std::mutex>& sendQueueGuard)
+	{
+		int64_t endTime = HelperFunctions::getTime() + _writeTimeout / 1000;
+		while(true)
+		{
+			if(!flushSendQueue(clientData)) return false;
+			if(clientData->sendQueue.empty()) break;
+			int64_t timeout = endTime - HelperFunctions::getTime();
+			if(timeout <= 0)
+			{
+				clientData->socket->countWriteTimeout();
+				return false;
+			}
+			pollfd pollInfo{ clientData->fileDescriptor->descriptor, (short)POLLOUT, (short)0 };
+			sendQueueGuard.unlock();
+			poll(&pollInfo, 1, timeout > 100 ? 100 : timeout);
+			sendQueueGuard.lock();
+		}
+		updateWriteEvent(clientData);
+		return true;
+	}
 
-						if(_clients.size() > _maxConnections)
-						{
-							collectGarbage();
-							if(_clients.size() > _maxConnections)
-							{
-                                _bl->out.printError("Error: No more clients can connect to me as the maximum number of allowed connections is reached. Listen IP: " + _listenAddress + ", bound port: " + _listenPort + ", client IP: " + ipString);
-								_bl->fileDescriptorManager.shutdown(clientFileDescriptor);
-								continue;
-							}
-						}
+	void TcpSocket::updateWriteEvent(PTcpClientData& clientData)
+	{
+		bool enable = !clientData->sendQueue.empty();
+		if((!enable && !clientData->writeEventEnabled) || clientData->epollDescriptor == -1 || clientData->fileDescriptor->descriptor == -1) return;
+
+		//The registration is also modified when EPOLLOUT is set already, because this reports the socket again if it is writable. Otherwise an event
+		//consumed while another thread was writing could be lost with edge-triggered notifications.
+		epoll_event event{};
+		event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (enable ? EPOLLOUT : 0);
+		event.data.u64 = (uint32_t)clientData->id;
+		if(epoll_ctl(clientData->epollDescriptor, EPOLL_CTL_MOD, clientData->fileDescriptor->descriptor, &event) == 0) clientData->writeEventEnabled = enable;
+	}
 
-						int32_t currentClientId = 0;
+	void TcpSocket::writeClient(PTcpClientData& clientData)
+	{
+		bool close = false;
+		{
+			//When the lock is held, the owner takes care of writing and of registering EPOLLOUT again, so the server thread never blocks here.
+			std::unique_lock<std::mutex> sendQueueGuard(clientData->sendQueueMutex, std::try_to_lock);
+			if(!sendQueueGuard.owns_lock()) return;
+
+			if(!flushSendQueue(clientData)) close = true;
+			else if(clientData->sendQueue.empty() && clientData->closeAfterSend) close = true;
+			else updateWriteEvent(clientData);
+		}
+		if(close) closeClient(clientData);
+	}
 
-                        if(_stopServer)
+	void TcpSocket::closeClient(PTcpClientData& clientData)
+	{
+		//Reading, writing and garbage collection can detect a closed connection at the same time, but the callback is only called once.
+		if(clientData->closed.exchange(true)) return;
+		_bl->fileDescriptorManager.close(clientData->fileDescriptor);
+		//The server thread removes the client from the client table on the next tick.
+		if(!_serverShards.empty()) _serverShards.at(clientData->id % _serverShards.size())->timers.schedule(clientData, HelperFunctions::getTime());
+		//Clients still doing the TLS handshake haven't been reported to the new connection callback yet.
+		if(_connectionClosedCallback && !clientData->tlsHandshakePending) _connectionClosedCallback(clientData->id);
+	}
+
+	void TcpSocket::serverThread(uint32_t shardIndex)
+	{
+		PServerShard shard = _serverShards.at(shardIndex);
+		//Marks events of the listening socket. All other events carry the client ID.
+		const uint64_t listenerEvent = std::numeric_limits<uint64_t>::max();
+		int32_t result = 0;
+        int32_t socketDescriptor = -1;
+		std::array<epoll_event, 64> events;
+		int32_t epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+		if(epollDescriptor == -1)
+		{
+			_bl->out.printError("Error: Could not create epoll instance: " + std::string(strerror(errno)));
+			return;
+		}
+		while(!_stopServer)
+		{
+			try
+			{
+                {
+                    std::unique_lock<std::mutex> socketDescriptorGuard(_socketDescriptorMutex);
+                    if(!shard->socketDescriptor || shard->socketDescriptor->descriptor == -1)
+                    {
+                        socketDescriptorGuard.unlock();
+                        if(_stopServer) break;
+                        std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+                        bindSocket(shard);
+                        continue;
+                    }
+                    if(shard->socketDescriptor->descriptor != socketDescriptor)
+                    {
+                        //The listening socket is new. Closed descriptors are removed from epoll automatically.
+                        epoll_event event{};
+                        event.events = EPOLLIN | EPOLLET;
+                        event.data.u64 = listenerEvent;
+                        if(epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, shard->socketDescriptor->descriptor, &event) == -1 && errno != EEXIST)
                         {
-                            _bl->fileDescriptorManager.shutdown(clientFileDescriptor);
+                            socketDescriptorGuard.unlock();
+                            _bl->out.printError("Error: Could not add listening socket to epoll: " + std::string(strerror(errno)));
+                            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
                             continue;
                         }
+                        socketDescriptor = shard->socketDescriptor->descriptor;
+                    }
+                }
 
-                        if(_useSsl) initClientSsl(clientFileDescriptor);
-
-						{
-                            std::lock_guard<std::mutex> clientsGuard(_clientsMutex);
-							currentClientId = _currentClientId++;
-
-							PTcpClientData clientData = std::make_shared<TcpClientData>();
-							clientData->id = currentClientId;
-							clientData->fileDescriptor = clientFileDescriptor;
-							clientData->socket = std::make_shared<BaseLib::TcpSocket>(_bl, clientFileDescriptor);
-							clientData->socket->setReadTimeout(100000);
-							clientData->socket->setWriteTimeout(15000000);
-
-							_clients[currentClientId] = clientData;
-                            clients[currentClientId] = clientData;
-						}
+				result = epoll_wait(epollDescriptor, events.data(), events.size(), 100);
+				processTimers(shard);
+				if(result == 0) continue;
+				else if(result == -1)
+				{
+					if(errno == EINTR) continue;
+					_bl->out.printError("Error: epoll_wait returned -1: " + std::string(strerror(errno)));
+					continue;
+				}
 
-						if(_newConnectionCallback) _newConnectionCallback(currentClientId, address, port);
-					}
-					catch(const std::exception& ex)
+				for(int32_t i = 0; i < result; i++)
+				{
+					if(events[i].data.u64 == listenerEvent)
 					{
-						_bl->fileDescriptorManager.shutdown(clientFileDescriptor);
-						_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+						if(!_stopServer) acceptClients(shard, epollDescriptor);
+						continue;
 					}
-					catch(BaseLib::Exception& ex)
+
+					PTcpClientData clientData;
 					{
-						_bl->fileDescriptorManager.shutdown(clientFileDescriptor);
-						_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+						std::lock_guard<std::mutex> clientsGuard(shard->clientsMutex);
+						auto clientIterator = shard->clients.find((int32_t)(uint32_t)events[i].data.u64);
+						if(clientIterator == shard->clients.end()) continue;
+						clientData = clientIterator->second;
 					}
-					catch(...)
+					if(clientData->tlsHandshakePending)
 					{
-						_bl->fileDescriptorManager.shutdown(clientFileDescriptor);
-						_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+						if(!clientData->closed) continueTlsHandshake(clientData);
+						continue;
 					}
-					continue;
+					if(events[i].events & EPOLLOUT) writeClient(clientData);
+					if(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) readClient(clientData);
 				}
+			}
+			catch(const std::exception& ex)
+			{
+				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+			}
+			catch(BaseLib::Exception& ex)
+			{
+				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+			}
+			catch(...)
+			{
+				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+			}
+		}
+		::close(epollDescriptor);
+        std::lock_guard<std::mutex> socketDescriptorGuard(_socketDescriptorMutex);
+		_bl->fileDescriptorManager.close(shard->socketDescriptor);
+	}
 
-				PTcpClientData clientData;
+	void TcpSocket::acceptClients(PServerShard& shard, int32_t epollDescriptor)
+	{
+		int32_t socketDescriptor = shard->socketDescriptor->descriptor;
+		while(!_stopServer)
+		{
+			struct sockaddr_storage clientInfo;
+			socklen_t addressSize = sizeof(clientInfo);
+			//The listening socket is non-blocking, so accept() fails with EAGAIN when there are no more pending connections.
+			int32_t clientSocketDescriptor = accept(socketDescriptor, (struct sockaddr *) &clientInfo, &addressSize);
+			if(clientSocketDescriptor == -1)
+			{
+				if(errno == EINTR || errno == ECONNABORTED) continue;
+				if(errno != EAGAIN && errno != EWOULDBLOCK) _bl->out.printError("Error: Could not accept connection: " + std::string(strerror(errno)));
+				break;
+			}
+			std::shared_ptr<BaseLib::FileDescriptor> clientFileDescriptor = _bl->fileDescriptorManager.add(clientSocketDescriptor);
+			if(!clientFileDescriptor || clientFileDescriptor->descriptor == -1) continue;
+
+			try
+			{
+				getpeername(clientFileDescriptor->descriptor, (struct sockaddr*)&clientInfo, &addressSize);
+
+				uint16_t port = 0;
+				char ipString[INET6_ADDRSTRLEN];
+				if(clientInfo.ss_family == AF_UNIX)
 				{
-					for(auto& client : clients)
+					//Clients of Unix domain sockets are usually unnamed, so the socket path is used as address.
+					strncpy(ipString, _listenAddress.c_str(), sizeof(ipString) - 1);
+					ipString[sizeof(ipString) - 1] = 0;
+					if(_unixPeerCredentialsCallback)
 					{
-						if(client.second->fileDescriptor->descriptor == -1) continue;
-						if(FD_ISSET(client.second->fileDescriptor->descriptor, &readFileDescriptor))
+						struct ucred credentials{};
+						socklen_t credentialsLength = sizeof(credentials);
+						if(getsockopt(clientFileDescriptor->descriptor, SOL_SOCKET, SO_PEERCRED, &credentials, &credentialsLength) == -1)
 						{
-							clientData = client.second;
-							break;
+							_bl->out.printError("Error: Could not get credentials of client connecting to " + _listenAddress + ": " + std::string(strerror(errno)));
+							_bl->fileDescriptorManager.shutdown(clientFileDescriptor);
+							continue;
+						}
+						if(!_unixPeerCredentialsCallback(credentials.pid, credentials.uid, credentials.gid))
+						{
+							_bl->out.printWarning("Warning: Rejected connection to " + _listenAddress + " from process " + std::to_string(credentials.pid) + " (UID " + std::to_string(credentials.uid) + ", GID " + std::to_string(credentials.gid) + ").");
+							SocketMetrics::increment(_tcpServerMetrics.connectionsRejected);
+							_bl->fileDescriptorManager.shutdown(clientFileDescriptor);
+							continue;
 						}
 					}
 				}
+				else if (clientInfo.ss_family == AF_INET) {
+					struct sockaddr_in *s = (struct sockaddr_in *)&clientInfo;
+					port = ntohs(s->sin_port);
+					inet_ntop(AF_INET, &s->sin_addr, ipString, sizeof(ipString));
+				} else { // AF_INET6
+					struct sockaddr_in6 *s = (struct sockaddr_in6 *)&clientInfo;
+					port = ntohs(s->sin6_port);
+					inet_ntop(AF_INET6, &s->sin6_addr, ipString, sizeof(ipString));
+				}
+				std::string address = std::string(ipString);
+
+				if((uint32_t)clientCount() > _maxConnections)
+				{
+					collectGarbage();
+					if((uint32_t)clientCount() > _maxConnections)
+					{
+                        _bl->out.printError("Error: No more clients can connect to me as the maximum number of allowed connections is reached. Listen IP: " + _listenAddress + ", bound port: " + _listenPort + ", client IP: " + ipString);
+						SocketMetrics::increment(_tcpServerMetrics.connectionsRejected);
+						_bl->fileDescriptorManager.shutdown(clientFileDescriptor);
+						continue;
+					}
+				}
+
+				PTcpClientData clientData;
+
+                if(_stopServer)
+                {
+                    _bl->fileDescriptorManager.shutdown(clientFileDescriptor);
+                    continue;
+                }
+
+                if(_useSsl) initClientSsl(clientFileDescriptor);
+
+				{
+                    std::lock_guard<std::mutex> clientsGuard(shard->clientsMutex);
+					clientData = std::make_shared<TcpClientData>();
+					clientData->id = shard->nextClientId;
+					shard->nextClientId += _serverShards.size();
+					clientData->fileDescriptor = clientFileDescriptor;
+					clientData->socket = std::make_shared<BaseLib::TcpSocket>(_bl, clientFileDescriptor);
+					clientData->socket->setReadTimeout(100000);
+					clientData->socket->_reactorClient = true;
+					clientData->socket->setWriteTimeout(15000000);
+					clientData->socket->_parentMetrics = _metrics;
+					clientData->address = address;
+					clientData->port = port;
+					clientData->connectTimeMicroseconds = HelperFunctions::getTimeMicroseconds();
+					clientData->connectTime = clientData->connectTimeMicroseconds / 1000;
+					clientData->lastActivity = clientData->connectTime;
+					clientData->epollDescriptor = epollDescriptor;
+					clientData->tlsHandshakePending = _useSsl;
+
+					epoll_event event{};
+					event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+					event.data.u64 = (uint32_t)clientData->id;
+					if(epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, clientFileDescriptor->descriptor, &event) == -1) throw SocketOperationException("Could not add client to epoll: " + std::string(strerror(errno)));
+
+					shard->clients[clientData->id] = clientData;
+				}
+				SocketMetrics::increment(_tcpServerMetrics.connectionsAccepted);
+				checkTimeouts(shard, clientData);
 
-				if(clientData) readClient(clientData);
+				//The client hello usually arrived with the connection already.
+				if(_useSsl) continueTlsHandshake(clientData);
+				else if(_newConnectionCallback) _newConnectionCallback(clientData->id, address, port);
 			}
 			catch(const std::exception& ex)
 			{
+				_bl->fileDescriptorManager.shutdown(clientFileDescriptor);
 				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
 			}
 			catch(BaseLib::Exception& ex)
 			{
+				_bl->fileDescriptorManager.shutdown(clientFileDescriptor);
 				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
 			}
 			catch(...)
 			{
+				_bl->fileDescriptorManager.shutdown(clientFileDescriptor);
 				_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
 			}
 		}
-        std::lock_guard<std::mutex> socketDescriptorGuard(_socketDescriptorMutex);
-		_bl->fileDescriptorManager.close(_socketDescriptor);
 	}
 
 	void TcpSocket::collectGarbage()
 	{
-		_lastGarbageCollection = BaseLib::HelperFunctions::getTime();
+		for(auto& shard : _serverShards)
+		{
+			collectGarbage(shard);
+		}
+	}
 
-		std::lock_guard<std::mutex> clientsGuard(_clientsMutex);
+	void TcpSocket::collectGarbage(PServerShard& shard)
+	{
+		std::lock_guard<std::mutex> clientsGuard(shard->clientsMutex);
+		shard->lastGarbageCollection = BaseLib::HelperFunctions::getTime();
 		std::vector<int32_t> clientsToRemove;
 		{
-			for(auto& client : _clients)
+			for(auto& client : shard->clients)
 			{
 				if(!client.second->fileDescriptor || client.second->fileDescriptor->descriptor == -1) clientsToRemove.push_back(client.first);
 			}
 		}
-		for(auto& client : clientsToRemove)
-		{
-			_clients.erase(client);
-		}
+		for(auto& client : clientsToRemove)
+		{
+			shard->clients.erase(client);
+		}
+	}
+
+	void TcpSocket::processTimers(PServerShard& shard)
+	{
+		try
+		{
+			std::vector<PTcpClientData> expired;
+			shard->timers.advance(HelperFunctions::getTime(), expired);
+			//Closing a client calls the connection closed callback, which might send data to other clients of the shard. So no lock is held here.
+			for(auto& clientData : expired)
+			{
+				checkTimeouts(shard, clientData);
+			}
+		}
+		catch(const std::exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(BaseLib::Exception& ex)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__, ex.what());
+		}
+		catch(...)
+		{
+			_bl->out.printEx(__FILE__, __LINE__, __PRETTY_FUNCTION__);
+		}
+	}
+
+	void TcpSocket::checkTimeouts(PServerShard& shard, PTcpClientData& clientData)
+	{
+		if(clientData->closed)
+		{
+			std::lock_guard<std::mutex> clientsGuard(shard->clientsMutex);
+			auto clientIterator = shard->clients.find(clientData->id);
+			if(clientIterator != shard->clients.end() && clientIterator->second == clientData) shard->clients.erase(clientIterator);
+			return;
+		}
+
+		int64_t time = HelperFunctions::getTime();
+		int64_t nextDeadline = std::numeric_limits<int64_t>::max();
+		std::string expiredTimeout;
+		std::atomic<uint64_t>* timeoutCounter = nullptr;
+		if(clientData->tlsHandshakePending && _tlsHandshakeTimeout > 0)
+		{
+			int64_t deadline = clientData->connectTime + _tlsHandshakeTimeout;
+			if(time >= deadline)
+			{
+				expiredTimeout = "TLS handshake";
+				timeoutCounter = &_tcpServerMetrics.tlsHandshakeTimeouts;
+			}
+			else nextDeadline = deadline;
+		}
+		if(expiredTimeout.empty() && _connectionIdleTimeout > 0)
+		{
+			int64_t deadline = clientData->lastActivity + _connectionIdleTimeout;
+			if(time >= deadline)
+			{
+				expiredTimeout = "Idle";
+				timeoutCounter = &_tcpServerMetrics.idleTimeouts;
+			}
+			else if(deadline < nextDeadline) nextDeadline = deadline;
+		}
+		if(expiredTimeout.empty() && _useSendQueue && _sendQueueStallTimeout > 0)
+		{
+			std::unique_lock<std::mutex> sendQueueGuard(clientData->sendQueueMutex, std::try_to_lock);
+			//Another thread is writing to the client right now, so check again on the next tick.
+			if(!sendQueueGuard.owns_lock()) nextDeadline = time;
+			else if(!clientData->sendQueue.empty())
+			{
+				int64_t deadline = clientData->lastSendProgress + _sendQueueStallTimeout;
+				if(time >= deadline)
+				{
+					expiredTimeout = "Send queue stall";
+					timeoutCounter = &_tcpServerMetrics.sendQueueStallTimeouts;
+				}
+				else if(deadline < nextDeadline) nextDeadline = deadline;
+			}
+		}
+
+		if(!expiredTimeout.empty())
+		{
+			SocketMetrics::increment(*timeoutCounter);
+			if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: " + expiredTimeout + " timeout of client number " + std::to_string(clientData->id) + " (" + clientData->address + "). Closing connection.");
+			closeClient(clientData);
+		}
+		else if(nextDeadline != std::numeric_limits<int64_t>::max()) shard->timers.schedule(clientData, nextDeadline);
+	}
+
+	TcpSocket::TimerWheel::TimerWheel(int64_t tickLength, uint32_t slotCount)
+	{
+		_tickLength = tickLength > 0 ? tickLength : 100;
+		_slots.resize(slotCount > 0 ? slotCount : 1);
+		_currentTick = HelperFunctions::getTime() / _tickLength;
+	}
+
+	void TcpSocket::TimerWheel::schedule(const PTcpClientData& clientData, int64_t time)
+	{
+		std::lock_guard<std::mutex> slotsGuard(_slotsMutex);
+		//The old entry is left in its slot and skipped when it expires, as it doesn't match "timerTime" anymore.
+		if(clientData->timerTime != 0 && clientData->timerTime <= time) return;
+		clientData->timerTime = time > 0 ? time : 1;
+
+		//Round up, so the entry's time has passed when its tick is processed.
+		int64_t tick = (time + _tickLength - 1) / _tickLength;
+		if(tick <= _currentTick) tick = _currentTick + 1;
+		Entry entry;
+		entry.clientData = clientData;
+		entry.time = clientData->timerTime;
+		_slots.at(tick % _slots.size()).push_back(std::move(entry));
+	}
+
+	void TcpSocket::TimerWheel::advance(int64_t time, std::vector<PTcpClientData>& expired)
+	{
+		std::lock_guard<std::mutex> slotsGuard(_slotsMutex);
+		int64_t tick = time / _tickLength;
+		if(tick <= _currentTick) return;
+
+		//After a pause longer than one revolution every slot is processed once.
+		int64_t firstTick = tick - _currentTick > (int64_t)_slots.size() ? tick - _slots.size() + 1 : _currentTick + 1;
+		for(int64_t i = firstTick; i <= tick; i++)
+		{
+			std::vector<Entry>& slot = _slots.at(i % _slots.size());
+			for(size_t j = 0; j < slot.size();)
+			{
+				Entry& entry = slot.at(j);
+				//Entries of later revolutions stay in the slot.
+				if(entry.clientData->timerTime == entry.time && entry.time > time)
+				{
+					j++;
+					continue;
+				}
+				if(entry.clientData->timerTime == entry.time)
+				{
+					entry.clientData->timerTime = 0;
+					expired.push_back(entry.clientData);
+				}
+				if(j != slot.size() - 1) entry = std::move(slot.back());
+				slot.pop_back();
+			}
+		}
+		_currentTick = tick;
 	}
-
-    void TcpSocket::collectGarbage(std::map<int32_t, PTcpClientData>& clients)
-    {
-        std::vector<int32_t> clientsToRemove;
-        {
-            for(auto& client : clients)
-            {
-                if(!client.second->fileDescriptor || client.second->fileDescriptor->descriptor == -1) clientsToRemove.push_back(client.first);
-            }
-        }
-        for(auto& client : clientsToRemove)
-        {
-            clients.erase(client);
-        }
-    }
 // }}}
 
-PFileDescriptor TcpSocket::bindAndReturnSocket(FileDescriptorManager& fileDescriptorManager, std::string address, std::string port, std::string& listenAddress, int32_t& listenPort)
+PFileDescriptor TcpSocket::bindAndReturnSocket(FileDescriptorManager& fileDescriptorManager, std::string address, std::string port, std::string& listenAddress, int32_t& listenPort, bool reusePort)
 {
+	if(isUnixSocketPath(address))
+	{
+		PFileDescriptor socketDescriptor = bindAndReturnUnixSocket(fileDescriptorManager, address);
+		listenAddress = address;
+		listenPort = 0;
+		return socketDescriptor;
+	}
+
 	PFileDescriptor socketDescriptor;
 	addrinfo hostInfo;
 	addrinfo *serverInfo = nullptr;
@@ -672,6 +1482,7 @@ PFileDescriptor TcpSocket::bindAndReturnSocket(FileDescriptorManager& fileDescri
 			if(fcntl(socketDescriptor->descriptor, F_SETFL, fcntl(socketDescriptor->descriptor, F_GETFL) | O_NONBLOCK) < 0) throw SocketOperationException("Error: Could not set socket options.");
 		}
 		if(setsockopt(socketDescriptor->descriptor, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int32_t)) == -1) throw SocketOperationException("Error: Could not set socket options.");
+		if(reusePort && setsockopt(socketDescriptor->descriptor, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int32_t)) == -1) throw SocketOperationException("Error: Could not set SO_REUSEPORT.");
 		if(bind(socketDescriptor->descriptor, info->ai_addr, info->ai_addrlen) == -1)
 		{
 			socketDescriptor.reset();
@@ -715,7 +1526,7 @@ PFileDescriptor TcpSocket::bindAndReturnSocket(FileDescriptorManager& fileDescri
 		socketDescriptor.reset();
 		throw SocketOperationException("Error: Could get port listening on: " + std::string(strerror(error)));
 	}
-	listenPort = addressInfo.sin_port;
+	listenPort = ntohs(addressInfo.sin_port);
 
 	if(listenAddress == "0.0.0.0") listenAddress = Net::getMyIpAddress();
 	else if(listenAddress == "::")
@@ -726,6 +1537,53 @@ PFileDescriptor TcpSocket::bindAndReturnSocket(FileDescriptorManager& fileDescri
 	return socketDescriptor;
 }
 
+PFileDescriptor TcpSocket::bindAndReturnUnixSocket(FileDescriptorManager& fileDescriptorManager, const std::string& path)
+{
+	sockaddr_un address{};
+	if(path.size() >= sizeof(address.sun_path)) throw SocketInvalidParametersException("Error: Socket path is too long: " + path);
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+	PFileDescriptor socketDescriptor = fileDescriptorManager.add(socket(AF_UNIX, SOCK_STREAM, 0));
+	if(!socketDescriptor || socketDescriptor->descriptor == -1) throw SocketOperationException("Error: Could not create socket: " + std::string(strerror(errno)));
+	if(fcntl(socketDescriptor->descriptor, F_SETFL, fcntl(socketDescriptor->descriptor, F_GETFL) | O_NONBLOCK) < 0)
+	{
+		fileDescriptorManager.shutdown(socketDescriptor);
+		throw SocketOperationException("Error: Could not set socket options.");
+	}
+
+	//Remove the socket file of a previous process, but not one somebody is still listening on.
+	struct stat fileInfo{};
+	if(stat(path.c_str(), &fileInfo) == 0 && S_ISSOCK(fileInfo.st_mode))
+	{
+		int32_t testDescriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+		bool inUse = testDescriptor != -1 && connect(testDescriptor, (struct sockaddr*)&address, sizeof(address)) == 0;
+		if(testDescriptor != -1) ::close(testDescriptor);
+		if(inUse)
+		{
+			fileDescriptorManager.shutdown(socketDescriptor);
+			throw SocketAddressInUseException("Error: Could not start listening on " + path + ": Another process is listening on this socket.");
+		}
+		unlink(path.c_str());
+	}
+
+	if(bind(socketDescriptor->descriptor, (struct sockaddr*)&address, sizeof(address)) == -1)
+	{
+		int32_t error = errno;
+		fileDescriptorManager.shutdown(socketDescriptor);
+		if(error == EADDRINUSE) throw SocketAddressInUseException("Error: Could not start listening on " + path + ": " + std::string(strerror(error)));
+		else throw SocketBindException("Error: Could not start listening on " + path + ": " + std::string(strerror(error)));
+	}
+	if(listen(socketDescriptor->descriptor, 100) == -1)
+	{
+		int32_t error = errno;
+		fileDescriptorManager.shutdown(socketDescriptor);
+		unlink(path.c_str());
+		throw SocketOperationException("Error: Server could not start listening on " + path + ": " + std::string(strerror(error)));
+	}
+	return socketDescriptor;
+}
+
 void TcpSocket::freeCredentials()
 {
 	for(auto& credentials : _x509Credentials)
@@ -735,6 +1593,151 @@ void TcpSocket::freeCredentials()
 	_x509Credentials.clear();
 }
 
+void TcpSocket::freeSessionTicketKey()
+{
+	if(!_sessionTicketKey.data) return;
+	gnutls_memset(_sessionTicketKey.data, 0, _sessionTicketKey.size);
+	gnutls_free(_sessionTicketKey.data);
+	_sessionTicketKey.data = nullptr;
+	_sessionTicketKey.size = 0;
+}
+
+bool TcpSocket::kernelTlsSendEnabled()
+{
+#if GNUTLS_VERSION_NUMBER >= 0x030703
+	if(!_socketDescriptor || !_socketDescriptor->tlsSession) return false;
+	return gnutls_transport_is_ktls_enabled(_socketDescriptor->tlsSession) & GNUTLS_KTLS_SEND;
+#else
+	return false;
+#endif
+}
+
+TcpSocket::TlsHandshakeStatistics TcpSocket::getTlsHandshakeStatistics()
+{
+	TlsHandshakeStatistics statistics;
+	statistics.handshakes = _tlsHandshakes;
+	statistics.resumedHandshakes = _tlsResumedHandshakes;
+	return statistics;
+}
+
+TcpSocket::ConnectStatistics TcpSocket::getConnectStatistics()
+{
+	ConnectStatistics statistics;
+	statistics.connects = _connects;
+	statistics.failedConnects = _failedConnects;
+	statistics.dnsCacheHits = _dnsCacheHits;
+	statistics.dnsCacheMisses = _dnsCacheMisses;
+	statistics.lastConnectTime = _lastConnectTime;
+	statistics.averageConnectTime = statistics.connects > 0 ? _totalConnectTime / statistics.connects : 0;
+	statistics.maxConnectTime = _maxConnectTime;
+	return statistics;
+}
+
+PVariable TcpSocket::getMetrics(bool includeClients)
+{
+	PVariable metrics = std::make_shared<Variable>(VariableType::tStruct);
+	_metrics->addTo(metrics);
+	metrics->structValue->emplace("tlsHandshakes", std::make_shared<Variable>(_tlsHandshakes.load(std::memory_order_relaxed)));
+	metrics->structValue->emplace("tlsResumedHandshakes", std::make_shared<Variable>(_tlsResumedHandshakes.load(std::memory_order_relaxed)));
+	if(!_isServer)
+	{
+		metrics->structValue->emplace("connects", std::make_shared<Variable>(_connects.load(std::memory_order_relaxed)));
+		metrics->structValue->emplace("failedConnects", std::make_shared<Variable>(_failedConnects.load(std::memory_order_relaxed)));
+		metrics->structValue->emplace("dnsCacheHits", std::make_shared<Variable>(_dnsCacheHits.load(std::memory_order_relaxed)));
+		metrics->structValue->emplace("dnsCacheMisses", std::make_shared<Variable>(_dnsCacheMisses.load(std::memory_order_relaxed)));
+		metrics->structValue->emplace("connectTime", _connectTimeHistogram.toVariable());
+		metrics->structValue->emplace("tlsHandshakeTime", _tlsHandshakeTime.toVariable());
+		return metrics;
+	}
+
+	_tcpServerMetrics.addTo(metrics);
+	int32_t clientCount = 0;
+	uint64_t sendQueueSize = 0;
+	uint64_t maxSendQueueSize = 0;
+	PVariable clients = std::make_shared<Variable>(VariableType::tArray);
+	for(auto& shard : _serverShards)
+	{
+		std::vector<PTcpClientData> shardClients;
+		{
+			std::lock_guard<std::mutex> clientsGuard(shard->clientsMutex);
+			shardClients.reserve(shard->clients.size());
+			for(auto& client : shard->clients)
+			{
+				if(!client.second->closed) shardClients.push_back(client.second);
+			}
+		}
+
+		for(auto& clientData : shardClients)
+		{
+			size_t clientSendQueueSize = 0;
+			{
+				std::lock_guard<std::mutex> sendQueueGuard(clientData->sendQueueMutex);
+				clientSendQueueSize = clientData->sendQueueSize;
+			}
+			clientCount++;
+			sendQueueSize += clientSendQueueSize;
+			if(clientSendQueueSize > maxSendQueueSize) maxSendQueueSize = clientSendQueueSize;
+			if(!includeClients) continue;
+
+			PVariable client = std::make_shared<Variable>(VariableType::tStruct);
+			client->structValue->emplace("id", std::make_shared<Variable>(clientData->id));
+			client->structValue->emplace("address", std::make_shared<Variable>(clientData->address));
+			client->structValue->emplace("port", std::make_shared<Variable>((int32_t)clientData->port));
+			client->structValue->emplace("connectTime", std::make_shared<Variable>(clientData->connectTime));
+			client->structValue->emplace("lastActivity", std::make_shared<Variable>(clientData->lastActivity.load()));
+			client->structValue->emplace("tlsHandshakePending", std::make_shared<Variable>((bool)clientData->tlsHandshakePending));
+			client->structValue->emplace("sendQueueSize", std::make_shared<Variable>((uint64_t)clientSendQueueSize));
+			clientData->socket->_metrics->addTo(client);
+			clients->arrayValue->push_back(client);
+		}
+	}
+	metrics->structValue->emplace("clientCount", std::make_shared<Variable>(clientCount));
+	metrics->structValue->emplace("sendQueueSize", std::make_shared<Variable>(sendQueueSize));
+	metrics->structValue->emplace("maxSendQueueSize", std::make_shared<Variable>(maxSendQueueSize));
+	if(includeClients) metrics->structValue->emplace("clients", clients);
+	return metrics;
+}
+
+void TcpSocket::clearDnsCache()
+{
+	std::lock_guard<std::mutex> dnsCacheGuard(_dnsCacheMutex);
+	_dnsCache.clear();
+}
+
+std::string TcpSocket::getTlsSessionCacheKey()
+{
+	std::string key = _hostname + ":" + _port;
+	for(auto& certificateInfo : _certificates)
+	{
+		if(!certificateInfo.second->certFile.empty()) key += ":" + certificateInfo.second->certFile;
+		else if(!certificateInfo.second->certData.empty()) key += ":" + std::to_string(std::hash<std::string>()(certificateInfo.second->certData));
+	}
+	return key;
+}
+
+void TcpSocket::storeTlsSession(gnutls_session_t tlsSession)
+{
+	gnutls_datum_t sessionData{};
+	if(gnutls_session_get_data2(tlsSession, &sessionData) != GNUTLS_E_SUCCESS) return;
+	std::vector<uint8_t> data(sessionData.data, sessionData.data + sessionData.size);
+	gnutls_free(sessionData.data);
+	if(data.empty()) return;
+
+	std::string key = getTlsSessionCacheKey();
+	std::lock_guard<std::mutex> tlsSessionCacheGuard(_tlsSessionCacheMutex);
+	if(_tlsSessionCache.size() >= 1000 && _tlsSessionCache.find(key) == _tlsSessionCache.end()) _tlsSessionCache.erase(_tlsSessionCache.begin());
+	_tlsSessionCache[key].swap(data);
+}
+
+int TcpSocket::newSessionTicket(gnutls_session_t tlsSession, unsigned int type, unsigned int when, unsigned int incoming, const gnutls_datum_t* message)
+{
+	//TLS 1.2 tickets are part of the handshake, those sessions are stored when the handshake is completed.
+	if(!incoming || gnutls_protocol_get_version(tlsSession) != GNUTLS_TLS1_3) return 0;
+	TcpSocket* tcpSocket = (TcpSocket*)gnutls_session_get_ptr(tlsSession);
+	if(tcpSocket) tcpSocket->storeTlsSession(tlsSession);
+	return 0;
+}
+
 void TcpSocket::initSsl()
 {
     freeCredentials();
@@ -1019,31 +2022,27 @@ int32_t TcpSocket::proofread(char* buffer, int32_t bufferSize, bool& moreData)
 			if(gnutls_record_check_pending(_socketDescriptor->tlsSession) > 0) moreData = true;
 			_readMutex.unlock();
 			if(bytesRead > bufferSize) bytesRead = bufferSize;
+			countReceived(bytesRead);
 			return bytesRead;
 		}
 	}
 
-	timeval timeout{};
-	int32_t seconds = _readTimeout / 1000000;
-	timeout.tv_sec = seconds;
-	timeout.tv_usec = _readTimeout - (1000000 * seconds);
-	fd_set readFileDescriptor{};
-	FD_ZERO(&readFileDescriptor);
 	auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
 	fileDescriptorGuard.lock();
-	int32_t nfds = _socketDescriptor->descriptor + 1;
-	if(nfds <= 0)
+	if(_socketDescriptor->descriptor < 0)
 	{
 		fileDescriptorGuard.unlock();
 		_readMutex.unlock();
 		throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (1).");
 	}
-	FD_SET(_socketDescriptor->descriptor, &readFileDescriptor);
+	//poll() instead of select(), as select() can't handle descriptors greater than FD_SETSIZE.
+	pollfd pollInfo{ _socketDescriptor->descriptor, (short)POLLIN, (short)0 };
 	fileDescriptorGuard.unlock();
-	bytesRead = select(nfds, &readFileDescriptor, NULL, NULL, &timeout);
+	bytesRead = poll(&pollInfo, 1, _readTimeout / 1000);
 	if(bytesRead == 0)
 	{
 		_readMutex.unlock();
+		countReadTimeout();
 		throw SocketTimeOutException("Reading from socket timed out (1).", SocketTimeOutException::SocketTimeOutType::selectTimeout);
 	}
 	if(bytesRead != 1)
@@ -1053,10 +2052,26 @@ int32_t TcpSocket::proofread(char* buffer, int32_t bufferSize, bool& moreData)
 	}
 	if(_socketDescriptor->tlsSession)
 	{
-		do
+		while(true)
 		{
 			bytesRead = gnutls_record_recv(_socketDescriptor->tlsSession, buffer, bufferSize);
-		} while(bytesRead == GNUTLS_E_INTERRUPTED || bytesRead == GNUTLS_E_AGAIN);
+			if(bytesRead == GNUTLS_E_INTERRUPTED) continue;
+			if(bytesRead != GNUTLS_E_AGAIN) break;
+			//The socket is non-blocking and the record is incomplete.
+			if(_reactorClient)
+			{
+				//Don't block the server thread. The rest of the record triggers a new EPOLLIN.
+				_readMutex.unlock();
+				return 0;
+			}
+			pollInfo.revents = 0;
+			if(poll(&pollInfo, 1, _readTimeout / 1000) == 0)
+			{
+				_readMutex.unlock();
+				countReadTimeout();
+				throw SocketTimeOutException("Reading from socket timed out (3).", SocketTimeOutException::SocketTimeOutType::readTimeout);
+			}
+		}
 
 		if(gnutls_record_check_pending(_socketDescriptor->tlsSession) > 0) moreData = true;
 	}
@@ -1072,13 +2087,18 @@ int32_t TcpSocket::proofread(char* buffer, int32_t bufferSize, bool& moreData)
 		_readMutex.unlock();
 		if(bytesRead == -1)
 		{
-			if(errno == ETIMEDOUT) throw SocketTimeOutException("Reading from socket timed out (2).", SocketTimeOutException::SocketTimeOutType::readTimeout);
+			if(errno == ETIMEDOUT)
+			{
+				countReadTimeout();
+				throw SocketTimeOutException("Reading from socket timed out (2).", SocketTimeOutException::SocketTimeOutType::readTimeout);
+			}
 			else throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (3): " + strerror(errno));
 		}
 		else throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (3).");
 	}
 	_readMutex.unlock();
 	if(bytesRead > bufferSize) bytesRead = bufferSize;
+	countReceived(bytesRead);
 	return bytesRead;
 }
 
@@ -1119,27 +2139,22 @@ int32_t TcpSocket::proofwrite(const std::vector<char>& data)
 	int32_t totalBytesWritten = 0;
 	while (totalBytesWritten < (signed)data.size())
 	{
-		timeval timeout;
-		int32_t seconds = _writeTimeout / 1000000;
-		timeout.tv_sec = seconds;
-		timeout.tv_usec = _writeTimeout - (1000000 * seconds);
-		fd_set writeFileDescriptor;
-		FD_ZERO(&writeFileDescriptor);
 		auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
 		fileDescriptorGuard.lock();
-		int32_t nfds = _socketDescriptor->descriptor + 1;
-		if(nfds <= 0)
+		if(_socketDescriptor->descriptor < 0)
 		{
 			fileDescriptorGuard.unlock();
 			_writeMutex.unlock();
 			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (4).");
 		}
-		FD_SET(_socketDescriptor->descriptor, &writeFileDescriptor);
+		//poll() instead of select(), as select() can't handle descriptors greater than FD_SETSIZE.
+		pollfd pollInfo{ _socketDescriptor->descriptor, (short)POLLOUT, (short)0 };
 		fileDescriptorGuard.unlock();
-		int32_t readyFds = select(nfds, NULL, &writeFileDescriptor, NULL, &timeout);
+		int32_t readyFds = poll(&pollInfo, 1, _writeTimeout / 1000);
 		if(readyFds == 0)
 		{
 			_writeMutex.unlock();
+			countWriteTimeout();
 			throw SocketTimeOutException("Writing to socket timed out.");
 		}
 		if(readyFds != 1)
@@ -1151,7 +2166,7 @@ int32_t TcpSocket::proofwrite(const std::vector<char>& data)
 		int32_t bytesWritten = _socketDescriptor->tlsSession ? gnutls_record_send(_socketDescriptor->tlsSession, &data.at(totalBytesWritten), data.size() - totalBytesWritten) : send(_socketDescriptor->descriptor, &data.at(totalBytesWritten), data.size() - totalBytesWritten, MSG_NOSIGNAL);
 		if(bytesWritten <= 0)
 		{
-			if(bytesWritten == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+			if(_socketDescriptor->tlsSession ? (bytesWritten == GNUTLS_E_AGAIN || bytesWritten == GNUTLS_E_INTERRUPTED) : (bytesWritten == -1 && (errno == EINTR || errno == EAGAIN))) continue;
 			_writeMutex.unlock();
 			close();
 			_writeMutex.lock();
@@ -1166,6 +2181,7 @@ int32_t TcpSocket::proofwrite(const std::vector<char>& data)
 				throw SocketOperationException(strerror(errno));
 			}
 		}
+		countSent(bytesWritten);
 		totalBytesWritten += bytesWritten;
 	}
 	_writeMutex.unlock();
@@ -1196,27 +2212,22 @@ int32_t TcpSocket::proofwrite(const char* buffer, int32_t bytesToWrite)
 	int32_t totalBytesWritten = 0;
 	while (totalBytesWritten < bytesToWrite)
 	{
-		timeval timeout;
-		int32_t seconds = _writeTimeout / 1000000;
-		timeout.tv_sec = seconds;
-		timeout.tv_usec = _writeTimeout - (1000000 * seconds);
-		fd_set writeFileDescriptor;
-		FD_ZERO(&writeFileDescriptor);
 		auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
 		fileDescriptorGuard.lock();
-		int32_t nfds = _socketDescriptor->descriptor + 1;
-		if(nfds <= 0)
+		if(_socketDescriptor->descriptor < 0)
 		{
 			fileDescriptorGuard.unlock();
 			_writeMutex.unlock();
 			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (4).");
 		}
-		FD_SET(_socketDescriptor->descriptor, &writeFileDescriptor);
+		//poll() instead of select(), as select() can't handle descriptors greater than FD_SETSIZE.
+		pollfd pollInfo{ _socketDescriptor->descriptor, (short)POLLOUT, (short)0 };
 		fileDescriptorGuard.unlock();
-		int32_t readyFds = select(nfds, NULL, &writeFileDescriptor, NULL, &timeout);
+		int32_t readyFds = poll(&pollInfo, 1, _writeTimeout / 1000);
 		if(readyFds == 0)
 		{
 			_writeMutex.unlock();
+			countWriteTimeout();
 			throw SocketTimeOutException("Writing to socket timed out.");
 		}
 		if(readyFds != 1)
@@ -1228,7 +2239,7 @@ int32_t TcpSocket::proofwrite(const char* buffer, int32_t bytesToWrite)
 		int32_t bytesWritten = _socketDescriptor->tlsSession ? gnutls_record_send(_socketDescriptor->tlsSession, buffer + totalBytesWritten, bytesToWrite - totalBytesWritten) : send(_socketDescriptor->descriptor, buffer + totalBytesWritten, bytesToWrite - totalBytesWritten, MSG_NOSIGNAL);
 		if(bytesWritten <= 0)
 		{
-			if(bytesWritten == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+			if(_socketDescriptor->tlsSession ? (bytesWritten == GNUTLS_E_AGAIN || bytesWritten == GNUTLS_E_INTERRUPTED) : (bytesWritten == -1 && (errno == EINTR || errno == EAGAIN))) continue;
 			_writeMutex.unlock();
 			close();
 			_writeMutex.lock();
@@ -1243,6 +2254,75 @@ int32_t TcpSocket::proofwrite(const char* buffer, int32_t bytesToWrite)
 				throw SocketOperationException(strerror(errno));
 			}
 		}
+		countSent(bytesWritten);
+		totalBytesWritten += bytesWritten;
+	}
+	_writeMutex.unlock();
+	return totalBytesWritten;
+}
+
+int64_t TcpSocket::proofsendfile(int32_t fileDescriptor, off_t offset, size_t length)
+{
+	if(!_socketDescriptor) throw SocketOperationException("Socket descriptor is nullptr.");
+	if(_socketDescriptor->tlsSession && !kernelTlsSendEnabled())
+	{
+		//sendfile() would bypass TLS, so the file is read in blocks.
+		std::vector<char> buffer(length > 65536 ? 65536 : length);
+		size_t totalBytesWritten = 0;
+		while(totalBytesWritten < length)
+		{
+			size_t bytesToRead = length - totalBytesWritten > buffer.size() ? buffer.size() : length - totalBytesWritten;
+			ssize_t bytesRead = pread(fileDescriptor, buffer.data(), bytesToRead, offset + totalBytesWritten);
+			if(bytesRead <= 0)
+			{
+				if(bytesRead == -1 && errno == EINTR) continue;
+				throw SocketOperationException("Could not read file: " + std::string(bytesRead == 0 ? "Unexpected end of file." : strerror(errno)));
+			}
+			proofwrite(buffer.data(), bytesRead);
+			totalBytesWritten += bytesRead;
+		}
+		return totalBytesWritten;
+	}
+
+	_writeMutex.lock();
+	size_t totalBytesWritten = 0;
+	while(totalBytesWritten < length)
+	{
+		auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
+		fileDescriptorGuard.lock();
+		int32_t socketDescriptor = _socketDescriptor->descriptor;
+		fileDescriptorGuard.unlock();
+		if(socketDescriptor == -1)
+		{
+			_writeMutex.unlock();
+			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (4).");
+		}
+
+		pollfd pollstruct { socketDescriptor, POLLOUT, 0 };
+		int32_t pollResult = poll(&pollstruct, 1, _writeTimeout / 1000);
+		if(pollResult == 0)
+		{
+			_writeMutex.unlock();
+			countWriteTimeout();
+			throw SocketTimeOutException("Writing to socket timed out.");
+		}
+		if(pollResult != 1 || (pollstruct.revents & (POLLERR | POLLHUP | POLLNVAL)))
+		{
+			if(pollResult == -1 && errno == EINTR) continue;
+			_writeMutex.unlock();
+			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (5).");
+		}
+
+		ssize_t bytesWritten = sendfile(socketDescriptor, fileDescriptor, &offset, length - totalBytesWritten);
+		if(bytesWritten <= 0)
+		{
+			if(bytesWritten == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+			std::string error = bytesWritten == 0 ? "Unexpected end of file." : strerror(errno);
+			_writeMutex.unlock();
+			close();
+			throw SocketOperationException(error);
+		}
+		countSent(bytesWritten);
 		totalBytesWritten += bytesWritten;
 	}
 	_writeMutex.unlock();
@@ -1273,27 +2353,22 @@ int32_t TcpSocket::proofwrite(const std::string& data)
 	int32_t totalBytesWritten = 0;
 	while (totalBytesWritten < (signed)data.size())
 	{
-		timeval timeout;
-		int32_t seconds = _writeTimeout / 1000000;
-		timeout.tv_sec = seconds;
-		timeout.tv_usec = _writeTimeout - (1000000 * seconds);
-		fd_set writeFileDescriptor;
-		FD_ZERO(&writeFileDescriptor);
 		auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
 		fileDescriptorGuard.lock();
-		int32_t nfds = _socketDescriptor->descriptor + 1;
-		if(nfds <= 0)
+		if(_socketDescriptor->descriptor < 0)
 		{
 			fileDescriptorGuard.unlock();
 			_writeMutex.unlock();
 			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (6).");
 		}
-		FD_SET(_socketDescriptor->descriptor, &writeFileDescriptor);
+		//poll() instead of select(), as select() can't handle descriptors greater than FD_SETSIZE.
+		pollfd pollInfo{ _socketDescriptor->descriptor, (short)POLLOUT, (short)0 };
 		fileDescriptorGuard.unlock();
-		int32_t readyFds = select(nfds, NULL, &writeFileDescriptor, NULL, &timeout);
+		int32_t readyFds = poll(&pollInfo, 1, _writeTimeout / 1000);
 		if(readyFds == 0)
 		{
 			_writeMutex.unlock();
+			countWriteTimeout();
 			throw SocketTimeOutException("Writing to socket timed out.");
 		}
 		if(readyFds != 1)
@@ -1306,7 +2381,7 @@ int32_t TcpSocket::proofwrite(const std::string& data)
 		int32_t bytesWritten = _socketDescriptor->tlsSession ? gnutls_record_send(_socketDescriptor->tlsSession, &data.at(totalBytesWritten), bytesToSend) : send(_socketDescriptor->descriptor, &data.at(totalBytesWritten), bytesToSend, MSG_NOSIGNAL);
 		if(bytesWritten <= 0)
 		{
-			if(bytesWritten == -1 && (errno == EINTR || errno == EAGAIN)) continue;
+			if(_socketDescriptor->tlsSession ? (bytesWritten == GNUTLS_E_AGAIN || bytesWritten == GNUTLS_E_INTERRUPTED) : (bytesWritten == -1 && (errno == EINTR || errno == EAGAIN))) continue;
 			_writeMutex.unlock();
 			close();
 			_writeMutex.lock();
@@ -1321,6 +2396,7 @@ int32_t TcpSocket::proofwrite(const std::string& data)
 				throw SocketOperationException(strerror(errno));
 			}
 		}
+		countSent(bytesWritten);
 		totalBytesWritten += bytesWritten;
 	}
 	_writeMutex.unlock();
@@ -1335,6 +2411,18 @@ bool TcpSocket::connected()
 	return true;
 }
 
+bool TcpSocket::isReusable()
+{
+	if(!connected()) return false;
+	if(_socketDescriptor->tlsSession && gnutls_record_check_pending(_socketDescriptor->tlsSession) > 0) return false;
+	pollfd pollInfo{};
+	pollInfo.fd = _socketDescriptor->descriptor;
+	pollInfo.events = POLLIN;
+	int32_t result = poll(&pollInfo, 1, 0);
+	//Readable means EOF, an error or data nobody asked for.
+	return result == 0;
+}
+
 void TcpSocket::getSocketDescriptor()
 {
 	_readMutex.lock();
@@ -1382,12 +2470,12 @@ void TcpSocket::getSsl()
 	int32_t result = 0;
 	//Disable TCP Nagle algorithm to improve performance
 	const int32_t value = 1;
-	if ((result = setsockopt(_socketDescriptor->descriptor, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value))) < 0)
+	if (!isUnixSocketPath(_hostname) && (result = setsockopt(_socketDescriptor->descriptor, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value))) < 0)
     {
 		_bl->fileDescriptorManager.shutdown(_socketDescriptor);
 		throw SocketSSLException("Could not disable Nagle algorithm.");
 	}
-	if((result = gnutls_init(&_socketDescriptor->tlsSession, GNUTLS_CLIENT)) != GNUTLS_E_SUCCESS)
+	if((result = gnutls_init(&_socketDescriptor->tlsSession, GNUTLS_CLIENT | GNUTLS_NO_SIGNAL)) != GNUTLS_E_SUCCESS)
 	{
 		_bl->fileDescriptorManager.shutdown(_socketDescriptor);
 		throw SocketSSLException("Could not initialize TLS session: " + std::string(gnutls_strerror(result)));
@@ -1405,12 +2493,21 @@ void TcpSocket::getSsl()
         throw SocketSSLException("Could not set trusted certificates: " + std::string(gnutls_strerror(result)));
     }
 
+	{
+		std::lock_guard<std::mutex> tlsSessionCacheGuard(_tlsSessionCacheMutex);
+		auto sessionIterator = _tlsSessionCache.find(getTlsSessionCacheKey());
+		if(sessionIterator != _tlsSessionCache.end()) gnutls_session_set_data(_socketDescriptor->tlsSession, sessionIterator->second.data(), sessionIterator->second.size());
+	}
+	gnutls_session_set_ptr(_socketDescriptor->tlsSession, this);
+	gnutls_handshake_set_hook_function(_socketDescriptor->tlsSession, GNUTLS_HANDSHAKE_NEW_SESSION_TICKET, GNUTLS_HOOK_POST, &TcpSocket::newSessionTicket);
+
 	gnutls_transport_set_ptr(_socketDescriptor->tlsSession, (gnutls_transport_ptr_t)(uintptr_t)_socketDescriptor->descriptor);
-	if((result = gnutls_server_name_set(_socketDescriptor->tlsSession, GNUTLS_NAME_DNS, _hostname.c_str(), _hostname.length())) != GNUTLS_E_SUCCESS)
+	if(!isUnixSocketPath(_hostname) && (result = gnutls_server_name_set(_socketDescriptor->tlsSession, GNUTLS_NAME_DNS, _hostname.c_str(), _hostname.length())) != GNUTLS_E_SUCCESS)
 	{
 		_bl->fileDescriptorManager.shutdown(_socketDescriptor);
 		throw SocketSSLException("Could not set server's hostname: " + std::string(gnutls_strerror(result)));
 	}
+	int64_t handshakeStartTime = HelperFunctions::getTimeMicroseconds();
 	do
 	{
 		result = gnutls_handshake(_socketDescriptor->tlsSession);
@@ -1420,6 +2517,10 @@ void TcpSocket::getSsl()
 		_bl->fileDescriptorManager.shutdown(_socketDescriptor);
 		throw SocketSSLException("Error during TLS handshake: " + std::string(gnutls_strerror(result)));
 	}
+	_tlsHandshakes++;
+	_tlsHandshakeTime.record(HelperFunctions::getTimeMicroseconds() - handshakeStartTime);
+	if(gnutls_session_is_resumed(_socketDescriptor->tlsSession)) _tlsResumedHandshakes++;
+	if(gnutls_protocol_get_version(_socketDescriptor->tlsSession) != GNUTLS_TLS1_3) storeTlsSession(_socketDescriptor->tlsSession);
 
 	//Now verify the certificate
 	uint32_t serverCertChainLength = 0;
@@ -1501,153 +2602,312 @@ void TcpSocket::getConnection()
 {
 	_socketDescriptor.reset();
 	if(_hostname.empty()) throw SocketInvalidParametersException("Hostname is empty");
+	if(isUnixSocketPath(_hostname))
+	{
+		getUnixConnection();
+		return;
+	}
 	if(_port.empty()) throw SocketInvalidParametersException("Port is empty");
 	if(_connectionRetries < 1) _connectionRetries = 1;
 	else if(_connectionRetries > 10) _connectionRetries = 10;
 
 	if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: Connecting to host " + _hostname + " on port " + _port + (_useSsl ? " using SSL" : "") + "...");
 
-	//Retry for two minutes
 	for(int32_t i = 0; i < _connectionRetries; ++i)
 	{
-		struct addrinfo *serverInfo = nullptr;
-		struct addrinfo hostInfo;
-		memset(&hostInfo, 0, sizeof hostInfo);
+		int64_t startTime = HelperFunctions::getTimeMicroseconds();
+		bool cacheHit = false;
+		std::vector<ResolvedAddress> addresses = resolveHostname(_hostname, _port, cacheHit);
+		if(cacheHit) _dnsCacheHits++;
+		else _dnsCacheMisses++;
+
+		std::string ipAddress;
+		std::string error;
+		_socketDescriptor = connectToAddresses(addresses, ipAddress, error);
+		if(_socketDescriptor)
+		{
+			_ipAddress = ipAddress;
+			uint64_t connectTime = HelperFunctions::getTimeMicroseconds() - startTime;
+			_connects++;
+			_lastConnectTime = connectTime;
+			_totalConnectTime += connectTime;
+			uint64_t maxConnectTime = _maxConnectTime;
+			while(connectTime > maxConnectTime && !_maxConnectTime.compare_exchange_weak(maxConnectTime, connectTime));
+			_connectTimeHistogram.record(connectTime);
+			break;
+		}
 
-		hostInfo.ai_family = AF_UNSPEC;
-		hostInfo.ai_socktype = SOCK_STREAM;
+		_failedConnects++;
+		//The host might have moved to other addresses
+		if(cacheHit) removeDnsCacheEntry(_hostname, _port);
+		if(i < _connectionRetries - 1)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			continue;
+		}
+		_socketDescriptor.reset();
+		throw SocketTimeOutException("Could not connect to server " + _hostname + " on port " + _port + ": " + error);
+	}
+	if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: Connected to host " + _hostname + " on port " + _port + ". Client number is: " + std::to_string(_socketDescriptor->id));
+}
+
+void TcpSocket::removeDnsCacheEntry(const std::string& hostname, const std::string& port)
+{
+	std::lock_guard<std::mutex> dnsCacheGuard(_dnsCacheMutex);
+	_dnsCache.erase(hostname + ":" + port);
+}
 
-		if(getaddrinfo(_hostname.c_str(), _port.c_str(), &hostInfo, &serverInfo) != 0)
+std::vector<TcpSocket::ResolvedAddress> TcpSocket::resolveHostname(const std::string& hostname, const std::string& port, bool& cacheHit)
+{
+	cacheHit = false;
+	std::string key = hostname + ":" + port;
+	if(_dnsCacheTtl > 0)
+	{
+		std::lock_guard<std::mutex> dnsCacheGuard(_dnsCacheMutex);
+		auto cacheIterator = _dnsCache.find(key);
+		if(cacheIterator != _dnsCache.end())
 		{
-			freeaddrinfo(serverInfo);
-			throw SocketOperationException("Could not get address information: " + std::string(strerror(errno)));
+			if(cacheIterator->second.expirationTime > HelperFunctions::getTime())
+			{
+				cacheHit = true;
+				return cacheIterator->second.addresses;
+			}
+			_dnsCache.erase(cacheIterator);
 		}
+	}
+
+	struct addrinfo* serverInfo = nullptr;
+	struct addrinfo hostInfo;
+	memset(&hostInfo, 0, sizeof hostInfo);
+
+	hostInfo.ai_family = AF_UNSPEC;
+	hostInfo.ai_socktype = SOCK_STREAM;
+
+	int32_t result = getaddrinfo(hostname.c_str(), port.c_str(), &hostInfo, &serverInfo);
+	if(result != 0)
+	{
+		if(serverInfo) freeaddrinfo(serverInfo);
+		throw SocketOperationException("Could not get address information: " + std::string(result == EAI_SYSTEM ? strerror(errno) : gai_strerror(result)));
+	}
+
+	//Group by address family, keeping the order of getaddrinfo() within each family.
+	std::vector<ResolvedAddress> preferredFamilyAddresses;
+	std::vector<ResolvedAddress> otherFamilyAddresses;
+	int32_t preferredFamily = serverInfo ? serverInfo->ai_family : AF_UNSPEC;
+	for(struct addrinfo* info = serverInfo; info; info = info->ai_next)
+	{
+		if((info->ai_family != AF_INET && info->ai_family != AF_INET6) || info->ai_addrlen > sizeof(sockaddr_storage)) continue;
+		ResolvedAddress address;
+		memset(&address.address, 0, sizeof(address.address));
+		memcpy(&address.address, info->ai_addr, info->ai_addrlen);
+		address.addressLength = info->ai_addrlen;
 
 		char ipStringBuffer[INET6_ADDRSTRLEN];
-		if (serverInfo->ai_family == AF_INET) {
-			struct sockaddr_in *s = (struct sockaddr_in *)serverInfo->ai_addr;
-			inet_ntop(AF_INET, &s->sin_addr, ipStringBuffer, sizeof(ipStringBuffer));
-		} else { // AF_INET6
-			struct sockaddr_in6 *s = (struct sockaddr_in6 *)serverInfo->ai_addr;
-			inet_ntop(AF_INET6, &s->sin6_addr, ipStringBuffer, sizeof(ipStringBuffer));
-		}
-		_ipAddress = std::string(&ipStringBuffer[0]);
+		if(info->ai_family == AF_INET) inet_ntop(AF_INET, &((struct sockaddr_in*)info->ai_addr)->sin_addr, ipStringBuffer, sizeof(ipStringBuffer));
+		else inet_ntop(AF_INET6, &((struct sockaddr_in6*)info->ai_addr)->sin6_addr, ipStringBuffer, sizeof(ipStringBuffer));
+		address.ipAddress = std::string(&ipStringBuffer[0]);
 
-		_socketDescriptor = _bl->fileDescriptorManager.add(socket(serverInfo->ai_family, serverInfo->ai_socktype, serverInfo->ai_protocol));
-		if(!_socketDescriptor || _socketDescriptor->descriptor == -1)
+		std::vector<ResolvedAddress>& familyAddresses = info->ai_family == preferredFamily ? preferredFamilyAddresses : otherFamilyAddresses;
+		bool duplicate = false;
+		for(auto& familyAddress : familyAddresses)
 		{
-			freeaddrinfo(serverInfo);
-			throw SocketOperationException("Could not create socket for server " + _ipAddress + " on port " + _port + ": " + strerror(errno));
+			if(familyAddress.ipAddress == address.ipAddress)
+			{
+				duplicate = true;
+				break;
+			}
 		}
-		int32_t optValue = 1;
-		if(setsockopt(_socketDescriptor->descriptor, SOL_SOCKET, SO_KEEPALIVE, (void*)&optValue, sizeof(int32_t)) == -1)
+		if(!duplicate) familyAddresses.push_back(std::move(address));
+	}
+	freeaddrinfo(serverInfo);
+
+	std::vector<ResolvedAddress> addresses;
+	addresses.reserve(preferredFamilyAddresses.size() + otherFamilyAddresses.size());
+	for(size_t i = 0; i < preferredFamilyAddresses.size() || i < otherFamilyAddresses.size(); i++)
+	{
+		if(i < preferredFamilyAddresses.size()) addresses.push_back(preferredFamilyAddresses[i]);
+		if(i < otherFamilyAddresses.size()) addresses.push_back(otherFamilyAddresses[i]);
+	}
+	if(addresses.empty()) throw SocketOperationException("Could not get address information: No IPv4 or IPv6 address found for " + hostname + ".");
+
+	if(_dnsCacheTtl > 0)
+	{
+		std::lock_guard<std::mutex> dnsCacheGuard(_dnsCacheMutex);
+		if(_dnsCache.size() >= 1000 && _dnsCache.find(key) == _dnsCache.end()) _dnsCache.erase(_dnsCache.begin());
+		DnsCacheEntry& entry = _dnsCache[key];
+		entry.expirationTime = HelperFunctions::getTime() + (int64_t)_dnsCacheTtl * 1000;
+		entry.addresses = addresses;
+	}
+
+	return addresses;
+}
+
+PFileDescriptor TcpSocket::startConnect(const ResolvedAddress& address, bool& connected, std::string& error)
+{
+	connected = false;
+	PFileDescriptor socketDescriptor = _bl->fileDescriptorManager.add(socket(address.address.ss_family, SOCK_STREAM, 0));
+	if(!socketDescriptor || socketDescriptor->descriptor == -1)
+	{
+		error = "Could not create socket for " + address.ipAddress + ": " + strerror(errno);
+		return PFileDescriptor();
+	}
+
+	int32_t optValue = 1;
+	bool optionsSet = setsockopt(socketDescriptor->descriptor, SOL_SOCKET, SO_KEEPALIVE, (void*)&optValue, sizeof(int32_t)) != -1;
+	//Don't use SOL_TCP, as this constant doesn't exists in BSD
+	int32_t tcpProtocol = getprotobyname("TCP")->p_proto;
+	optValue = 30;
+	if(optionsSet) optionsSet = setsockopt(socketDescriptor->descriptor, tcpProtocol, TCP_KEEPIDLE, (void*)&optValue, sizeof(int32_t)) != -1;
+	optValue = 4;
+	if(optionsSet) optionsSet = setsockopt(socketDescriptor->descriptor, tcpProtocol, TCP_KEEPCNT, (void*)&optValue, sizeof(int32_t)) != -1;
+	optValue = 15;
+	if(optionsSet) optionsSet = setsockopt(socketDescriptor->descriptor, tcpProtocol, TCP_KEEPINTVL, (void*)&optValue, sizeof(int32_t)) != -1;
+	if(optionsSet) optionsSet = fcntl(socketDescriptor->descriptor, F_SETFL, fcntl(socketDescriptor->descriptor, F_GETFL) | O_NONBLOCK) != -1;
+	if(!optionsSet)
+	{
+		error = "Could not set socket options for " + address.ipAddress + ": " + strerror(errno);
+		_bl->fileDescriptorManager.shutdown(socketDescriptor);
+		return PFileDescriptor();
+	}
+
+	if(connect(socketDescriptor->descriptor, (const struct sockaddr*)&address.address, address.addressLength) == 0)
+	{
+		connected = true;
+		return socketDescriptor;
+	}
+	if(errno != EINPROGRESS)
+	{
+		error = "Connection to " + address.ipAddress + " failed: " + strerror(errno);
+		_bl->fileDescriptorManager.shutdown(socketDescriptor);
+		return PFileDescriptor();
+	}
+	return socketDescriptor;
+}
+
+PFileDescriptor TcpSocket::connectToAddresses(const std::vector<ResolvedAddress>& addresses, std::string& ipAddress, std::string& error)
+{
+	//"Connection Attempt Delay" recommended by RFC 8305
+	const int64_t connectionAttemptDelay = 250;
+
+	std::vector<std::pair<PFileDescriptor, size_t>> attempts; //Pending connections and the index of their address
+	std::vector<pollfd> pollDescriptors;
+	size_t nextAddress = 0;
+	int64_t nextAttemptTime = 0;
+	int64_t endTime = HelperFunctions::getTime() + _readTimeout / 1000;
+	PFileDescriptor connectedDescriptor;
+
+	while(true)
+	{
+		int64_t time = HelperFunctions::getTime();
+
+		//Start the next attempt when the delay is over or immediately when all earlier attempts failed
+		if(nextAddress < addresses.size() && (time >= nextAttemptTime || attempts.empty()) && time < endTime)
 		{
-			freeaddrinfo(serverInfo);
-			_bl->fileDescriptorManager.shutdown(_socketDescriptor);
-			throw SocketOperationException("Could not set socket options for server " + _ipAddress + " on port " + _port + ": " + strerror(errno));
+			bool connected = false;
+			PFileDescriptor socketDescriptor = startConnect(addresses.at(nextAddress), connected, error);
+			if(connected)
+			{
+				connectedDescriptor = socketDescriptor;
+				ipAddress = addresses.at(nextAddress).ipAddress;
+				break;
+			}
+			if(socketDescriptor) attempts.emplace_back(socketDescriptor, nextAddress);
+			nextAddress++;
+			nextAttemptTime = time + connectionAttemptDelay;
+			continue;
 		}
-		optValue = 30;
-		//Don't use SOL_TCP, as this constant doesn't exists in BSD
-		if(setsockopt(_socketDescriptor->descriptor, getprotobyname("TCP")->p_proto, TCP_KEEPIDLE, (void*)&optValue, sizeof(int32_t)) == -1)
+
+		if(attempts.empty()) break;
+		if(time >= endTime)
 		{
-			freeaddrinfo(serverInfo);
-			_bl->fileDescriptorManager.shutdown(_socketDescriptor);
-			throw SocketOperationException("Could not set socket options for server " + _ipAddress + " on port " + _port + ": " + strerror(errno));
+			error = "Connection to " + addresses.at(attempts.front().second).ipAddress + (attempts.size() > 1 ? " and " + std::to_string(attempts.size() - 1) + " other address(es)" : "") + " timed out.";
+			break;
 		}
-		optValue = 4;
-		if(setsockopt(_socketDescriptor->descriptor, getprotobyname("TCP")->p_proto, TCP_KEEPCNT, (void*)&optValue, sizeof(int32_t)) == -1)
+
+		int64_t timeout = endTime - time;
+		if(nextAddress < addresses.size() && nextAttemptTime - time < timeout) timeout = nextAttemptTime - time;
+		pollDescriptors.clear();
+		for(auto& attempt : attempts)
 		{
-			freeaddrinfo(serverInfo);
-			_bl->fileDescriptorManager.shutdown(_socketDescriptor);
-			throw SocketOperationException("Could not set socket options for server " + _ipAddress + " on port " + _port + ": " + strerror(errno));
+			pollDescriptors.push_back(pollfd{ (int)attempt.first->descriptor, (short)(POLLOUT | POLLERR), (short)0 });
 		}
-		optValue = 15;
-		if(setsockopt(_socketDescriptor->descriptor, getprotobyname("TCP")->p_proto, TCP_KEEPINTVL, (void*)&optValue, sizeof(int32_t)) == -1)
+
+		int32_t pollResult = poll(pollDescriptors.data(), pollDescriptors.size(), (int)timeout);
+		if(pollResult < 0)
 		{
-			freeaddrinfo(serverInfo);
-			_bl->fileDescriptorManager.shutdown(_socketDescriptor);
-			throw SocketOperationException("Could not set socket options for server " + _ipAddress + " on port " + _port + ": " + strerror(errno));
+			if(errno == EINTR) continue;
+			error = "Poll failed with error: " + std::string(strerror(errno));
+			break;
 		}
+		if(pollResult == 0) continue;
 
-		if(!(fcntl(_socketDescriptor->descriptor, F_GETFL) & O_NONBLOCK))
+		for(int32_t i = (int32_t)pollDescriptors.size() - 1; i >= 0; i--)
 		{
-			if(fcntl(_socketDescriptor->descriptor, F_SETFL, fcntl(_socketDescriptor->descriptor, F_GETFL) | O_NONBLOCK) < 0)
+			if(pollDescriptors.at(i).revents == 0) continue;
+			int32_t socketError = 0;
+			socklen_t resultLength = sizeof(socketError);
+			if(getsockopt(pollDescriptors.at(i).fd, SOL_SOCKET, SO_ERROR, &socketError, &resultLength) < 0) socketError = errno;
+			if(socketError == 0)
 			{
-				freeaddrinfo(serverInfo);
-				_bl->fileDescriptorManager.shutdown(_socketDescriptor);
-				throw SocketOperationException("Could not set socket options for server " + _ipAddress + " on port " + _port + ": " + strerror(errno));
+				//When several attempts succeeded at the same time, the others are closed below
+				if(connectedDescriptor) continue;
+				connectedDescriptor = attempts.at(i).first;
+				ipAddress = addresses.at(attempts.at(i).second).ipAddress;
 			}
+			else
+			{
+				error = "Connection to " + addresses.at(attempts.at(i).second).ipAddress + " failed: " + strerror(socketError);
+				_bl->fileDescriptorManager.shutdown(attempts.at(i).first);
+			}
+			attempts.erase(attempts.begin() + i);
 		}
+		if(connectedDescriptor) break;
+	}
+
+	//Cancel the attempts that lost the race
+	for(auto& attempt : attempts)
+	{
+		if(attempt.first != connectedDescriptor) _bl->fileDescriptorManager.shutdown(attempt.first);
+	}
+	return connectedDescriptor;
+}
+
+void TcpSocket::getUnixConnection()
+{
+	sockaddr_un address{};
+	if(_hostname.size() >= sizeof(address.sun_path)) throw SocketInvalidParametersException("Socket path is too long: " + _hostname);
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, _hostname.c_str(), sizeof(address.sun_path) - 1);
+	_ipAddress = _hostname;
+
+	if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: Connecting to socket " + _hostname + (_useSsl ? " using SSL" : "") + "...");
+
+	for(int32_t i = 0; i < _connectionRetries; ++i)
+	{
+		_socketDescriptor = _bl->fileDescriptorManager.add(socket(AF_UNIX, SOCK_STREAM, 0));
+		if(!_socketDescriptor || _socketDescriptor->descriptor == -1) throw SocketOperationException("Could not create socket for " + _hostname + ": " + strerror(errno));
 
-		int32_t connectResult;
-		if((connectResult = connect(_socketDescriptor->descriptor, serverInfo->ai_addr, serverInfo->ai_addrlen)) == -1 && errno != EINPROGRESS)
+		//Connecting to a Unix domain socket doesn't wait for the server, so the socket is made non-blocking afterwards.
+		if(connect(_socketDescriptor->descriptor, (struct sockaddr*)&address, sizeof(address)) == -1)
 		{
+			std::string error = strerror(errno);
+			_bl->fileDescriptorManager.shutdown(_socketDescriptor);
 			if(i < _connectionRetries - 1)
 			{
-				freeaddrinfo(serverInfo);
-				_bl->fileDescriptorManager.shutdown(_socketDescriptor);
 				std::this_thread::sleep_for(std::chrono::milliseconds(200));
 				continue;
 			}
-			else
-			{
-				freeaddrinfo(serverInfo);
-				_bl->fileDescriptorManager.shutdown(_socketDescriptor);
-				throw SocketTimeOutException("Connecting to server " + _ipAddress + " on port " + _port + " timed out: " + strerror(errno));
-			}
+			throw SocketTimeOutException("Could not connect to socket " + _hostname + ": " + error);
 		}
-		freeaddrinfo(serverInfo);
 
-		if(connectResult != 0) //We have to wait for the connection
+		if(fcntl(_socketDescriptor->descriptor, F_SETFL, fcntl(_socketDescriptor->descriptor, F_GETFL) | O_NONBLOCK) < 0)
 		{
-			pollfd pollstruct
-			{
-				(int)_socketDescriptor->descriptor,
-				(short)(POLLIN | POLLOUT | POLLERR),
-				(short)0
-			};
-
-			int32_t pollResult = poll(&pollstruct, 1, _readTimeout / 1000);
-			if(pollResult < 0 || (pollstruct.revents & POLLERR))
-			{
-				if(i < _connectionRetries - 1)
-				{
-					_bl->fileDescriptorManager.shutdown(_socketDescriptor);
-					std::this_thread::sleep_for(std::chrono::milliseconds(200));
-					continue;
-				}
-				else
-				{
-					_bl->fileDescriptorManager.shutdown(_socketDescriptor);
-					throw SocketTimeOutException("Could not connect to server " + _ipAddress + " on port " + _port + ". Poll failed with error code: " + std::to_string(pollResult) + ".");
-				}
-			}
-			else if(pollResult > 0)
-			{
-				socklen_t resultLength = sizeof(connectResult);
-				if(getsockopt(_socketDescriptor->descriptor, SOL_SOCKET, SO_ERROR, &connectResult, &resultLength) < 0)
-				{
-					_bl->fileDescriptorManager.shutdown(_socketDescriptor);
-					throw SocketOperationException("Could not connect to server " + _ipAddress + " on port " + _port + ": " + strerror(errno) + ".");
-				}
-				break;
-			}
-			else if(pollResult == 0)
-			{
-				if(i < _connectionRetries - 1)
-				{
-					_bl->fileDescriptorManager.shutdown(_socketDescriptor);
-					continue;
-				}
-				else
-				{
-					_bl->fileDescriptorManager.shutdown(_socketDescriptor);
-					throw SocketTimeOutException("Connecting to server " + _ipAddress + " on port " + _port + " timed out.");
-				}
-			}
+			_bl->fileDescriptorManager.shutdown(_socketDescriptor);
+			throw SocketOperationException("Could not set socket options for " + _hostname + ": " + strerror(errno));
 		}
+		break;
 	}
-	if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: Connected to host " + _hostname + " on port " + _port + ". Client number is: " + std::to_string(_socketDescriptor->id));
+	if(_bl->debugLevel >= 5) _bl->out.printDebug("Debug: Connected to socket " + _hostname + ". Client number is: " + std::to_string(_socketDescriptor->id));
 }
 
 }
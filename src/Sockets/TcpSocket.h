@@ -32,6 +32,7 @@
 #define TCPSOCKETOPERATIONS_H_
 
 #include "SocketExceptions.h"
+#include "SocketMetrics.h"
 #include "../Managers/FileDescriptorManager.h"
 
 #include <thread>
@@ -39,7 +40,9 @@
 #include <iomanip>
 #include <string>
 #include <vector>
+#include <array>
 #include <list>
+#include <deque>
 #include <iterator>
 #include <sstream>
 #include <mutex>
@@ -49,6 +52,7 @@
 #include <utility>
 #include <cstring>
 #include <atomic>
+#include <limits>
 #include <functional>
 
 #include <fcntl.h>
@@ -59,6 +63,9 @@
 #include <netinet/in.h> //Needed for BSD
 #include <netdb.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <errno.h>
 #include <poll.h>
@@ -138,9 +145,19 @@ class SharedObjects;
  */
 class TcpSocket
 {
+	friend class AsyncHttpClient;
 public:
 	typedef std::vector<uint8_t> TcpPacket;
 
+	/**
+	 * Read-only view of received data. The data belongs to a pooled receive buffer and is only valid until the callback it was passed to returns.
+	 */
+	struct TcpPacketView
+	{
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+	};
+
     struct CertificateInfo
     {
         std::string certFile;
@@ -152,6 +169,54 @@ public:
     };
     typedef std::shared_ptr<CertificateInfo> PCertificateInfo;
 
+	/**
+	 * Number of TLS handshakes of a server or client socket. "resumedHandshakes" counts the handshakes that resumed an earlier session instead of doing a
+	 * full handshake.
+	 */
+	struct TlsHandshakeStatistics
+	{
+		uint64_t handshakes = 0;
+		uint64_t resumedHandshakes = 0;
+	};
+
+	/**
+	 * Connection statistics of a client socket. Connect times are in microseconds and measured from the start of the name resolution until the TCP
+	 * connection is established (without the TLS handshake). Failed connection attempts are not included in the times.
+	 */
+	struct ConnectStatistics
+	{
+		uint64_t connects = 0;
+		uint64_t failedConnects = 0;
+		uint64_t dnsCacheHits = 0;
+		uint64_t dnsCacheMisses = 0;
+		uint64_t lastConnectTime = 0;
+		uint64_t averageConnectTime = 0;
+		uint64_t maxConnectTime = 0;
+	};
+
+	/**
+	 * What to do when data is sent to a client whose send queue is above the high watermark. Only used when the send queue is enabled.
+	 */
+	enum class SlowClientPolicy
+	{
+		/**
+		 * The sending thread waits until the queue drops to the low watermark. When this takes longer than the write timeout, the client is disconnected.
+		 */
+		block,
+
+		/**
+		 * Data sent with sendToClients() is discarded until the queue drops to the low watermark. Only complete messages are discarded, so use this only
+		 * for protocols whose messages stand on their own, e. g. WebSocket events. Data sent with sendToClient() is part of a stream like an HTTP
+		 * response and is never discarded. For it the sending thread waits like with "block".
+		 */
+		drop,
+
+		/**
+		 * The client is disconnected.
+		 */
+		disconnect
+	};
+
 	struct TcpServerInfo
 	{
 		bool useSsl = false;
@@ -161,9 +226,73 @@ public:
 		std::string dhParamFile;
 		std::string dhParamData;
 		bool requireClientCert = false;
+
+		/**
+		 * Issue TLS session tickets, so returning clients can resume their session without a full handshake.
+		 */
+		bool useSessionTickets = true;
+
+		/**
+		 * Time in seconds after which the key session tickets are encrypted with is replaced by a new random key. Tickets expire after half of this time.
+		 * Tickets encrypted with the old key can't be used anymore, so tickets issued in the second half of the key lifetime might become invalid before
+		 * they expire. Their clients do a full handshake once.
+		 */
+		uint32_t sessionTicketKeyLifetime = 21600;
+
+		/**
+		 * Time in milliseconds after which connections without any traffic are closed. Set to "0" to never close idle connections.
+		 */
+		uint32_t connectionIdleTimeout = 0;
+
+		/**
+		 * Time in milliseconds a client has to complete the TLS handshake. The connection is only reported to newConnectionCallback after the handshake.
+		 * Set to "0" to wait forever.
+		 */
+		uint32_t tlsHandshakeTimeout = 10000;
+
+		/**
+		 * When set to "true", data sent to clients is appended to a per-client queue instead of being written on the calling thread. The queue is written
+		 * non-blocking using scatter-gather I/O and flushed by the server thread when the socket becomes writable again, so one slow client doesn't stall
+		 * the sending thread.
+		 */
+		bool useSendQueue = false;
+
+		/**
+		 * Number of queued bytes above which a client is considered slow and "slowClientPolicy" is applied.
+		 */
+		size_t sendQueueHighWatermark = 4194304;
+
+		/**
+		 * Number of queued bytes at or below which a slow client is accepting data again.
+		 */
+		size_t sendQueueLowWatermark = 1048576;
+		SlowClientPolicy slowClientPolicy = SlowClientPolicy::block;
+
+		/**
+		 * Time in milliseconds after which a client is disconnected when there is data in its send queue but nothing could be written. Set to "0" to
+		 * disable the timeout.
+		 */
+		uint32_t sendQueueStallTimeout = 60000;
+
+		/**
+		 * Size in bytes of the receive buffers. The buffers are shared by all clients and only borrowed while data is read, so idle connections don't use
+		 * any receive memory.
+		 */
+		size_t receiveBufferSize = 16384;
+
+		/**
+		 * Only used when listening on a Unix domain socket. Called with the process ID, user ID and group ID of every connecting process as reported by
+		 * SO_PEERCRED. Return "false" to reject the connection. When not set, every process with write access to the socket file can connect.
+		 */
+		std::function<bool(pid_t pid, uid_t uid, gid_t gid)> unixPeerCredentialsCallback;
 		std::function<void(int32_t clientId, std::string address, uint16_t port)> newConnectionCallback;
 		std::function<void(int32_t clientId)> connectionClosedCallback;
 		std::function<void(int32_t clientId, TcpPacket& packet)> packetReceivedCallback;
+
+		/**
+		 * Called instead of "packetReceivedCallback" when set. The packet points into the receive buffer, so the received data is not copied.
+		 */
+		std::function<void(int32_t clientId, const TcpPacketView& packet)> packetViewReceivedCallback;
 	};
 
 	// {{{ TCP server or client
@@ -188,8 +317,8 @@ public:
 		 * Constructor to create a TCP client socket.
 		 *
 		 * @param baseLib The base library object.
-		 * @param hostname The host name or IP address to connect to.
-		 * @param port The port to connect to.
+		 * @param hostname The host name or IP address to connect to. Set to a path starting with "/" to connect to a Unix domain socket.
+		 * @param port The port to connect to. Ignored for Unix domain sockets.
 		 */
 		TcpSocket(BaseLib::SharedObjects* baseLib, std::string hostname, std::string port);
 
@@ -272,7 +401,28 @@ public:
 
 	virtual ~TcpSocket();
 
-	static PFileDescriptor bindAndReturnSocket(FileDescriptorManager& fileDescriptorManager, std::string address, std::string port, std::string& listenAddress, int32_t& listenPort);
+	/**
+	 * Creates a listening socket.
+	 *
+	 * @param fileDescriptorManager The file descriptor manager to register the socket with.
+	 * @param address The address to bind the socket to. When the address starts with "/", a Unix domain socket is created at this path and "port" is
+	 *                ignored.
+	 * @param port The port to bind the socket to. Set to "0" to get a dynamically assigned port.
+	 * @param[out] listenAddress The IP address the socket was bound to.
+	 * @param[out] listenPort The port the socket was bound to.
+	 * @param reusePort (Optional, default "false") Set SO_REUSEPORT, so multiple sockets can listen on the same port.
+	 * @return Returns the listening socket.
+	 */
+	static PFileDescriptor bindAndReturnSocket(FileDescriptorManager& fileDescriptorManager, std::string address, std::string port, std::string& listenAddress, int32_t& listenPort, bool reusePort = false);
+
+	/**
+	 * Checks if an address is the path of a Unix domain socket. Servers and clients use a Unix domain socket instead of TCP when the address or hostname
+	 * starts with "/". The port is ignored in this case.
+	 *
+	 * @param address The address or hostname to check.
+	 * @return Returns "true" when the address starts with "/".
+	 */
+	static bool isUnixSocketPath(const std::string& address) { return !address.empty() && address.front() == '/'; }
 
 	std::string getIpAddress();
 	int32_t getPort() { return _boundListenPort; }
@@ -294,8 +444,61 @@ public:
     void setVerificationHostname(std::string hostname) { close(); _verificationHostname = hostname; }
 	std::unordered_map<std::string, gnutls_certificate_credentials_t>& getCredentials() { return _x509Credentials; }
 
+	/**
+	 * Returns the number of TLS handshakes done by this socket and how many of them resumed a session. For servers the handshakes with all clients are
+	 * counted. Clients share a session cache, so a new client object can resume a session of an earlier one connected to the same host and port.
+	 */
+	TlsHandshakeStatistics getTlsHandshakeStatistics();
+
+	/**
+	 * Returns the connect statistics of this client socket.
+	 */
+	ConnectStatistics getConnectStatistics();
+
+	/**
+	 * Returns the metrics of this socket as a struct. All sockets report the transferred bytes, read and write timeouts and TLS handshakes. Clients
+	 * additionally report their connect statistics and histograms of the connect and TLS handshake times. Servers report the totals of all clients, the
+	 * connection counters and timeouts of TcpServerMetrics, the number of connected clients and the total and maximum size of the send queues.
+	 *
+	 * @param includeClients Servers only: Add the array "clients" with the address, activity times, send queue size and transfer counters of every
+	 * connected client.
+	 */
+	PVariable getMetrics(bool includeClients = false);
+
+	/**
+	 * Sets how long resolved host names are cached by all client sockets of this process. getaddrinfo() doesn't return the TTL of the DNS records, so
+	 * this value should not be longer than the TTLs used for the hosts connected to. Entries are also removed when no address of a host could be
+	 * connected to.
+	 *
+	 * @param seconds The time in seconds. "0" disables the cache. The default is 60 seconds.
+	 */
+	static void setDnsCacheTtl(int32_t seconds) { _dnsCacheTtl = seconds < 0 ? 0 : seconds; }
+
+	/**
+	 * Removes all entries from the DNS cache.
+	 */
+	static void clearDnsCache();
+
+	/**
+	 * Checks if the kernel encrypts the TLS records sent on this connection (kTLS). In this case sendfile() and scatter-gather I/O work on TLS connections
+	 * like on plain ones. GnuTLS (3.7.3 or later) enables kTLS after the handshake when it was built with kTLS support, "ktls = true" is set in the
+	 * "[global]" section of its configuration file (e. g. "/etc/gnutls/config") and the kernel module "tls" is loaded. Otherwise the records are
+	 * encrypted by GnuTLS in user space.
+	 *
+	 * @return Returns "true" when the connection uses kTLS for sending.
+	 */
+	bool kernelTlsSendEnabled();
+
 	bool connected();
 
+	/**
+	 * Checks if an idle client connection can be used for another request. In contrast to connected(), this also detects connections closed by the remote end and
+	 * connections with unexpected pending data.
+	 *
+	 * @return Returns "true" when the socket is connected and there is nothing to read.
+	 */
+	bool isReusable();
+
 	/**
 	 * Use this overload when there are no socket operations outside of this class.
 	 *
@@ -314,7 +517,8 @@ public:
 	 * @param buffer The buffer to fill.
 	 * @param bufferSize The size of the buffer.
 	 * @param[out] moreData If true, call proofread immediately again (without calling e. g. select first).
-	 * @returns The number of bytes read. The returned value is always greater than 0.
+	 * @returns The number of bytes read. The returned value is always greater than 0 except for client sockets of a TcpSocket server, where 0 is
+	 * returned when a TLS record is incomplete.
 	 * @throws SocketOperationException Thrown when socket is nullptr.
 	 * @throws SocketTimeOutException Thrown when reading times out.
 	 * @throws SocketClosedException Thrown when socket is closed.
@@ -324,6 +528,20 @@ public:
 	int32_t proofwrite(const std::vector<char>& data);
 	int32_t proofwrite(const std::string& data);
 	int32_t proofwrite(const char* buffer, int32_t bytesToWrite);
+
+	/**
+	 * Writes a part of a file to the socket. On plain connections and TLS connections using kTLS the kernel copies the data directly from the page cache
+	 * using sendfile(). On other TLS connections the file is read in blocks and encrypted.
+	 *
+	 * @param fileDescriptor The descriptor of the file opened for reading.
+	 * @param offset The position within the file to start at.
+	 * @param length The number of bytes to send.
+	 * @returns The number of bytes written.
+	 * @throws SocketOperationException Thrown when socket is nullptr or the file can't be read.
+	 * @throws SocketTimeOutException Thrown when writing times out.
+	 * @throws SocketClosedException Thrown when socket is closed.
+	 */
+	int64_t proofsendfile(int32_t fileDescriptor, off_t offset, size_t length);
 	void open();
 	void close();
 
@@ -331,8 +549,8 @@ public:
 		/**
 		 * Starts listening.
 		 *
-		 * @param address The address to bind the server to (e. g. `::` or `0.0.0.0`).
-		 * @param port The port number to bind the server to.
+		 * @param address The address to bind the server to (e. g. `::` or `0.0.0.0`) or the path of a Unix domain socket starting with "/".
+		 * @param port The port number to bind the server to. Ignored for Unix domain sockets.
 		 * @param[out] listenAddress The IP address the server was bound to (e. g. `192.168.0.152`).
 		 */
 		void startServer(std::string address, std::string port, std::string& listenAddress);
@@ -365,6 +583,60 @@ public:
 		 */
 		void sendToClient(int32_t clientId, TcpPacket packet, bool closeConnection = false);
 
+		/**
+		 * Sends a header followed by data from a buffer owned by the caller to a TCP client connected to the server. The data is not copied. When the send
+		 * queue is enabled, data up to the size of the high watermark is copied into the queue. Larger data is written directly after the queue is empty.
+		 *
+		 * @param clientId The ID of the client as passed to TcpSocket::TcpServerServer::packetReceivedCallback.
+		 * @param header The data to send first.
+		 * @param data The data to send after the header.
+		 * @param size The size of "data".
+		 * @param closeConnection Close the connection after sending the data.
+		 */
+		void sendToClient(int32_t clientId, const TcpPacket& header, const char* data, size_t size, bool closeConnection);
+
+		/**
+		 * Sends a header followed by shared data to a TCP client connected to the server, e. g. to send the same data with a different header to multiple
+		 * clients. When the send queue is enabled, the header and the data are queued as separate entries, so the data is not copied. Both are discarded
+		 * together according to SlowClientPolicy::drop.
+		 *
+		 * @param clientId The ID of the client as passed to TcpSocket::TcpServerServer::packetReceivedCallback.
+		 * @param header The data to send first.
+		 * @param data The data to send after the header.
+		 * @param closeConnection Close the connection after sending the data.
+		 */
+		void sendToClient(int32_t clientId, const TcpPacket& header, const std::shared_ptr<const std::vector<char>>& data, bool closeConnection);
+
+		/**
+		 * Sends the same data to multiple TCP clients connected to the server, e. g. an event encoded once with WebSocket::encodeShared(). The data is
+		 * neither copied nor modified, only encryption is done per client. Clients the data can't be sent to are disconnected.
+		 *
+		 * @param clientIds The IDs of the clients as passed to TcpSocket::TcpServerServer::packetReceivedCallback. Unknown IDs are ignored.
+		 * @param packet The data to send.
+		 */
+		void sendToClients(const std::vector<int32_t>& clientIds, const std::shared_ptr<const std::vector<char>>& packet);
+
+		/**
+		 * Sends a header followed by a part of a file to a TCP client connected to the server using proofsendfile(). When the send queue is enabled, the
+		 * queue is written first.
+		 *
+		 * @param clientId The ID of the client as passed to TcpSocket::TcpServerServer::packetReceivedCallback.
+		 * @param header The data to send first.
+		 * @param fileDescriptor The descriptor of the file opened for reading.
+		 * @param offset The position within the file to start at.
+		 * @param length The number of bytes of the file to send.
+		 * @param closeConnection Close the connection after sending the data.
+		 */
+		void sendFileToClient(int32_t clientId, const TcpPacket& header, int32_t fileDescriptor, off_t offset, size_t length, bool closeConnection);
+
+		/**
+		 * Checks if the kernel encrypts the data sent to a client. See kernelTlsSendEnabled().
+		 *
+		 * @param clientId The ID of the client as passed to TcpSocket::TcpServerServer::packetReceivedCallback.
+		 * @return Returns "true" when the connection to the client uses kTLS for sending.
+		 */
+		bool clientKernelTlsSendEnabled(int32_t clientId);
+
         /**
          * Returns the number of clients connected to the TCP server
          * @return The number of connected clients.
@@ -376,22 +648,119 @@ protected:
 	{
 		int32_t id = 0;
 		PFileDescriptor fileDescriptor;
-		std::vector<uint8_t> buffer;
 		std::shared_ptr<TcpSocket> socket;
+		std::atomic<int64_t> lastActivity{0};
+		int32_t epollDescriptor = -1;
+		std::atomic_bool closed{false};
+		std::string address;
+		uint16_t port = 0;
+		int64_t connectTime = 0;
+		int64_t connectTimeMicroseconds = 0;
+		std::atomic_bool tlsHandshakePending{false};
+		int64_t timerTime = 0; //Guarded by the timer wheel's mutex
 
-		TcpClientData()
-		{
-			buffer.resize(1024);
-		}
+		// {{{ Send queue
+			std::mutex sendQueueMutex;
+			std::deque<std::shared_ptr<const std::vector<char>>> sendQueue;
+			size_t sendQueueOffset = 0; //Number of bytes of the first element already written
+			size_t sendQueueSize = 0; //Number of bytes not written yet
+			bool congested = false;
+			bool closeAfterSend = false;
+			bool writeEventEnabled = false;
+			int64_t lastSendProgress = 0;
+		// }}}
 	};
 	typedef std::shared_ptr<TcpClientData> PTcpClientData;
 
+	/**
+	 * Pool of fixed-size receive buffers shared by all clients of a server. Buffers are allocated in slabs of several buffers and are only borrowed while
+	 * a read is in progress. Slabs are freed when the pool is destroyed.
+	 */
+	class ReceiveBufferPool
+	{
+	public:
+		ReceiveBufferPool(size_t bufferSize, size_t buffersPerSlab);
+		size_t bufferSize() { return _bufferSize; }
+
+		/**
+		 * Borrows a buffer of bufferSize() bytes. Return it with put().
+		 */
+		uint8_t* get();
+
+		/**
+		 * Returns a buffer borrowed with get().
+		 */
+		void put(uint8_t* buffer);
+	private:
+		size_t _bufferSize = 0;
+		size_t _buffersPerSlab = 0;
+		std::mutex _buffersMutex;
+		std::vector<std::unique_ptr<uint8_t[]>> _slabs;
+		std::vector<uint8_t*> _freeBuffers;
+	};
+
+	/**
+	 * Hashed timer wheel tracking the deadlines (TLS handshake, idle connection, stalled send queue) of the clients of a server shard. Every client has at
+	 * most one entry, the time its earliest deadline expires. Activity doesn't touch the wheel: When an entry expires, the deadlines of the client are
+	 * checked again and the client is rescheduled if it was active in the meantime. Scheduling and expiring are O(1) per entry.
+	 */
+	class TimerWheel
+	{
+	public:
+		TimerWheel(int64_t tickLength = 100, uint32_t slotCount = 512);
+
+		/**
+		 * Schedules a client. Nothing is done when the client is scheduled at or before "time" already.
+		 *
+		 * @param clientData The client to schedule.
+		 * @param time The time in milliseconds to expire the entry at.
+		 */
+		void schedule(const PTcpClientData& clientData, int64_t time);
+
+		/**
+		 * Processes all ticks up to "time".
+		 *
+		 * @param time The current time in milliseconds.
+		 * @param[out] expired The clients whose entries expired. They are not scheduled anymore.
+		 */
+		void advance(int64_t time, std::vector<PTcpClientData>& expired);
+	private:
+		struct Entry
+		{
+			PTcpClientData clientData;
+			int64_t time = 0;
+		};
+
+		int64_t _tickLength = 100;
+		int64_t _currentTick = 0;
+		std::mutex _slotsMutex;
+		std::vector<std::vector<Entry>> _slots;
+	};
+
+	/**
+	 * The state of one server thread. Every server thread has its own listening socket, epoll instance and client table. With more than one server thread
+	 * the listening sockets are bound using SO_REUSEPORT, so the kernel distributes new connections between the threads. The client IDs of a shard
+	 * are assigned so that "clientId % number of shards" is the shard's index.
+	 */
+	struct ServerShard
+	{
+		uint32_t index = 0;
+		PFileDescriptor socketDescriptor;
+		int64_t lastGarbageCollection = 0;
+		TimerWheel timers;
+		int32_t nextClientId = 0;
+		std::mutex clientsMutex;
+		std::map<int32_t, PTcpClientData> clients;
+	};
+	typedef std::shared_ptr<ServerShard> PServerShard;
+
 	BaseLib::SharedObjects* _bl = nullptr;
 	int32_t _connectionRetries = 3;
 	int64_t _readTimeout = 15000000;
 	int64_t _writeTimeout = 15000000;
 	std::atomic_bool _connecting;
 	bool _autoConnect = true;
+	bool _reactorClient = false; //Client socket of a TcpSocket server. proofread() must not block the server thread.
 	std::string _ipAddress;
 	std::string _hostname;
     std::string _verificationHostname;
@@ -401,6 +770,41 @@ protected:
     std::unordered_map<std::string, PCertificateInfo> _certificates;
 	bool _verifyCertificate = true;
 	bool _verifyHostname = true;
+	std::atomic<uint64_t> _tlsHandshakes{0};
+	std::atomic<uint64_t> _tlsResumedHandshakes{0};
+	std::shared_ptr<SocketMetrics> _metrics = std::make_shared<SocketMetrics>();
+	std::shared_ptr<SocketMetrics> _parentMetrics; //Set for the client sockets of a server to also count the transfers in the server's totals
+
+	// {{{ For client only
+		struct ResolvedAddress
+		{
+			sockaddr_storage address;
+			socklen_t addressLength = 0;
+			std::string ipAddress;
+		};
+
+		struct DnsCacheEntry
+		{
+			int64_t expirationTime = 0;
+			std::vector<ResolvedAddress> addresses;
+		};
+
+		static std::mutex _tlsSessionCacheMutex;
+		static std::unordered_map<std::string, std::vector<uint8_t>> _tlsSessionCache;
+		static std::mutex _dnsCacheMutex;
+		static std::unordered_map<std::string, DnsCacheEntry> _dnsCache;
+		static std::atomic<int32_t> _dnsCacheTtl;
+
+		std::atomic<uint64_t> _connects{0};
+		std::atomic<uint64_t> _failedConnects{0};
+		std::atomic<uint64_t> _dnsCacheHits{0};
+		std::atomic<uint64_t> _dnsCacheMisses{0};
+		std::atomic<uint64_t> _lastConnectTime{0};
+		std::atomic<uint64_t> _totalConnectTime{0};
+		std::atomic<uint64_t> _maxConnectTime{0};
+		LatencyHistogram _connectTimeHistogram;
+		LatencyHistogram _tlsHandshakeTime;
+	// }}}
 
 	// {{{ For server only
 		bool _isServer = false;
@@ -408,25 +812,37 @@ protected:
 		std::string _dhParamFile;
 		std::string _dhParamData;
 		bool _requireClientCert = false;
+		bool _useSessionTickets = true;
+		int64_t _sessionTicketKeyLifetime = 21600;
+		std::mutex _sessionTicketKeyMutex;
+		gnutls_datum_t _sessionTicketKey{nullptr, 0};
+		int64_t _sessionTicketKeyCreationTime = 0;
+		int64_t _connectionIdleTimeout = 0;
+		int64_t _tlsHandshakeTimeout = 10000;
+		int64_t _sendQueueStallTimeout = 60000;
+		bool _useSendQueue = false;
+		size_t _sendQueueHighWatermark = 4194304;
+		size_t _sendQueueLowWatermark = 1048576;
+		SlowClientPolicy _slowClientPolicy = SlowClientPolicy::block;
 		std::function<void(int32_t clientId, std::string address, uint16_t port)> _newConnectionCallback;
 		std::function<void(int32_t clientId)> _connectionClosedCallback;
 		std::function<void(int32_t clientId, TcpPacket& packet)> _packetReceivedCallback;
+		std::function<void(int32_t clientId, const TcpPacketView& packet)> _packetViewReceivedCallback;
+		std::unique_ptr<ReceiveBufferPool> _receiveBufferPool;
+		std::function<bool(pid_t pid, uid_t uid, gid_t gid)> _unixPeerCredentialsCallback;
+		TcpServerMetrics _tcpServerMetrics;
 
 		std::string _listenAddress;
 		std::string _listenPort;
 		int32_t _boundListenPort = -1;
+		std::string _boundUnixSocketPath;
 
 		gnutls_dh_params_t _dhParams = nullptr;
 		gnutls_priority_t _tlsPriorityCache = nullptr;
 
 		std::atomic_bool _stopServer;
 		std::vector<std::thread> _serverThreads;
-
-		int64_t _lastGarbageCollection = 0;
-
-		int32_t _currentClientId = 0;
-		std::mutex _clientsMutex;
-		std::map<int32_t, PTcpClientData> _clients;
+		std::vector<PServerShard> _serverShards;
 	// }}}
 
 	std::mutex _socketDescriptorMutex;
@@ -436,19 +852,175 @@ protected:
 
 	void getSocketDescriptor();
 	void getConnection();
+
+	/**
+	 * Connects to the Unix domain socket at the path in "_hostname".
+	 */
+	void getUnixConnection();
 	void getSsl();
 	void initSsl();
 	void autoConnect();
     void freeCredentials();
 
+	void countReceived(size_t bytes) { _metrics->received(bytes); if(_parentMetrics) _parentMetrics->received(bytes); }
+	void countSent(size_t bytes) { _metrics->sent(bytes); if(_parentMetrics) _parentMetrics->sent(bytes); }
+	void countReadTimeout() { SocketMetrics::increment(_metrics->readTimeouts); if(_parentMetrics) SocketMetrics::increment(_parentMetrics->readTimeouts); }
+	void countWriteTimeout() { SocketMetrics::increment(_metrics->writeTimeouts); if(_parentMetrics) SocketMetrics::increment(_parentMetrics->writeTimeouts); }
+
+	// {{{ For client only
+		/**
+		 * Returns the key of the TLS session cache. Sessions are only shared between connections to the same host and port using the same client certificate.
+		 */
+		std::string getTlsSessionCacheKey();
+
+		/**
+		 * Stores the resumption data of an established TLS session in the session cache.
+		 */
+		void storeTlsSession(gnutls_session_t tlsSession);
+
+		/**
+		 * Returns the addresses of a host from the DNS cache or resolves them with getaddrinfo(). The addresses are ordered as recommended by RFC 8305:
+		 * Address families alternate, starting with the family of the address getaddrinfo() prefers.
+		 *
+		 * @param[out] cacheHit Set to "true" when the addresses were taken from the cache.
+		 * @throws SocketOperationException Thrown when the hostname can't be resolved.
+		 */
+		static std::vector<ResolvedAddress> resolveHostname(const std::string& hostname, const std::string& port, bool& cacheHit);
+
+		/**
+		 * Removes a host from the DNS cache, e. g. because none of its addresses could be connected to and the host might have moved.
+		 */
+		static void removeDnsCacheEntry(const std::string& hostname, const std::string& port);
+
+		/**
+		 * Creates a non-blocking socket for "address" and starts connecting.
+		 *
+		 * @param[out] connected Set to "true" when the connection was established immediately.
+		 * @param[out] error Set to the error message when starting the connection failed.
+		 * @return Returns the socket or nullptr on error.
+		 */
+		PFileDescriptor startConnect(const ResolvedAddress& address, bool& connected, std::string& error);
+
+		/**
+		 * Connects to the first reachable address using "Happy Eyeballs" (RFC 8305): A new connection attempt is started every 250 ms while the earlier ones
+		 * are still pending. The first established connection wins, all other attempts are cancelled.
+		 *
+		 * @param addresses The addresses as returned by resolveHostname().
+		 * @param[out] ipAddress Set to the address connected to.
+		 * @param[out] error Set to the last error when no connection could be established.
+		 * @return Returns the connected socket or nullptr when no address could be connected to within the read timeout.
+		 */
+		PFileDescriptor connectToAddresses(const std::vector<ResolvedAddress>& addresses, std::string& ipAddress, std::string& error);
+
+		/**
+		 * Handshake hook to store the session when a TLS 1.3 server sends a session ticket. TLS 1.3 tickets are sent after the handshake is completed.
+		 */
+		static int newSessionTicket(gnutls_session_t tlsSession, unsigned int type, unsigned int when, unsigned int incoming, const gnutls_datum_t* message);
+	// }}}
+
 	// {{{ For server only
 		void bindSocket();
+		void bindSocket(PServerShard& shard);
+
+		/**
+		 * Creates a listening Unix domain socket. An existing socket file nobody is listening on anymore is replaced.
+		 */
+		static PFileDescriptor bindAndReturnUnixSocket(FileDescriptorManager& fileDescriptorManager, const std::string& path);
+
+		/**
+		 * Closes the listening sockets and removes the socket file when listening on a Unix domain socket.
+		 */
+		void closeListeners();
+
+		/**
+		 * Returns the client with the given ID from the client table of its shard.
+		 *
+		 * @return Returns the client or nullptr when it doesn't exist.
+		 */
+		PTcpClientData getClientData(int32_t clientId);
 
-		void serverThread();
+		void serverThread(uint32_t shardIndex);
 		void collectGarbage();
-		void collectGarbage(std::map<int32_t, PTcpClientData>& clients);
+		void collectGarbage(PServerShard& shard);
+
+		/**
+		 * Creates the TLS session of a new client and makes its socket non-blocking for the handshake.
+		 */
 		void initClientSsl(PFileDescriptor fileDescriptor);
+
+		/**
+		 * Frees the session ticket key. "_sessionTicketKeyMutex" needs to be locked.
+		 */
+		void freeSessionTicketKey();
+
+		/**
+		 * Continues the TLS handshake of a client. When the handshake is done, the connection is reported to the new connection callback. Otherwise the
+		 * client is registered for the socket event the handshake is waiting for.
+		 */
+		void continueTlsHandshake(PTcpClientData& clientData);
+
+		/**
+		 * Expires the timer wheel entries of a shard up to the current time and calls checkTimeouts() for each of them.
+		 */
+		void processTimers(PServerShard& shard);
+
+		/**
+		 * Closes the connection of a client when one of its deadlines passed and otherwise schedules the client for the earliest remaining deadline.
+		 * Closed clients are removed from the client table.
+		 */
+		void checkTimeouts(PServerShard& shard, PTcpClientData& clientData);
+
+		/**
+		 * Accepts all pending connections on the listening socket of a shard and adds them to the shard's epoll instance.
+		 */
+		void acceptClients(PServerShard& shard, int32_t epollDescriptor);
+
+		/**
+		 * Reads until no more data is available, as the client descriptors are registered edge-triggered.
+		 */
 		void readClient(PTcpClientData clientData);
+
+		/**
+		 * Closes the connection and calls the connection closed callback unless this was done already.
+		 */
+		void closeClient(PTcpClientData& clientData);
+
+		// {{{ Send queue
+			/**
+			 * Appends data to the send queue of a client, applies the slow client policy and tries to write the queue immediately.
+			 *
+			 * @param clientData The client to send the data to.
+			 * @param data The data to queue. Can be nullptr to only close the connection.
+			 * @param closeConnection Close the connection after all queued data is written.
+			 * @param droppable Set to "true" when "data" is a complete message which can be discarded according to SlowClientPolicy::drop.
+			 * @param header (Optional) Data to queue in front of "data". Both are queued under the same lock, so nothing is written in between.
+			 */
+			void queueData(PTcpClientData& clientData, const std::shared_ptr<const std::vector<char>>& data, bool closeConnection, bool droppable = false, const std::shared_ptr<const std::vector<char>>& header = std::shared_ptr<const std::vector<char>>());
+
+			/**
+			 * Writes as much of the send queue as possible without blocking. "sendQueueMutex" needs to be locked.
+			 *
+			 * @return Returns "false" when the connection is broken.
+			 */
+			bool flushSendQueue(PTcpClientData& clientData);
+
+			/**
+			 * Waits until the send queue is empty. "sendQueueGuard" needs to own "sendQueueMutex" and still owns it on return.
+			 *
+			 * @return Returns "false" when the connection is broken or the write timeout is exceeded.
+			 */
+			bool drainSendQueue(PTcpClientData& clientData, std::unique_lock<std::mutex>& sendQueueGuard);
+
+			/**
+			 * Registers for EPOLLOUT when there is queued data and unregisters when the queue is empty. "sendQueueMutex" needs to be locked.
+			 */
+			void updateWriteEvent(PTcpClientData& clientData);
+
+			/**
+			 * Called by the server thread when the socket of a client is writable again.
+			 */
+			void writeClient(PTcpClientData& clientData);
+		// }}}
 	// }}}
 };
 
@@ -93,27 +93,22 @@ int32_t UdpSocket::proofread(char* buffer, int32_t bufferSize, std::string& send
 		if(!isOpen()) throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (8).");
 		_readMutex.lock();
 	}
-	timeval timeout;
-	int32_t seconds = _readTimeout / 1000000;
-	timeout.tv_sec = seconds;
-	timeout.tv_usec = _readTimeout - (1000000 * seconds);
-	fd_set readFileDescriptor;
-	FD_ZERO(&readFileDescriptor);
 	auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
 	fileDescriptorGuard.lock();
-	int32_t nfds = _socketDescriptor->descriptor + 1;
-	if(nfds <= 0)
+	if(_socketDescriptor->descriptor < 0)
 	{
 		fileDescriptorGuard.unlock();
 		_readMutex.unlock();
 		throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (1).");
 	}
-	FD_SET(_socketDescriptor->descriptor, &readFileDescriptor);
+	//poll() instead of select(), as select() can't handle descriptors greater than FD_SETSIZE.
+	pollfd pollInfo{ _socketDescriptor->descriptor, (short)POLLIN, (short)0 };
 	fileDescriptorGuard.unlock();
-	int32_t bytesRead = select(nfds, &readFileDescriptor, NULL, NULL, &timeout);
+	int32_t bytesRead = poll(&pollInfo, 1, _readTimeout / 1000);
 	if(bytesRead == 0)
 	{
 		_readMutex.unlock();
+		SocketMetrics::increment(_metrics.readTimeouts);
 		throw SocketTimeOutException("Reading from socket timed out.");
 	}
 	if(bytesRead != 1)
@@ -121,12 +116,12 @@ int32_t UdpSocket::proofread(char* buffer, int32_t bufferSize, std::string& send
 		_readMutex.unlock();
 		throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (2).");
 	}
-	struct sockaddr clientInfo;
-	memset(&clientInfo, 0, sizeof(sockaddr));
-	uint32_t addressLength = sizeof(sockaddr);
+	struct sockaddr_storage clientInfo;
+	memset(&clientInfo, 0, sizeof(clientInfo));
+	socklen_t addressLength = sizeof(clientInfo);
 	do
 	{
-		bytesRead = recvfrom(_socketDescriptor->descriptor, buffer, bufferSize, 0, &clientInfo, &addressLength);
+		bytesRead = recvfrom(_socketDescriptor->descriptor, buffer, bufferSize, 0, (struct sockaddr*)&clientInfo, &addressLength);
 	} while(bytesRead < 0 && (errno == EAGAIN || errno == EINTR));
 	if(bytesRead <= 0)
 	{
@@ -134,19 +129,99 @@ int32_t UdpSocket::proofread(char* buffer, int32_t bufferSize, std::string& send
 		throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (3).");
 	}
 	_readMutex.unlock();
-	char ipStringBuffer[INET6_ADDRSTRLEN];
-	if(clientInfo.sa_family == AF_INET)
+	_metrics.received(bytesRead);
+	uint16_t senderPort = 0;
+	getAddress(clientInfo, senderIp, senderPort);
+	return bytesRead;
+}
+
+int32_t UdpSocket::proofreadBatch(std::vector<Datagram>& datagrams, uint32_t maxDatagrams, uint32_t maxDatagramSize)
+{
+	if(!_socketDescriptor) throw SocketOperationException("Socket descriptor is nullptr.");
+	if(maxDatagrams == 0 || maxDatagramSize == 0) throw SocketInvalidParametersException("maxDatagrams and maxDatagramSize need to be greater than 0.");
+	if(maxDatagrams > UIO_MAXIOV) maxDatagrams = UIO_MAXIOV;
+	std::unique_lock<std::mutex> readGuard(_readMutex);
+	if(_autoConnect && !isOpen())
 	{
-		struct sockaddr_in *s = (struct sockaddr_in*)&clientInfo;
-		inet_ntop(AF_INET, &s->sin_addr, ipStringBuffer, sizeof(ipStringBuffer));
+		readGuard.unlock();
+		autoConnect();
+		if(!isOpen()) throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (8).");
+		readGuard.lock();
 	}
-	else
-	{ // AF_INET6
-		struct sockaddr_in6 *s = (struct sockaddr_in6*)&clientInfo;
-		inet_ntop(AF_INET6, &s->sin6_addr, ipStringBuffer, sizeof(ipStringBuffer));
+
+	if(_batchBuffer.size() < (size_t)maxDatagrams * maxDatagramSize) _batchBuffer.resize((size_t)maxDatagrams * maxDatagramSize);
+	const size_t controlSize = CMSG_SPACE(sizeof(struct timeval));
+	std::vector<struct mmsghdr> messages(maxDatagrams);
+	std::vector<struct iovec> buffers(maxDatagrams);
+	std::vector<struct sockaddr_storage> addresses(maxDatagrams);
+	std::vector<char> control(maxDatagrams * controlSize);
+
+	int64_t endTime = HelperFunctions::getTime() + _readTimeout / 1000;
+	int32_t count = 0;
+	while(true)
+	{
+		auto fileDescriptorGuard = _bl->fileDescriptorManager.getLock();
+		fileDescriptorGuard.lock();
+		if(_socketDescriptor->descriptor < 0)
+		{
+			fileDescriptorGuard.unlock();
+			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (1).");
+		}
+		pollfd pollInfo{ _socketDescriptor->descriptor, (short)POLLIN, (short)0 };
+		fileDescriptorGuard.unlock();
+		int64_t timeout = endTime - HelperFunctions::getTime();
+		int32_t result = poll(&pollInfo, 1, timeout > 0 ? timeout : 0);
+		if(result == 0)
+		{
+			SocketMetrics::increment(_metrics.readTimeouts);
+			throw SocketTimeOutException("Reading from socket timed out.");
+		}
+		if(result != 1)
+		{
+			if(result == -1 && errno == EINTR) continue;
+			throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (2).");
+		}
+
+		for(uint32_t i = 0; i < maxDatagrams; i++)
+		{
+			buffers[i].iov_base = _batchBuffer.data() + (size_t)i * maxDatagramSize;
+			buffers[i].iov_len = maxDatagramSize;
+			memset(&messages[i], 0, sizeof(struct mmsghdr));
+			messages[i].msg_hdr.msg_iov = &buffers[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+			messages[i].msg_hdr.msg_name = &addresses[i];
+			messages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+			messages[i].msg_hdr.msg_control = control.data() + i * controlSize;
+			messages[i].msg_hdr.msg_controllen = controlSize;
+		}
+		//The datagrams are already queued, so MSG_DONTWAIT only returns what is available instead of waiting for "maxDatagrams" datagrams.
+		count = recvmmsg(pollInfo.fd, messages.data(), maxDatagrams, MSG_DONTWAIT, nullptr);
+		if(count > 0) break;
+		if(count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+		throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (3)" + (count == -1 ? ": " + std::string(strerror(errno)) : "."));
 	}
-	senderIp = std::string(&ipStringBuffer[0]);
-	return bytesRead;
+
+	//_readMutex stays locked until the datagrams are copied out of _batchBuffer.
+	if(datagrams.size() < maxDatagrams) datagrams.resize(maxDatagrams);
+	int64_t time = HelperFunctions::getTimeMicroseconds();
+	for(int32_t i = 0; i < count; i++)
+	{
+		Datagram& datagram = datagrams[i];
+		size_t size = messages[i].msg_len > maxDatagramSize ? maxDatagramSize : messages[i].msg_len;
+		datagram.data.assign((char*)buffers[i].iov_base, (char*)buffers[i].iov_base + size);
+		datagram.truncated = messages[i].msg_hdr.msg_flags & MSG_TRUNC;
+		getAddress(addresses[i], datagram.senderIp, datagram.senderPort);
+		datagram.timestamp = time;
+		for(struct cmsghdr* controlMessage = CMSG_FIRSTHDR(&messages[i].msg_hdr); controlMessage; controlMessage = CMSG_NXTHDR(&messages[i].msg_hdr, controlMessage))
+		{
+			if(controlMessage->cmsg_level != SOL_SOCKET || controlMessage->cmsg_type != SCM_TIMESTAMP) continue;
+			struct timeval receiveTime;
+			memcpy(&receiveTime, CMSG_DATA(controlMessage), sizeof(receiveTime));
+			datagram.timestamp = (int64_t)receiveTime.tv_sec * 1000000 + receiveTime.tv_usec;
+		}
+		_metrics.received(size);
+	}
+	return count;
 }
 
 int32_t UdpSocket::proofwrite(const std::shared_ptr<std::vector<char>> data)
@@ -188,6 +263,7 @@ int32_t UdpSocket::proofwrite(const std::vector<char>& data)
 			close();
 			throw SocketOperationException(strerror(errno));
 		}
+		_metrics.sent(bytesWritten);
 		totalBytesWritten += bytesWritten;
 	}
 	_writeMutex.unlock();
@@ -227,6 +303,7 @@ int32_t UdpSocket::proofwrite(const char* buffer, int32_t bytesToWrite)
 			close();
 			throw SocketOperationException(strerror(errno));
 		}
+		_metrics.sent(bytesWritten);
 		totalBytesWritten += bytesWritten;
 	}
 	_writeMutex.unlock();
@@ -267,12 +344,128 @@ int32_t UdpSocket::proofwrite(const std::string& data)
 			close();
 			throw SocketOperationException(strerror(errno));
 		}
+		_metrics.sent(bytesWritten);
 		totalBytesWritten += bytesWritten;
 	}
 	_writeMutex.unlock();
 	return totalBytesWritten;
 }
 
+PVariable UdpSocket::getMetrics()
+{
+	PVariable metrics = std::make_shared<Variable>(VariableType::tStruct);
+	_metrics.addTo(metrics);
+	return metrics;
+}
+
+int32_t UdpSocket::proofwriteBatch(const std::vector<std::vector<char>>& datagrams)
+{
+	if(!_socketDescriptor) throw SocketOperationException("Socket descriptor is nullptr.");
+	std::unique_lock<std::mutex> writeGuard(_writeMutex);
+	if(!isOpen())
+	{
+		writeGuard.unlock();
+		autoConnect();
+		if(!isOpen()) throw SocketClosedException("Connection to client number " + std::to_string(_socketDescriptor->id) + " closed (8).");
+		writeGuard.lock();
+	}
+	if(datagrams.empty()) return 0;
+
+	std::vector<struct mmsghdr> messages(datagrams.size());
+	std::vector<struct iovec> buffers(datagrams.size());
+	for(size_t i = 0; i < datagrams.size(); i++)
+	{
+		if(datagrams[i].size() > 104857600) throw SocketDataLimitException("Data size is larger than 100 MiB.");
+		buffers[i].iov_base = (void*)datagrams[i].data();
+		buffers[i].iov_len = datagrams[i].size();
+		memset(&messages[i], 0, sizeof(struct mmsghdr));
+		messages[i].msg_hdr.msg_iov = &buffers[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+		messages[i].msg_hdr.msg_name = _serverInfo->ai_addr;
+		messages[i].msg_hdr.msg_namelen = _serverInfo->ai_addrlen;
+	}
+
+	size_t datagramsSent = 0;
+	int64_t endTime = HelperFunctions::getTime() + _writeTimeout / 1000;
+	while(datagramsSent < datagrams.size())
+	{
+		//sendmmsg() sends at most UIO_MAXIOV datagrams per call.
+		size_t datagramsToSend = datagrams.size() - datagramsSent;
+		if(datagramsToSend > UIO_MAXIOV) datagramsToSend = UIO_MAXIOV;
+		int32_t result = sendmmsg(_socketDescriptor->descriptor, messages.data() + datagramsSent, datagramsToSend, 0);
+		if(result <= 0)
+		{
+			if(result == -1 && errno == EINTR) continue;
+			if(result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			{
+				//The socket is non-blocking, so wait until the send buffer has room again.
+				int64_t timeout = endTime - HelperFunctions::getTime();
+				if(timeout <= 0)
+				{
+					SocketMetrics::increment(_metrics.writeTimeouts);
+					throw SocketTimeOutException("Writing to socket timed out.");
+				}
+				pollfd pollInfo{ _socketDescriptor->descriptor, (short)POLLOUT, (short)0 };
+				poll(&pollInfo, 1, timeout > 100 ? 100 : timeout);
+				continue;
+			}
+			writeGuard.unlock();
+			close();
+			throw SocketOperationException(strerror(errno));
+		}
+		for(int32_t i = 0; i < result; i++)
+		{
+			_metrics.sent(messages[datagramsSent + i].msg_len);
+		}
+		datagramsSent += result;
+	}
+	return datagramsSent;
+}
+
+void UdpSocket::setReceiveBufferSize(int32_t size)
+{
+	std::lock_guard<std::mutex> readGuard(_readMutex);
+	_receiveBufferSize = size < 0 ? 0 : size;
+	if(_socketDescriptor && _socketDescriptor->descriptor != -1) applyReceiveBufferSize();
+}
+
+int32_t UdpSocket::getReceiveBufferSize()
+{
+	if(!_socketDescriptor || _socketDescriptor->descriptor == -1) return -1;
+	int32_t size = 0;
+	socklen_t sizeLength = sizeof(size);
+	if(getsockopt(_socketDescriptor->descriptor, SOL_SOCKET, SO_RCVBUF, &size, &sizeLength) == -1) return -1;
+	return size;
+}
+
+void UdpSocket::applyReceiveBufferSize()
+{
+	if(_receiveBufferSize == 0) return;
+	if(setsockopt(_socketDescriptor->descriptor, SOL_SOCKET, SO_RCVBUF, &_receiveBufferSize, sizeof(_receiveBufferSize)) == -1)
+	{
+		_bl->out.printWarning("Warning: Could not set receive buffer size of UDP socket to " + std::to_string(_receiveBufferSize) + " bytes: " + std::string(strerror(errno)));
+	}
+}
+
+void UdpSocket::getAddress(const struct sockaddr_storage& address, std::string& ip, uint16_t& port)
+{
+	char ipStringBuffer[INET6_ADDRSTRLEN];
+	ipStringBuffer[0] = 0;
+	if(address.ss_family == AF_INET)
+	{
+		struct sockaddr_in* s = (struct sockaddr_in*)&address;
+		inet_ntop(AF_INET, &s->sin_addr, ipStringBuffer, sizeof(ipStringBuffer));
+		port = ntohs(s->sin_port);
+	}
+	else
+	{ // AF_INET6
+		struct sockaddr_in6* s = (struct sockaddr_in6*)&address;
+		inet_ntop(AF_INET6, &s->sin6_addr, ipStringBuffer, sizeof(ipStringBuffer));
+		port = ntohs(s->sin6_port);
+	}
+	ip = std::string(&ipStringBuffer[0]);
+}
+
 bool UdpSocket::isOpen()
 {
 	if(!_serverInfo || !_socketDescriptor || _socketDescriptor->descriptor == -1) return false;
@@ -368,6 +561,14 @@ void UdpSocket::getConnection()
 		}
 	}
 
+	//Per-datagram receive times for proofreadBatch()
+	int32_t timestampOption = 1;
+	if(setsockopt(_socketDescriptor->descriptor, SOL_SOCKET, SO_TIMESTAMP, &timestampOption, sizeof(timestampOption)) == -1)
+	{
+		_bl->out.printWarning("Warning: Could not enable receive timestamps for UDP socket: " + std::string(strerror(errno)));
+	}
+	applyReceiveBufferSize();
+
 	if(_serverInfo->ai_family == AF_INET)
 	{
 		struct sockaddr_in clientInfo;
@@ -32,6 +32,7 @@
 #define UDPSOCKETOPERATIONS_H_
 
 #include "SocketExceptions.h"
+#include "SocketMetrics.h"
 #include "../Managers/FileDescriptorManager.h"
 
 namespace BaseLib
@@ -42,11 +43,38 @@ class SharedObjects;
 class UdpSocket
 {
 public:
+	/**
+	 * A datagram read by proofreadBatch().
+	 */
+	struct Datagram
+	{
+		std::vector<char> data;
+		std::string senderIp;
+		uint16_t senderPort = 0;
+
+		/**
+		 * The time the kernel received the datagram in microseconds since the epoch.
+		 */
+		int64_t timestamp = 0;
+
+		/**
+		 * Set when the datagram was larger than the maximum datagram size passed to proofreadBatch() and "data" only contains its beginning.
+		 */
+		bool truncated = false;
+	};
+
 	UdpSocket(BaseLib::SharedObjects* baseLib);
 	UdpSocket(BaseLib::SharedObjects* baseLib, std::string hostname, std::string port);
 	virtual ~UdpSocket();
 
 	void setReadTimeout(int64_t timeout) { _readTimeout = timeout; }
+
+	/**
+	 * Sets the time proofwriteBatch() waits for room in the send buffer.
+	 *
+	 * @param timeout The timeout in microseconds. The default is 15 seconds.
+	 */
+	void setWriteTimeout(int64_t timeout) { _writeTimeout = timeout; }
 	void setAutoConnect(bool autoConnect) { _autoConnect = autoConnect; }
 	void setHostname(std::string hostname) { close(); _hostname = hostname; }
 	void setPort(std::string port) { close(); _port = port; }
@@ -54,8 +82,29 @@ public:
 	std::string getListenIp() { return _listenIp; }
 	int32_t getListenPort() { return _listenPort; }
 
+	/**
+	 * Sets the size of the kernel's receive buffer (SO_RCVBUF). Increase it for sockets receiving bursts of datagrams, which are dropped by the kernel
+	 * when the buffer is full. The setting is applied immediately when the socket is open and otherwise when it is opened. The kernel limits the size to
+	 * "net.core.rmem_max".
+	 *
+	 * @param size The size in bytes. "0" keeps the system's default.
+	 */
+	void setReceiveBufferSize(int32_t size);
+
+	/**
+	 * Returns the size of the kernel's receive buffer as reported by the kernel. Linux doubles the requested size to account for its bookkeeping overhead.
+	 *
+	 * @return Returns the size in bytes or -1 when the socket is not open.
+	 */
+	int32_t getReceiveBufferSize();
+
 	bool isOpen();
 
+	/**
+	 * Returns the transferred bytes and datagrams and the number of read timeouts as a struct.
+	 */
+	PVariable getMetrics();
+
 	/**
 	 * Reads bytes from UDP socket into "buffer".
 	 *
@@ -69,6 +118,31 @@ public:
 	 */
 	int32_t proofread(char* buffer, int32_t bufferSize, std::string& senderIp);
 
+	/**
+	 * Reads multiple datagrams with one system call (recvmmsg()). Waits until at least one datagram is available, then returns all queued datagrams up
+	 * to "maxDatagrams" without waiting any further. The elements of "datagrams" are reused, so passing the same vector on every call avoids allocations.
+	 *
+	 * @param[in,out] datagrams The received datagrams are written into the first elements. It is enlarged to "maxDatagrams" elements if it is smaller.
+	 * Elements after the returned number are left unchanged.
+	 * @param maxDatagrams The maximum number of datagrams to read.
+	 * @param maxDatagramSize (Optional, default 65536) The maximum size of a datagram. Larger datagrams are truncated.
+	 * @return Returns the number of datagrams read. Never returns 0 or a negative number.
+	 * @throws SocketTimeOutException Thrown on timeout.
+	 * @throws SocketClosedException Thrown when socket was closed.
+	 * @throws SocketOperationException Thrown when socket is nullptr.
+	 */
+	int32_t proofreadBatch(std::vector<Datagram>& datagrams, uint32_t maxDatagrams, uint32_t maxDatagramSize = 65536);
+
+	/**
+	 * Sends multiple datagrams to the host and port of this socket with as few system calls as possible (sendmmsg()).
+	 *
+	 * @param datagrams The datagrams to send.
+	 * @return Returns the number of datagrams sent, which is always the number of elements of "datagrams".
+	 * @throws SocketTimeOutException Thrown when the send buffer stays full longer than the write timeout. Part of the datagrams might have been sent.
+	 * @throws SocketOperationException Thrown when sending fails.
+	 */
+	int32_t proofwriteBatch(const std::vector<std::vector<char>>& datagrams);
+
 	int32_t proofwrite(const std::shared_ptr<std::vector<char>> data);
 	int32_t proofwrite(const std::vector<char>& data);
 	int32_t proofwrite(const std::string& data);
@@ -78,6 +152,7 @@ public:
 protected:
 	BaseLib::SharedObjects* _bl = nullptr;
 	int64_t _readTimeout = 15000000;
+	int64_t _writeTimeout = 15000000;
 	bool _autoConnect = true;
 	std::string _hostname;
 	std::string _clientIp;
@@ -87,12 +162,22 @@ protected:
 	struct addrinfo* _serverInfo = nullptr;
 	std::mutex _readMutex;
 	std::mutex _writeMutex;
+	SocketMetrics _metrics;
+	int32_t _receiveBufferSize = 0;
+	std::vector<char> _batchBuffer; //Guarded by "_readMutex"
 
 	std::shared_ptr<FileDescriptor> _socketDescriptor;
 
 	void getSocketDescriptor();
 	void getConnection();
 	void autoConnect();
+
+	/**
+	 * Applies "_receiveBufferSize" to the socket.
+	 */
+	void applyReceiveBufferSize();
+
+	static void getAddress(const struct sockaddr_storage& address, std::string& ip, uint16_t& port);
 };
 
 typedef std::shared_ptr<BaseLib::UdpSocket> PUdpSocket;